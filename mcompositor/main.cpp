@@ -21,6 +21,8 @@
 #include <QGLWidget>
 #include "mcompositescene.h"
 #include "mcompositemanager.h"
+#include "xserverpinger.h"
+#include <string.h>
 
 int main(int argc, char *argv[])
 {
@@ -33,6 +35,18 @@ int main(int argc, char *argv[])
     setenv("CONTEXT_COMMANDING", "1", 1);
 #endif
     
+    // Measure the X server's round trips for the stats if asked.  The
+    // pinger is forked, so it has to be started before we connect to X.
+    bool xpinger = false;
+#ifdef WINDOW_DEBUG_ALOT
+    xpinger = true;
+#endif
+    for (int i = 1; i < argc; i++)
+        if (!strcmp(argv[i], "-xpinger"))
+            xpinger = true;
+    if (xpinger)
+        XServerPinger::startProcess();
+
     // Don't load any Qt plugins
     QCoreApplication::setLibraryPaths(QStringList());
     MCompositeManager app(argc, argv);
@@ -11,11 +11,7 @@ target.path += $$M_INSTALL_BIN
 INSTALLS += target 
 
 # Input
-SOURCES += main.cpp
-
-contains(DEFINES, WINDOW_DEBUG_ALOT) {
-    HEADERS += xserverpinger.h
-    SOURCES += xserverpinger.cpp
-}
+HEADERS += xserverpinger.h
+SOURCES += main.cpp xserverpinger.cpp
 
 QT = core gui opengl
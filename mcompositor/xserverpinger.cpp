@@ -1,6 +1,8 @@
 // Instances of XServerPinger send some simple X requests periodically
-// and warn no reply arrives until the next ping.
+// and warn no reply arrives until the next ping.  The round-trip times
+// are published to the compositor in MXPingStats.
 #include "xserverpinger.h"
+#include "mxpingstats.h"
 
 #include <QCoreApplication>
 #include <QSocketNotifier>
@@ -12,9 +14,12 @@
 #include <xcb/xcb.h>
 #include <xcb/xcbext.h>
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <signal.h>
 #include <sys/prctl.h>
 #include <sys/signalfd.h>
+#include <sys/wait.h>
 
 // Ping X in @pingInterval miliseconds.
 XServerPinger::XServerPinger(int pingInterval)
@@ -31,6 +36,8 @@ XServerPinger::XServerPinger(int pingInterval)
     // XGetInputFocus() is our ping request.
     request = xcb_get_input_focus(xcb);
     xcb_flush(xcb);
+    if ((stats = MXPingStats::shared()) != NULL)
+        stats->pingSent(MLatencyHistogram::now());
 
     timer = new QTimer();
     connect(timer, SIGNAL(timeout()), SLOT(tick()));
@@ -62,6 +69,8 @@ void XServerPinger::xInput(int)
         if (reply) {
             free(reply);
             request.sequence = 0;
+            if (stats)
+                stats->replyReceived(MLatencyHistogram::now());
         } else if (error)
             // Ignore
             free(error);
@@ -74,6 +83,8 @@ void XServerPinger::tick()
         // Last ping was successful, keep pinging.
         request = xcb_get_input_focus(xcb);
         xcb_flush(xcb);
+        if (stats)
+            stats->pingSent(MLatencyHistogram::now());
     } else
         // Ping timed out
         qWarning("X is on holidays");
@@ -95,18 +106,33 @@ void XServerPinger::die(int)
     QCoreApplication::quit();
 }
 
-// Start XServerPinger in a separate process if it's not running yet.
-static void altmain() __attribute__((constructor));
-static void altmain()
+// Start XServerPinger in a separate process, replacing the one we had
+// before a restart.
+void XServerPinger::startProcess()
 {
-    // Don't run again if the parent restarted.
-    if (getenv("XSERVERPINGER"))
-        return;
-    putenv("XSERVERPINGER=1");
+    // If the parent restarted, the pinger it had before exec() is still
+    // running and writing to a segment we don't have anymore.  Replace
+    // it; it's our child, so wait until it's gone.
+    if (const char *old = getenv("XSERVERPINGER")) {
+        pid_t old_pid = atoi(old);
+        if (old_pid > 0 && !kill(old_pid, SIGTERM))
+            waitpid(old_pid, NULL, 0);
+    }
+
+    // Shared with the compositor, so map it before forking.
+    const int interval = 2500;
+    MXPingStats::create(interval);
 
     // Start a new process and let our parent (the real mcompositor) go.
-    if (fork())
+    pid_t pid = fork();
+    if (pid) {
+        if (pid > 0) {
+            char str[16];
+            snprintf(str, sizeof(str), "%d", pid);
+            setenv("XSERVERPINGER", str, 1);
+        }
         return;
+    }
 
     // Die with the parent.
     prctl(PR_SET_PDEATHSIG, SIGTERM);
@@ -114,7 +140,7 @@ static void altmain()
     int meh = 0;
     QCoreApplication app(meh, 0);
 
-    XServerPinger pinger(2500);
+    XServerPinger pinger(interval);
     app.exec();
     exit(0);
 }
@@ -6,16 +6,21 @@
 
 #include <xcb/xcb.h>
 
+class MXPingStats;
+
 class XServerPinger: public QObject
 {
     Q_OBJECT
 
 public:
     XServerPinger(int pingInterval);
+    //! Forks the pinger; must be called before connecting to X.
+    static void startProcess();
 protected:
     xcb_connection_t *xcb;
     xcb_get_input_focus_cookie_t request;
     QTimer *timer;
+    MXPingStats *stats;
 
 public slots:
     void xInput(int);
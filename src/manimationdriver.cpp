@@ -0,0 +1,107 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "manimationdriver.h"
+#include "mcompwindowanimator.h"
+#include <QWidget>
+
+static const int Fps = 60;
+
+MAnimationDriver::MAnimationDriver()
+    : widget(0), suspended(false)
+{
+    frame_timer.setInterval(1000 / Fps);
+    connect(&frame_timer, SIGNAL(timeout()), SLOT(advance()));
+    clock.start();
+}
+
+int MAnimationDriver::indexOf(const MCompWindowAnimator *a) const
+{
+    for (int i = 0; i < animations.size(); ++i)
+        if (animations[i].animator == a)
+            return i;
+    return -1;
+}
+
+void MAnimationDriver::start(MCompWindowAnimator *a)
+{
+    int i = indexOf(a);
+    if (i < 0) {
+        Animation anim = { a, clock.elapsed() };
+        animations.append(anim);
+    } else
+        animations[i].start = clock.elapsed();
+    if (!frame_timer.isActive())
+        frame_timer.start(suspended ? 0 : 1000 / Fps);
+}
+
+void MAnimationDriver::stop(MCompWindowAnimator *a)
+{
+    int i = indexOf(a);
+    if (i >= 0)
+        animations.remove(i);
+    if (animations.isEmpty())
+        frame_timer.stop();
+}
+
+void MAnimationDriver::setSuspended(bool s)
+{
+    suspended = s;
+    if (!animations.isEmpty())
+        frame_timer.start(suspended ? 0 : 1000 / Fps);
+}
+
+bool MAnimationDriver::isRunning(const MCompWindowAnimator *a) const
+{
+    return indexOf(a) >= 0;
+}
+
+void MAnimationDriver::advance()
+{
+    // All animations see the same time in a frame.  Work on a copy,
+    // because finishing an animation can start or stop others.
+    int now = clock.elapsed();
+    QVector<Animation> frame = animations;
+    bool repaint = false;
+
+    for (int i = 0; i < frame.size(); ++i) {
+        MCompWindowAnimator *a = frame[i].animator;
+        int j = indexOf(a);
+        if (j < 0 || animations[j].start != frame[i].start)
+            // stopped or restarted meanwhile
+            continue;
+
+        int elapsed = suspended ? a->duration() : now - frame[i].start;
+        bool finished = elapsed >= a->duration();
+        if (finished)
+            animations.remove(j);
+        // always apply the last frame, it's the state the window stays in
+        if (finished || !a->isObscured()) {
+            a->advanceFrame(a->valueForTime(elapsed));
+            repaint = true;
+        }
+        if (finished)
+            a->finish();
+    }
+
+    if (animations.isEmpty())
+        frame_timer.stop();
+    if (repaint && widget && !suspended)
+        widget->update();
+}
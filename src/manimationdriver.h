@@ -0,0 +1,77 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MANIMATIONDRIVER_H
+#define MANIMATIONDRIVER_H
+
+#include <QObject>
+#include <QVector>
+#include <QTimer>
+#include <QTime>
+
+class QWidget;
+class MCompWindowAnimator;
+
+/*!
+ * Advances all running window animations from one frame timer, so that
+ * simultaneous transitions are evaluated in a single pass and cause one
+ * repaint per frame.  Animations of windows which are fully obscured
+ * are not evaluated until their last frame.
+ */
+class MAnimationDriver: public QObject
+{
+    Q_OBJECT
+
+public:
+    MAnimationDriver();
+
+    //! The widget to repaint after the animations have been advanced.
+    void setWidget(QWidget *w) { widget = w; }
+
+    //! Starts driving \a a from its first frame.
+    void start(MCompWindowAnimator *a);
+    //! Stops driving \a a without finishing it.
+    void stop(MCompWindowAnimator *a);
+    bool isRunning(const MCompWindowAnimator *a) const;
+    int running() const { return animations.size(); }
+
+    /*!
+     * While suspended (the display is off) no frames are rendered, and
+     * animations are finished on the next pass of the event loop.
+     */
+    void setSuspended(bool s);
+
+private slots:
+    void advance();
+
+private:
+    struct Animation {
+        MCompWindowAnimator *animator;
+        int start;
+    };
+    int indexOf(const MCompWindowAnimator *a) const;
+
+    QVector<Animation> animations;
+    QTimer frame_timer;
+    QTime clock;
+    QWidget *widget;
+    bool suspended;
+};
+
+#endif
@@ -78,6 +78,8 @@ public:
         // misc
         _NET_WM_PID,
         _NET_WM_PING,
+        _NET_WM_SYNC_REQUEST,
+        _NET_WM_SYNC_REQUEST_COUNTER,
 
         // root messages
         _NET_ACTIVE_WINDOW,
@@ -127,25 +129,40 @@ public:
     int getPid(Window w);
     bool hasState(Window w, Atom a);
     QVector<Atom> getAtomArray(Window w, Atom array_atom);
-    unsigned int get_opacity_prop(Display *dpy, Window w, unsigned int def);
-    double get_opacity_percent(Display *dpy, Window w, double def);
-    int globalAlphaFromWindow(Window w);
 
     Atom getAtom(const unsigned int name);
-    Atom getType(Window w);
 
     static Atom atoms[ATOMS_TOTAL];
     int cardValueProperty(Window w, Atom property);
 
+    // first XSync event, or -1 without the extension
+    int syncEventBase() const { return sync_event; }
+
+#ifdef WINDOW_DEBUG
+    // The helpers above each wait for the X server.  They are only meant
+    // for windows without an MWindowPropertyCache; count how many times
+    // we block like that while handling each type of X event (0 when not
+    // handling any) to catch the ones that slip into the hot paths.
+    void roundTrip() { ++round_trips[current_event & 0x7f]; }
+    int current_event;
+    unsigned round_trips[128];
+#endif
+
 private:
     explicit MCompAtoms();
     static MCompAtoms *d;
 
-    Atom getAtom(Window w, Atoms atomtype);
-
     Display *dpy;
+    int sync_event;
 };
 
 #define ATOM(t) MCompAtoms::instance()->getAtom(MCompAtoms::t)
 
+// Put this next to the synchronous Xlib calls.
+#ifdef WINDOW_DEBUG
+# define SYNC_ROUND_TRIP() MCompAtoms::instance()->roundTrip()
+#else
+# define SYNC_ROUND_TRIP() do { } while (0)
+#endif
+
 #endif
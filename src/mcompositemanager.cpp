@@ -19,6 +19,7 @@
 
 #include "mtexturepixmapitem.h"
 #include "mtexturepixmapitem_p.h"
+#include "mcompwindowanimator.h"
 #include "mcompositemanager.h"
 #include "mcompositemanager_p.h"
 #include "mcompositescene.h"
@@ -28,11 +29,17 @@
 #include "mcompositemanagerextension.h"
 #include "mcompmgrextensionfactory.h"
 #include "mcompositordebug.h"
+#include "mstackingrules.h"
+#include "mxreader.h"
+#include "meventrecorder.h"
+#include "mxpingstats.h"
+#include "mtrace.h"
 #include <mrmiserver.h>
 
 #include <QX11Info>
 #include <QByteArray>
 #include <QVector>
+#include <QSocketNotifier>
 #include <QtPlugin>
 
 #include <X11/Xutil.h>
@@ -47,6 +54,9 @@
 #include "mcompatoms_p.h"
 
 #include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
 
@@ -54,7 +64,6 @@
 #include <sys/stat.h>
 
 #define TRANSLUCENT 0xe0000000
-#define OPAQUE      0xffffffff
 
 /*
   The reason why we have to look at the entire redirected buffers is that we
@@ -69,9 +78,6 @@
   and allocating EGL resources for the entire buffers is low.
  */
 
-// own log for catching bugs
-#define _log(txt, args... ) { FILE *out; out = fopen("/tmp/mcompositor.log", "a"); if(out) { fprintf(out, "" txt, ##args ); fclose(out); } }
-
 #define COMPOSITE_WINDOW(X) MCompositeWindow::compositeWindow(X)
 #define FULLSCREEN_WINDOW(X) \
         ((X)->propertyCache()->netWmState().indexOf(ATOM(_NET_WM_STATE_FULLSCREEN)) != -1)
@@ -167,6 +173,8 @@ MCompAtoms::MCompAtoms()
         // misc
         "_NET_WM_PID",
         "_NET_WM_PING",
+        "_NET_WM_SYNC_REQUEST",
+        "_NET_WM_SYNC_REQUEST_COUNTER",
 
         // root messages
         "_NET_ACTIVE_WINDOW",
@@ -214,9 +222,24 @@ MCompAtoms::MCompAtoms()
     if (!XInternAtoms(dpy, (char **)atom_names, ATOMS_TOTAL, False, atoms))
         qCritical("XInternAtoms failed");
 
+    // Don't make clients wait for _NET_WM_SYNC_REQUESTs we can't send.
+    int sync_error, sync_major, sync_minor;
+    if (!XSyncQueryExtension(dpy, &sync_event, &sync_error)
+        || !XSyncInitialize(dpy, &sync_major, &sync_minor))
+        sync_event = -1;
+    QVector<Atom> supported;
+    for (int i = 0; i < END_OF_NET_SUPPORTED; ++i)
+        if (sync_event >= 0 || (i != _NET_WM_SYNC_REQUEST
+                          && i != _NET_WM_SYNC_REQUEST_COUNTER))
+            supported.append(atoms[i]);
     XChangeProperty(dpy, QX11Info::appRootWindow(), atoms[_NET_SUPPORTED],
-                    XA_ATOM, 32, PropModeReplace, (unsigned char *)atoms,
-                    END_OF_NET_SUPPORTED);
+                    XA_ATOM, 32, PropModeReplace,
+                    (unsigned char *)supported.constData(), supported.size());
+
+#ifdef WINDOW_DEBUG
+    current_event = 0;
+    memset(round_trips, 0, sizeof(round_trips));
+#endif
 }
 
 MCompAtoms::Type MCompAtoms::windowType(Window w)
@@ -275,56 +298,29 @@ QVector<Atom> MCompAtoms::getAtomArray(Window w, Atom array_atom)
     int format;
     unsigned long n, left;
     unsigned char *data = 0;
-    int result = XGetWindowProperty(QX11Info::display(), w, array_atom, 0, 0,
-                                    False, XA_ATOM, &actual, &format,
-                                    &n, &left, &data);
-    if (data && result == Success && actual == XA_ATOM && format == 32) {
-        ret.resize(left / 4);
-        XFree((void *) data);
-        data = 0;
-
-        if (XGetWindowProperty(QX11Info::display(), w, array_atom, 0,
-                               ret.size(), False, XA_ATOM, &actual, &format,
-                               &n, &left, &data) != Success) {
-            ret.clear();
-        } else if (n != (ulong)ret.size())
-            ret.resize(n);
-
-        if (!ret.isEmpty())
-            memcpy(ret.data(), data, ret.size() * sizeof(Atom));
+    long len = 32;
+    // Guess the length so that we usually get away with one round trip.
+    do {
+        if (data) {
+            XFree(data);
+            data = 0;
+            len += (left + 3) / 4;
+        }
+        SYNC_ROUND_TRIP();
+        if (XGetWindowProperty(QX11Info::display(), w, array_atom, 0, len,
+                               False, XA_ATOM, &actual, &format,
+                               &n, &left, &data) != Success)
+            return ret;
+    } while (data && left > 0 && actual == XA_ATOM);
+    if (data && actual == XA_ATOM && format == 32 && n > 0) {
+        ret.resize(n);
+        memcpy(ret.data(), data, ret.size() * sizeof(Atom));
     }
     if (data) XFree(data);
 
     return ret;
 }
 
-unsigned int MCompAtoms::get_opacity_prop(Display *dpy, Window w, unsigned int def)
-{
-    Q_UNUSED(dpy);
-    Atom actual;
-    int format;
-    unsigned long n, left;
-
-    unsigned char *data = 0;
-    int result = XGetWindowProperty(QX11Info::display(), w, atoms[_NET_WM_WINDOW_OPACITY], 0L, 1L, False,
-                                    XA_CARDINAL, &actual, &format,
-                                    &n, &left, &data);
-    if (result == Success && data != NULL) {
-        unsigned int i;
-        memcpy(&i, data, sizeof(unsigned int));
-        XFree((void *) data);
-        return i;
-    }
-    return def;
-}
-
-double MCompAtoms::get_opacity_percent(Display *dpy, Window w, double def)
-{
-    unsigned int opacity = get_opacity_prop(dpy, w,
-                                            (unsigned int)(OPAQUE * def));
-    return opacity * 1.0 / OPAQUE;
-}
-
 Atom MCompAtoms::getAtom(const unsigned int name)
 {
     return atoms[name];
@@ -337,6 +333,7 @@ int MCompAtoms::cardValueProperty(Window w, Atom property)
     unsigned long n, left;
     unsigned char *data = 0;
 
+    SYNC_ROUND_TRIP();
     int result = XGetWindowProperty(QX11Info::display(), w, property, 0L, 1L, False,
                                     XA_CARDINAL, &actual, &format,
                                     &n, &left, &data);
@@ -349,47 +346,30 @@ int MCompAtoms::cardValueProperty(Window w, Atom property)
     return 0;
 }
 
-Atom MCompAtoms::getType(Window w)
-{
-    Atom t = getAtom(w, _NET_WM_WINDOW_TYPE);
-    if (t)
-        return t;
-    return atoms[_NET_WM_WINDOW_TYPE_NORMAL];
-}
-
-Atom MCompAtoms::getAtom(Window w, Atoms atomtype)
-{
-    Atom actual;
-    int format;
-    unsigned long n, left;
-    unsigned char *data = 0;
-
-    int result = XGetWindowProperty(QX11Info::display(), w, atoms[atomtype], 0L, 1L, False,
-                                    XA_ATOM, &actual, &format,
-                                    &n, &left, &data);
-    if (result == Success && data) {
-        Atom a;
-        memcpy(&a, data, sizeof(Atom));
-        XFree((void *) data);
-        return a;
-    }
-    return 0;
-}
-
 static Window transient_for(Window window)
 {
     Window transient_for = 0;
+    SYNC_ROUND_TRIP();
     XGetTransientForHint(QX11Info::display(), window, &transient_for);
     if (transient_for == window)
         transient_for = 0;
     return transient_for;
 }
 
+// Returns the _NET_WM_STATE of @window, from the property cache if we can.
+static QVector<Atom> net_wm_state(Window window)
+{
+    MCompositeManager *m = (MCompositeManager*)qApp;
+    MWindowPropertyCache *pc = m->d->registry.propertyCache(window);
+    if (pc && pc->is_valid)
+        return pc->netWmState().toVector();
+    return MCompAtoms::instance()->getAtomArray(window, ATOM(_NET_WM_STATE));
+}
+
 static void skiptaskbar_wm_state(int toggle, Window window)
 {
     Atom skip = ATOM(_NET_WM_STATE_SKIP_TASKBAR);
-    MCompAtoms *atom = MCompAtoms::instance();
-    QVector<Atom> states = atom->getAtomArray(window, ATOM(_NET_WM_STATE));
+    QVector<Atom> states = net_wm_state(window);
     bool update_root = false;
     int i = states.indexOf(skip);
 
@@ -425,6 +405,11 @@ static void skiptaskbar_wm_state(int toggle, Window window)
     }
 
     if (update_root) {
+        MCompositeManager *m = (MCompositeManager*)qApp;
+        MWindowPropertyCache *pc = m->d->registry.propertyCache(window);
+        if (pc)
+            pc->setNetWmState(states.toList());
+
         XPropertyEvent p;
         p.send_event = True;
         p.display = QX11Info::display();
@@ -440,16 +425,15 @@ static void skiptaskbar_wm_state(int toggle, Window window)
 
 static void fullscreen_wm_state(MCompositeManagerPrivate *priv,
                                 int toggle, Window window,
-                                QVector<Atom> *net_wm_state = 0)
+                                QVector<Atom> *new_wm_state = 0)
 {
     Atom fullscreen = ATOM(_NET_WM_STATE_FULLSCREEN);
     Display *dpy = QX11Info::display();
-    MCompAtoms *atom = MCompAtoms::instance();
     QVector<Atom> states;
-    if (net_wm_state)
-        states = *net_wm_state;
+    if (new_wm_state)
+        states = *new_wm_state;
     else
-        states = atom->getAtomArray(window, ATOM(_NET_WM_STATE));
+        states = net_wm_state(window);
     int i = states.indexOf(fullscreen);
 
     switch (toggle) {
@@ -490,7 +474,7 @@ static void fullscreen_wm_state(MCompositeManagerPrivate *priv,
         int yres = ScreenOfDisplay(dpy, DefaultScreen(dpy))->height;
         XMoveResizeWindow(dpy, window, 0, 0, xres, yres);
         MOVE_RESIZE(window, 0, 0, xres, yres);
-        MCompositeWindow *win = priv->windows.value(window, 0);
+        MCompositeWindow *win = priv->registry.compositeWindow(window);
         if (win) {
             win->propertyCache()->setRequestedGeometry(QRect(0, 0, xres, yres));
             win->propertyCache()->setNetWmState(states.toList());
@@ -652,7 +636,9 @@ static Bool map_predicate(Display *display, XEvent *xevent, XPointer arg)
 
 static void kill_window(Window window)
 {
-    int pid = MCompAtoms::instance()->getPid(window);
+    MCompositeManager *m = (MCompositeManager*)qApp;
+    MWindowPropertyCache *pc = m->d->registry.propertyCache(window);
+    int pid = pc ? pc->pid() : MCompAtoms::instance()->getPid(window);
     if (pid != 0) {
         // negative PID to kill the whole process group
         ::kill(-pid, SIGKILL);
@@ -671,6 +657,36 @@ static void safe_move(QList<Window>& winlist, int from, int to)
     winlist.move(from,to);
 }
 
+// Updates a window list property on the root window if @wins differs from
+// what was set last time (@prev).  Appending and prepending is done with
+// the respective modes to keep the requests small; anything else rewrites
+// the whole property.  @prev is updated to match @wins.
+static void update_root_window_list(Atom prop, const QVector<Window> &wins,
+                                    QVector<Window> &prev)
+{
+    if (wins == prev)
+        return;
+
+    const Window *data = wins.constData();
+    int n = wins.size(), m = prev.size(), mode = PropModeReplace;
+    if (m > 0 && n > m) {
+        if (!memcmp(data, prev.constData(), m * sizeof(Window))) {
+            mode = PropModeAppend;
+            data += m;
+            n -= m;
+        } else if (!memcmp(data + n - m, prev.constData(),
+                           m * sizeof(Window))) {
+            mode = PropModePrepend;
+            n -= m;
+        }
+    }
+    XChangeProperty(QX11Info::display(), RootWindow(QX11Info::display(), 0),
+                    prop, XA_WINDOW, 32, mode, (unsigned char *)data, n);
+    // copy rather than share, so that neither buffer is detached later
+    prev.resize(wins.size());
+    qCopy(wins.constBegin(), wins.constEnd(), prev.begin());
+}
+
 MCompositeManagerPrivate::MCompositeManagerPrivate(QObject *p)
     : QObject(p),
       prev_focus(0),
@@ -680,10 +696,26 @@ MCompositeManagerPrivate::MCompositeManagerPrivate(QObject *p)
       changed_properties(false),
       prepared(false),
       stacking_timeout_check_visibility(false),
-      stacking_timeout_timestamp(CurrentTime)
+      stacking_timeout_timestamp(CurrentTime),
+      stacking_held(false),
+      in_event_batch(false),
+      batch_stacking(false),
+      batch_focus_check(false),
+      draw_usecs(0),
+      recorder(0)
 {
     xcb_conn = XGetXCBConnection(QX11Info::display());
     MWindowPropertyCache::set_xcb_connection(xcb_conn);
+    if (qApp->arguments().contains("-xreader")) {
+        xreader = new MXReader(xcb_conn, this);
+        connect(xreader, SIGNAL(repliesArrived()),
+                SLOT(collectPropertyReplies()));
+    } else
+        xreader = 0;
+    gpu_transitions = qApp->arguments().contains("-gpu-transitions");
+    render_suspended = false;
+    suspend_release = qApp->arguments().contains("-suspend-release");
+    sync_event = -1; // until prepare()
 
     watch = new MCompositeScene(this);
     atom = MCompAtoms::instance();
@@ -694,6 +726,7 @@ MCompositeManagerPrivate::MCompositeManagerPrivate(QObject *p)
     connect(device_state, SIGNAL(callStateChange(bool)),
             this, SLOT(callOngoing(bool)));
     stacking_timer.setSingleShot(true);
+    stacking_timer.setInterval(0);
     connect(&stacking_timer, SIGNAL(timeout()), this, SLOT(stackingTimeout()));
     connect(this, SIGNAL(currentAppChanged(Window)), this,
             SLOT(setupButtonWindows(Window)));
@@ -706,6 +739,7 @@ MCompositeManagerPrivate::~MCompositeManagerPrivate()
         XDeleteProperty(QX11Info::display(), QX11Info::appRootWindow(),
                         ATOM(_NET_SUPPORTING_WM_CHECK));
 
+    delete recorder;
     delete watch;
     delete atom;
     watch   = 0;
@@ -717,6 +751,7 @@ Window MCompositeManagerPrivate::parentWindow(Window child)
     uint children = 0;
     Window r, p, *kids = 0;
 
+    SYNC_ROUND_TRIP();
     XQueryTree(QX11Info::display(), child, &r, &p, &kids, &children);
     if (kids)
         XFree(kids);
@@ -788,6 +823,16 @@ void MCompositeManagerPrivate::prepare()
     XMoveWindow(QX11Info::display(), localwin, -2, -2);
 
     XDamageQueryExtension(QX11Info::display(), &damage_event, &damage_error);
+    // queried by MCompAtoms for _NET_SUPPORTED
+    sync_event = atom->syncEventBase();
+    if (sync_event < 0)
+        qWarning("%s: no XSync extension, _NET_WM_SYNC_REQUEST disabled",
+                 __func__);
+    startup_profile.open(QString(QDir::homePath() + "/.mcompositor-startup")
+                         .toLocal8Bit().constData());
+    foreach (const QString &arg, qApp->arguments())
+        if (arg.startsWith("-record="))
+            recordEvents(arg.mid(strlen("-record=")).toLocal8Bit().constData());
 
     // create InputOnly windows for close and Home button handling
     close_button_win = XCreateWindow(QX11Info::display(),
@@ -868,6 +913,7 @@ bool MCompositeManagerPrivate::needDecoration(Window window,
         return false;
     else if (!pc) {
         XWindowAttributes a;
+        SYNC_ROUND_TRIP();
         if (!XGetWindowAttributes(QX11Info::display(), window, &a)
             || a.override_redirect || a.c_class == InputOnly)
             return false;
@@ -891,6 +937,14 @@ void MCompositeManagerPrivate::damageEvent(XDamageNotifyEvent *e)
     XDamageSubtract(QX11Info::display(), e->damage, None, None);
 
     MCompositeWindow *item = COMPOSITE_WINDOW(e->drawable);
+    if (render_suspended) {
+        // a window mapped while the display is off, resumeRendering()
+        // will refresh it
+        if (item && item->propertyCache())
+            item->propertyCache()->damageTracking(false);
+        return;
+    }
+    startup_profile.damage(e->drawable);
     if (item) {
         /* partial updates disabled for now, does not always work, unless we
          * check for EGL_BUFFER_PRESERVED or GLX_SWAP_COPY_OML first, see
@@ -902,29 +956,44 @@ void MCompositeManagerPrivate::damageEvent(XDamageNotifyEvent *e)
     }
 }
 
+// The client has drawn the frame we asked for with _NET_WM_SYNC_REQUEST.
+void MCompositeManagerPrivate::syncAlarmEvent(XSyncAlarmNotifyEvent *e)
+{
+    Window w = sync_alarms.value(e->alarm, None);
+    MCompositeWindow *item = w ? COMPOSITE_WINDOW(w) : 0;
+    if (item)
+        item->syncReceived();
+}
+
 void MCompositeManagerPrivate::destroyEvent(XDestroyWindowEvent *e)
 {
-    configure_reqs.remove(e->window);
+    registry.takeConfigureRequests(e->window);
+
+    if (MWindowPropertyCache *pc = registry.propertyCache(e->window)) {
+        // its replies won't come, don't hold the stacking pass for them
+        pending_prop_caches.remove(pc);
+        releaseStackingHold();
+    }
 
     MCompositeWindow *item = COMPOSITE_WINDOW(e->window);
     if (item) {
         item->deleteLater();
         removeWindow(item->window());
-        prop_caches.remove(item->window());
+        registry.setPropertyCache(item->window(), 0);
         // PC deleted with the MCompositeWindow.  Till then we've made sure
         // that we can't reuse it, even if a window with the same XID is
         // created before @item is actually destroyed.
     } else {
         // We got a destroy event from a framed window (or a window that was
         // never mapped)
-        FrameData fd = framed_windows.value(e->window);
+        FrameData fd = registry.frameData(e->window);
         if (fd.frame) {
-            framed_windows.remove(e->window);
+            registry.removeFrameData(e->window);
             delete fd.frame;
         }
-        if (prop_caches.contains(e->window)) {
-            delete prop_caches.value(e->window);
-            prop_caches.remove(e->window);
+        if (MWindowPropertyCache *pc = registry.propertyCache(e->window)) {
+            registry.setPropertyCache(e->window, 0);
+            delete pc;
         }
     }
 }
@@ -933,23 +1002,23 @@ void MCompositeManagerPrivate::propertyEvent(XPropertyEvent *e)
 {
     MWindowPropertyCache *pc;
 
-    if (!prop_caches.contains(e->window))
+    if (!registry.propertyCache(e->window))
         return;
-    pc = prop_caches.value(e->window);
+    pc = registry.propertyCache(e->window);
 
     if (pc->propertyEvent(e) && pc->isMapped()) {
         changed_properties = true; // property change can affect stacking order
         if (pc->isDecorator())
             // in case decorator's transiency changes, make us update the value
             pc->transientFor();
-        dirtyStacking(false, e->time);
+        // fullscreen changes decide about unredirection and decorator,
+        // so don't let a frame be painted before they are handled;
+        // everything else is handled once the event queue is drained
         MCompositeWindow *cw = COMPOSITE_WINDOW(e->window);
-        if (cw && !cw->isNewlyMapped()) {
-            checkStacking(false, e->time);
-            // window on top could have changed
-            if (!possiblyUnredirectTopmostWindow())
-                enableCompositing(false);
-        }
+        if (cw && !cw->isNewlyMapped() && e->atom == ATOM(_NET_WM_STATE))
+            dirtyStacking(false, e->time, SYNC_STACKING);
+        else
+            dirtyStacking(false, e->time);
     }
 
     // global alpha events here. TODO: property cache class could handle this
@@ -964,7 +1033,7 @@ Window MCompositeManagerPrivate::getLastVisibleParent(MWindowPropertyCache *pc)
     Window last = 0, parent;
     MWindowPropertyCache *orig_pc = pc;
     while (pc && (parent = pc->transientFor())) {
-       pc = prop_caches.value(parent, 0);
+       pc = registry.propertyCache(parent);
        if (pc == orig_pc) {
            qWarning("%s(): window 0x%lx belongs to a transiency loop!",
                     __func__, orig_pc->winId());
@@ -1066,7 +1135,7 @@ bool MCompositeManagerPrivate::haveMappedWindow() const
 {
     for (int i = stacking_list.size() - 1; i >= 0; --i) {
         Window w = stacking_list.at(i);
-        MWindowPropertyCache *pc = prop_caches.value(w, 0);
+        MWindowPropertyCache *pc = registry.propertyCache(w);
         if (pc && pc->is_valid && pc->isMapped())
             return true;
     }
@@ -1098,11 +1167,14 @@ bool MCompositeManagerPrivate::possiblyUnredirectTopmostWindow()
         if (cw->isClosing())
             // this window is unmapped and has unmap animation going on
             return false;
+        // the screen in the window's coordinates, for shapeCovers()
+        QRect screen = fs_r.boundingRect().translated(
+                            -cw->propertyCache()->realGeometry().topLeft());
         if (cw->isMapped() && (cw->propertyCache()->hasAlpha()
                                || cw->needDecoration()
                                || cw->propertyCache()->isDecorator()
             // FIXME: implement direct rendering for shaped windows
-            || !fs_r.subtracted(cw->propertyCache()->shapeRegion()).isEmpty()))
+            || !cw->propertyCache()->shapeCovers(screen)))
             // this window prevents direct rendering
             return false;
         // it is a fullscreen, non-transparent window of any type
@@ -1118,7 +1190,7 @@ bool MCompositeManagerPrivate::possiblyUnredirectTopmostWindow()
     for (int i = stacking_list.size() - 1; i >= 0; --i) {
         Window w = stacking_list.at(i);
         if (w == stack[DESKTOP_LAYER]) break;
-        MWindowPropertyCache *pc = prop_caches.value(w, 0);
+        MWindowPropertyCache *pc = registry.propertyCache(w);
         if (pc && pc->is_valid && pc->beingMapped())
             return false;
     }
@@ -1168,15 +1240,16 @@ void MCompositeManagerPrivate::unmapEvent(XUnmapEvent *e)
     if (e->send_event == True || e->event != QX11Info::appRootWindow())
         // handle root's SubstructureNotifys (top-levels) only
         return;
-    configure_reqs.remove(e->window);
-    MWindowPropertyCache *wpc = 0;
-    if (prop_caches.contains(e->window)) {
-        wpc = prop_caches.value(e->window);
+    registry.takeConfigureRequests(e->window);
+    MWindowPropertyCache *wpc = registry.propertyCache(e->window);
+    if (wpc) {
         wpc->setBeingMapped(false);
         wpc->setIsMapped(false);
         if (!wpc->isInputOnly()
             && wpc->parentWindow() != QX11Info::appRootWindow())
             XRemoveFromSaveSet(QX11Info::display(), e->window);
+        // the stacking pass needn't wait for its properties anymore
+        releaseStackingHold();
     }
 
     // do not keep unmapped windows in windows_as_mapped list
@@ -1220,7 +1293,7 @@ void MCompositeManagerPrivate::unmapEvent(XUnmapEvent *e)
         }
     } else {
         // We got an unmap event from a framed window
-        FrameData fd = framed_windows.value(e->window);
+        FrameData fd = registry.frameData(e->window);
         if (!fd.frame)
             return;
         // make sure we reparent first before deleting the window
@@ -1228,7 +1301,7 @@ void MCompositeManagerPrivate::unmapEvent(XUnmapEvent *e)
         XReparentWindow(QX11Info::display(), e->window,
                         RootWindow(QX11Info::display(), 0), 0, 0);
         setWindowState(e->window, IconicState);
-        framed_windows.remove(e->window);
+        registry.removeFrameData(e->window);
         XUngrabServer(QX11Info::display());
         delete fd.frame;
     }
@@ -1258,7 +1331,10 @@ void MCompositeManagerPrivate::configureEvent(XConfigureEvent *e)
         }
         if (item->propertyCache()->windowState() != IconicState) {
             item->setPos(e->x, e->y);
-            item->resize(e->width, e->height);
+            // don't name the pixmap before the client has drawn it,
+            // syncReceived() resizes the item then
+            if (!item->waitingForSync())
+                item->resize(e->width, e->height);
         }
         if (e->override_redirect == True) {
             if (check_visibility)
@@ -1303,8 +1379,7 @@ void MCompositeManagerPrivate::configureEvent(XConfigureEvent *e)
         }
         if (check_visibility)
             dirtyStacking(true);
-    } else if (prop_caches.contains(e->window)) {
-        MWindowPropertyCache *pc = prop_caches.value(e->window);
+    } else if (MWindowPropertyCache *pc = registry.propertyCache(e->window)) {
         QRect r(e->x, e->y, e->width, e->height);
         pc->setRealGeometry(r);
     }
@@ -1392,6 +1467,12 @@ void MCompositeManagerPrivate::configureWindow(MCompositeWindow *cw,
      * were done above. */
     unsigned int value_mask = e->value_mask & ~(CWSibling | CWStackMode);
     if (value_mask) {
+        const QRect &g = cw->propertyCache()->realGeometry();
+        if (((value_mask & CWWidth) && e->width != g.width())
+            || ((value_mask & CWHeight) && e->height != g.height()))
+            // let the client tell when it has drawn the new size
+            cw->requestSync();
+
         XWindowChanges wc;
         wc.border_width = e->border_width;
         wc.x = e->x;
@@ -1410,9 +1491,7 @@ void MCompositeManagerPrivate::configureRequestEvent(XConfigureRequestEvent *e)
     if (e->parent != RootWindow(QX11Info::display(), 0))
         return;
 
-    MWindowPropertyCache *pc = 0;
-    if (prop_caches.contains(e->window))
-        pc = prop_caches.value(e->window);
+    MWindowPropertyCache *pc = registry.propertyCache(e->window);
 
     // sandbox these windows. we own them
     if ((pc && pc->isDecorator()) || (!pc && atom->isDecorator(e->window)))
@@ -1441,7 +1520,7 @@ void MCompositeManagerPrivate::configureRequestEvent(XConfigureRequestEvent *e)
             RECONFIG(e->window, value_mask, e->x, e->y, e->width, e->height);
         }
         // store configure request for handling it at window mapping time
-        configure_reqs[e->window].append(*e);
+        registry.addConfigureRequest(*e);
         return;
     }
 
@@ -1467,22 +1546,20 @@ void MCompositeManagerPrivate::mapRequestEvent(XMapRequestEvent *e)
     Display *dpy = QX11Info::display();
     Damage damage_obj = 0;
     // create the damage object before mapping to get 'em all
-    if (!device_state->displayOff() && !prop_caches.contains(e->window))
+    if (!device_state->displayOff() && !registry.propertyCache(e->window))
         damage_obj = XDamageCreate(dpy, e->window, XDamageReportNonEmpty);
     // map early to give the app a chance to start drawing
     XMapWindow(dpy, e->window);
     XFlush(dpy);
 
-    MWindowPropertyCache *pc;
-    if (prop_caches.contains(e->window))
-        pc = prop_caches.value(e->window);
-    else {
+    MWindowPropertyCache *pc = registry.propertyCache(e->window);
+    if (!pc) {
         pc = new MWindowPropertyCache(e->window, 0, 0, damage_obj);
         if (!pc->is_valid) {
             delete pc;
             return;
         }
-        prop_caches[e->window] = pc;
+        registry.setPropertyCache(e->window, pc);
         // we know the parent due to SubstructureRedirectMask on root window
         pc->setParentWindow(RootWindow(dpy, 0));
     }
@@ -1551,7 +1628,7 @@ void MCompositeManagerPrivate::mapRequestEvent(XMapRequestEvent *e)
                          StructureNotifyMask | ColormapChangeMask |
                          PropertyChangeMask);
             MSimpleWindowFrame *frame = 0;
-            FrameData f = framed_windows.value(e->window);
+            FrameData f = registry.frameData(e->window);
             frame = f.frame;
             if (!frame) {
                 frame = new MSimpleWindowFrame(e->window);
@@ -1574,10 +1651,10 @@ void MCompositeManagerPrivate::mapRequestEvent(XMapRequestEvent *e)
                 fd.frame = frame;
                 fd.mapped = true;
                 fd.parentWindow = frame->winId();
-                framed_windows[e->window] = fd;
+                registry.setFrameData(e->window, fd);
 
                 if (trans) {
-                    FrameData f = framed_windows.value(trans);
+                    FrameData f = registry.frameData(trans);
                     if (f.frame) {
                         XSetTransientForHint(QX11Info::display(), frame->winId(),
                                              f.frame->winId());
@@ -1590,6 +1667,7 @@ void MCompositeManagerPrivate::mapRequestEvent(XMapRequestEvent *e)
             MapRequesterPrivate::instance()->requestMap(pc);
             frame->show();
 
+            SYNC_ROUND_TRIP();
             XSync(QX11Info::display(), False);
 #else
             qWarning("%s: mdecorator hasn't started yet", __func__);
@@ -1598,109 +1676,35 @@ void MCompositeManagerPrivate::mapRequestEvent(XMapRequestEvent *e)
     }
 }
 
+// The transiency trees for MStackingPlacement.
+class MCompositePlacementModel
+{
+public:
+    MCompositePlacementModel(const MWindowRegistry &r) : registry(r) {}
+
+    const QList<Window> *transientWindows(Window w) const
+    {
+        MWindowPropertyCache *pc = registry.propertyCache(w);
+        return pc ? &pc->transientWindows() : 0;
+    }
+
+private:
+    const MWindowRegistry &registry;
+};
+
 // Raise @pc's window together with its transiency tree to the top of
 // @stacking list.  @parent_idx is expected to be the index in the list
 // of the window of @pc.
 bool MCompositeManagerPrivate::raiseWithTransients(MWindowPropertyCache *pc,
-                                    int parent_idx, QList<int> *anewpos)
+                                                   int parent_idx)
 {
-    int nprev;
-    QList<int> *newpos;
-
     if (!pc)
         return true;
-
-    // @newpos is a list of @stacking_list indices which should be topped.
-    // If it contains [ @i1, @i2, ..., @in ] then [ @stacking_list[@i1],
-    // @stacking_list[@i2], ..., @stacking_list[@in] ] will be the tail
-    // of the list when we have finished.
-    //
-    // @nprev is the number of elements already in @newpos.  It is used
-    // for error recovery, when we encounter a transiency cycle.
-    if (!anewpos) {
-        // Non-recursive call.
-        newpos = new QList<int>;
-        nprev = 0;
-    } else {
-        // Recursive call.
-        newpos = anewpos;
-        nprev = newpos->size();
-    }
-
-    // @stcking_list[@parent_idx] -> top of the stack
-    Q_ASSERT(parent_idx == stacking_list.indexOf(pc->winId()));
-    newpos->push_front(parent_idx);
-
-    // @isok denotes whether the caller should stop iterating, because
-    // the callee found a better root of window hierarchy.  This can
-    // only happen if we were asked to raise a transiency cycle, but
-    // checkStacking() didn't gave us the lowest-stacked element of
-    // the cycle, for example if [@w1, @w2] is the stack and we had
-    // been asked to raise @w2.  Then we would restack needlessly,
-    // which we seek to avoid.
-    bool isok = true;
-    for (QList<Window>::const_iterator it = pc->transientWindows().begin();
-         it != pc->transientWindows().end(); ++it) {
-        int idx = stacking_list.indexOf(*it);
-        if (idx < 0)
-            continue;
-        if (newpos->contains(idx)) {
-            // Transiency loop.  Having seen @idx means we are transient for it,
-            // but if we are stacked lower we make for a better root of the
-            // hierarchy.
-            if (parent_idx < idx) {
-                // Undo all positionings not done by us.
-                isok = false;
-                for (; nprev > 0; nprev--)
-                    newpos->pop_back();
-            } else
-                // We already have a new position for @idx.
-                continue;
-        }
-
-        if (!raiseWithTransients(prop_caches.value(*it), idx, newpos)) {
-            // Callee found a new root, stop what we're doing.
-            isok = false;
-            break;
-        }
-    }
-
-    // If it was a recursive call we're finished.
-    if (anewpos)
-        return isok;
-
-    // Change @stacking_list according to @newpos.  The new position
-    // of @stacking_list[@newpos[0]] is length(@stacking_list)-1,
-    // @stacking_list[@newpos[1]] goes to length(@stacking_list)-2,
-    // and so on.
-    Q_ASSERT(newpos->size() > 0);
-    QList<int>::iterator it = newpos->begin();
-    for (int new_idx = stacking_list.size() - 1; ; new_idx--) {
-        bool moved = false;
-        int old_idx = *it;
-        if (old_idx != new_idx) {
-            Q_ASSERT(new_idx >= 0);
-            STACKING_MOVE(old_idx, new_idx);
-            stacking_list.move(old_idx, new_idx);
-            moved = true;
-        }
-
-        if (++it == newpos->end())
-            break;
-        if (!moved)
-            // No need to update @newpos indices.
-            continue;
-
-        // Since we have moved @stacking_list[@old_idx] all windows above
-        // drop down by one index.  Update @newpos according to this.
-        for (QList<int>::iterator ot = it; ot != newpos->end(); ++ot)
-            if (*ot > old_idx)
-                (*ot)--;
-    }
-
-    // The new @stacking_list is ready.
-    delete newpos;
-    return true;
+    STACKING("raising 0x%lx at %d with its transients", pc->winId(),
+             parent_idx);
+    MCompositePlacementModel model(registry);
+    return MStackingPlacement<MCompositePlacementModel>(model, stacking_list)
+                .raiseWithTransients(pc->winId(), parent_idx);
 }
 
 static Bool timestamp_predicate(Display *display, XEvent *xevent, XPointer arg)
@@ -1731,10 +1735,13 @@ void MCompositeManagerPrivate::checkInputFocus(Time timestamp)
 {
     Window w = None;
 
+    // covers the check the current event batch may have asked for
+    batch_focus_check = false;
+
     /* find topmost window wanting the input focus */
     for (int i = stacking_list.size() - 1; i >= 0; --i) {
         Window iw = stacking_list.at(i);
-        MWindowPropertyCache *pc = prop_caches.value(iw, 0);
+        MWindowPropertyCache *pc = registry.propertyCache(iw);
         if (!pc || !pc->isMapped() || !pc->wantsFocus() || pc->isDecorator()
             || pc->windowTypeAtom() == ATOM(_NET_WM_WINDOW_TYPE_DOCK))
             continue;
@@ -1760,7 +1767,7 @@ void MCompositeManagerPrivate::checkInputFocus(Time timestamp)
     if (timestamp == CurrentTime)
         timestamp = get_server_time();
 #if 0 // disabled due to bugs in applications (e.g. widgetsgallery)
-    MCompositeWindow *cw = windows.value(w);
+    MCompositeWindow *cw = registry.compositeWindow(w);
     if (cw && cw->supportedProtocols().indexOf(ATOM(WM_TAKE_FOCUS)) != -1) {
         /* CurrentTime for WM_TAKE_FOCUS brings trouble
          * (a lesson learned from Fremantle) */
@@ -1786,15 +1793,86 @@ void MCompositeManagerPrivate::checkInputFocus(Time timestamp)
                     XA_WINDOW, 32, PropModeReplace, (unsigned char *)&w, 1);
 }
 
+// All stacking triggers end up here.  By default the pass is run at the
+// end of the current batch of X events, or by the zero-timeout
+// stacking_timer outside of one, so a burst of property changes costs a
+// single pass.
 void MCompositeManagerPrivate::dirtyStacking(bool force_visibility_check,
-                                             Time timestamp)
+                                             Time timestamp,
+                                             StackingPolicy policy)
 {
     if (timestamp != CurrentTime)
         stacking_timeout_timestamp = timestamp;
     if (force_visibility_check)
         stacking_timeout_check_visibility = true;
-    if (!stacking_timer.isActive())
-        stacking_timer.start();
+    if (policy == SYNC_STACKING) {
+        // also takes care of whatever was pending
+        stacking_timer.stop();
+        stackingTimeout(false);
+    } else {
+        if (in_event_batch)
+            // run by endEventBatch() if the batch was a burst
+            batch_stacking = true;
+        if (!stacking_timer.isActive())
+            stacking_timer.start(0);
+    }
+}
+
+// Runs the work the handlers of a batch of @events X events have
+// deferred: the stacking pass (with the compositing mode decision at its
+// end) and the focus check, once for the whole batch.  A lone event
+// leaves the stacking pass to the zero-timeout stacking_timer, which
+// coalesces it with the rest of the dispatcher's round.  The pass may
+// still be held for property replies as usual.  Repaints need nothing
+// here, the update() requests of the batch are coalesced by Qt into one
+// frame.
+void MCompositeManagerPrivate::endEventBatch(int events)
+{
+    if (!pending_prop_caches.isEmpty())
+        collectPropertyReplies();
+    if (batch_stacking) {
+        batch_stacking = false;
+        if (events > 1 && stacking_timer.isActive() && !stacking_held)
+            stackingTimeout();
+    }
+    if (batch_focus_check)
+        checkInputFocus(CurrentTime);
+}
+
+// Picks up the property replies that have arrived.  Called at the end of
+// each batch of events and before a stacking pass, so the replies are
+// usually there by the time the pass needs them.
+void MCompositeManagerPrivate::collectPropertyReplies()
+{
+    QSet<MWindowPropertyCache*>::iterator it = pending_prop_caches.begin();
+    while (it != pending_prop_caches.end()) {
+        if ((*it)->collectReplies())
+            ++it;
+        else
+            it = pending_prop_caches.erase(it);
+    }
+    releaseStackingHold();
+}
+
+// Lets a held stacking pass run as soon as nothing it waits for is
+// pending anymore: the replies have arrived or the windows are gone.
+void MCompositeManagerPrivate::releaseStackingHold()
+{
+    if (stacking_held && !stackingRepliesPending()) {
+        stacking_held = false;
+        stacking_timer.start(0);
+    }
+}
+
+// Returns whether the stacking order of a mapped window depends on
+// properties that have not arrived yet.
+bool MCompositeManagerPrivate::stackingRepliesPending() const
+{
+    foreach (MWindowPropertyCache *pc, pending_prop_caches)
+        if ((pc->isMapped() || pc->beingMapped())
+            && !pc->stackingAttributesReady())
+            return true;
+    return false;
 }
 
 void MCompositeManagerPrivate::pingTopmost()
@@ -1948,6 +2026,9 @@ static int xrestackwindows_error_handler(Display *dpy, XErrorEvent *err)
 void MCompositeManagerPrivate::checkStacking(bool force_visibility_check,
                                              Time timestamp)
 {
+    MLatencyTimer timer(handler_stats[STATS_STACKING]);
+    MTrace::add(__PRETTY_FUNCTION__, force_visibility_check
+                                     ? "visibility check" : "start");
     if (stacking_timer.isActive()) {
         if (stacking_timeout_check_visibility) {
             force_visibility_check = true;
@@ -2068,13 +2149,11 @@ void MCompositeManagerPrivate::checkStacking(bool force_visibility_check,
         Window deco_w = deco->decoratorItem()->window();
         int deco_i = stacking_list.indexOf(deco_w);
         if (deco_i >= 0) {
-            if (deco_i < top_decorated_i) {
-                STACKING_MOVE(deco_i, top_decorated_i);
-                safe_move(stacking_list, deco_i, top_decorated_i);
-            } else {
-                STACKING_MOVE(deco_i, top_decorated_i + 1);
-                safe_move(stacking_list, deco_i, top_decorated_i + 1);
-            }
+            MCompositePlacementModel model(registry);
+            STACKING("placing the decorator at %d above %d", deco_i,
+                     top_decorated_i);
+            MStackingPlacement<MCompositePlacementModel>(model, stacking_list)
+                .placeDecorator(deco_i, top_decorated_i);
             if (!compositing)
                 // decor requires compositing
                 enableCompositing(true);
@@ -2086,8 +2165,10 @@ void MCompositeManagerPrivate::checkStacking(bool force_visibility_check,
         Window deco_w = deco->decoratorItem()->window();
         int deco_i = stacking_list.indexOf(deco_w);
         if (deco_i > 0) {
+            MCompositePlacementModel model(registry);
             STACKING_MOVE(deco_i, 0);
-            stacking_list.move(deco_i, 0);
+            MStackingPlacement<MCompositePlacementModel>(model, stacking_list)
+                .lowerDecorator(deco_i);
             MDecoratorFrame::instance()->setManagedWindow(0);
         }
     }
@@ -2096,14 +2177,23 @@ void MCompositeManagerPrivate::checkStacking(bool force_visibility_check,
     // order of mapped windows or mappedness FIXME: would make sense to
     // stack unmapped windows to the bottom of the stack to avoid them
     // "flashing" before we had the chance to stack them
-    QList<Window> only_mapped;
+    // the buffers are static so that their storage is reused
+    static QVector<Window> only_mapped, prev_only_mapped, no_decors;
+    only_mapped.reserve(stacking_list.size());
+    only_mapped.resize(0);
+    // decorator and OR windows are not included to the property
+    no_decors.reserve(stacking_list.size());
+    no_decors.resize(0);
     for (int i = 0; i <= last_i; ++i) {
          MCompositeWindow *witem = COMPOSITE_WINDOW(stacking_list.at(i));
          if (witem && witem->isMapped() &&
-             !witem->isNewlyMapped() && !witem->isClosing())
+             !witem->isNewlyMapped() && !witem->isClosing()) {
              only_mapped.append(stacking_list.at(i));
+             if (!witem->propertyCache()->isOverrideRedirect()
+                 && !witem->propertyCache()->isDecorator())
+                 no_decors.append(stacking_list.at(i));
+         }
     }
-    static QList<Window> prev_only_mapped;
 
     // fix Z-values always to make sure we do it after an animation
     for (int i = 0; i <= last_i; ++i) {
@@ -2116,21 +2206,25 @@ void MCompositeManagerPrivate::checkStacking(bool force_visibility_check,
     }
     bool order_changed = prev_only_mapped != only_mapped;
     if (xrestackwindows_error || order_changed) {
-        QList<Window> reverse;
+        static QVector<Window> reverse;
+        reverse.reserve(last_i + 1);
+        reverse.resize(0);
         for (int i = last_i; i >= 0; --i)
             reverse.append(stacking_list.at(i));
 
         // Log the actual arguments of XRestackWindows().
         STACKING("XRestackWindows([%s])",
-                 dumpWindows(reverse).toLatin1().constData());
+                 dumpWindows(reverse.toList()).toLatin1().constData());
 
         // Watch out for errors, there may be BadWin:s in @reverse.
+        SYNC_ROUND_TRIP();
         XSync(QX11Info::display(), False);
         int (*xerr)(Display *dpy, XErrorEvent *);
         xrestackwindows_error = false;
         xerr = XSetErrorHandler(xrestackwindows_error_handler);
-        XRestackWindows(QX11Info::display(), reverse.toVector().data(),
+        XRestackWindows(QX11Info::display(), reverse.data(),
                         reverse.size());
+        SYNC_ROUND_TRIP();
         XSync(QX11Info::display(), False);
         XSetErrorHandler(xerr);
         if (xrestackwindows_error) {
@@ -2138,22 +2232,11 @@ void MCompositeManagerPrivate::checkStacking(bool force_visibility_check,
             dirtyStacking(false);
         }
 
-        // decorator and OR windows are not included to the property
-        QList<Window> no_decors = only_mapped;
-        for (int i = 0; i <= last_i; ++i) {
-             MCompositeWindow *witem = COMPOSITE_WINDOW(stacking_list.at(i));
-             if (witem && witem->isMapped() &&
-                 (witem->propertyCache()->isOverrideRedirect()
-                  || witem->propertyCache()->isDecorator()))
-                 no_decors.removeOne(stacking_list.at(i));
-        }
-        XChangeProperty(QX11Info::display(),
-                        RootWindow(QX11Info::display(), 0),
-                        ATOM(_NET_CLIENT_LIST_STACKING),
-                        XA_WINDOW, 32, PropModeReplace,
-                        (unsigned char *)no_decors.toVector().data(),
-                        no_decors.size());
-        prev_only_mapped = only_mapped;
+        static QVector<Window> prev_no_decors;
+        update_root_window_list(ATOM(_NET_CLIENT_LIST_STACKING), no_decors,
+                                prev_no_decors);
+        qSwap(prev_only_mapped, only_mapped);
+        registry.restack(stacking_list);
     }
     if (order_changed || changed_properties) {
         if (!device_state->displayOff())
@@ -2161,31 +2244,38 @@ void MCompositeManagerPrivate::checkStacking(bool force_visibility_check,
         checkInputFocus(timestamp);
     }
     if (order_changed || force_visibility_check) {
-        static int xres = ScreenOfDisplay(QX11Info::display(),
-                                   DefaultScreen(QX11Info::display()))->width;
-        static int yres = ScreenOfDisplay(QX11Info::display(),
-                                   DefaultScreen(QX11Info::display()))->height;
-        int covering_i = 0;
-        static const QRegion fs_r(0, 0, xres, yres);
+        const QRegion &fs_region = occlusion.screenRegion();
+        // feed the occlusion tracker with the mapped windows, top-down
+        QVector<MOcclusionTracker::Layer> layers;
+        layers.reserve(stacking_list.size());
         for (int i = stacking_list.size() - 1; i >= 0; --i) {
              Window w = stacking_list.at(i);
-             if (w == stack[DESKTOP_LAYER]) {
-                 covering_i = i;
-                 break;
-             }
              MCompositeWindow *cw = COMPOSITE_WINDOW(w);
-             MWindowPropertyCache *pc = 0;
-             if (cw && cw->isMapped())
-                 pc = cw->propertyCache();
-             if (cw && cw->isMapped() && !pc->hasAlpha() &&
-                 !pc->isDecorator() && !cw->hasTransitioningWindow() &&
+             if (!cw || !cw->isMapped() || !cw->propertyCache())
+                 continue;
+             MWindowPropertyCache *pc = cw->propertyCache();
+             MOcclusionTracker::Layer l;
+             l.window = w;
+             if (w == stack[DESKTOP_LAYER]) {
+                 // nothing below the desktop is shown
+                 l.shape = fs_region;
+                 l.opaque = true;
+             } else if (pc->isInputOnly()) {
+                 // InputOnly window obstructs nothing
+                 l.shape = QRegion();
+                 l.opaque = false;
+             } else {
                  /* FIXME: decorated window is assumed to be fullscreen */
-                 (cw->needDecoration() ||
-                  fs_r.subtracted(pc->shapeRegion()).isEmpty())) {
-                 covering_i = i;
-                 break;
+                 l.shape = cw->needDecoration() ? fs_region
+                                                : pc->rootShapeRegion();
+                 // an animated window may not cover its shape
+                 l.opaque = !pc->hasAlpha() && !pc->isDecorator()
+                            && !cw->isWindowTransitioning();
              }
+             layers.append(l);
         }
+        occlusion.update(layers);
+
         MWindowPropertyCache *ga_pc = 0;
         /* Send synthetic visibility events for our babies */
         int home_i = stacking_list.indexOf(duihome);
@@ -2200,8 +2290,9 @@ void MCompositeManagerPrivate::checkStacking(bool force_visibility_check,
                     setWindowState(cw->window(), NormalState);
                 continue;
             }
-            if (i >= covering_i) {
-                cw->setWindowObscured(false);
+            MOcclusionTracker::State state = occlusion.state(cw->window());
+            if (state != MOcclusionTracker::FullyObscured) {
+                cw->setWindowVisibility(state);
                 cw->setVisible(true);
                 if (!ga_pc && (cw->propertyCache()->globalAlpha() < 255 ||
                     cw->propertyCache()->videoGlobalAlpha() < 255))
@@ -2249,8 +2340,25 @@ void MCompositeManagerPrivate::checkStacking(bool force_visibility_check,
     changed_properties = false;
 }
 
-void MCompositeManagerPrivate::stackingTimeout()
+// How long a stacking pass may be held back waiting for a slow client's
+// properties, after which the property cache blocks for them.
+#define STACKING_MAX_HOLD_MS  100
+#define STACKING_HOLD_POLL_MS 5
+
+void MCompositeManagerPrivate::stackingTimeout(bool hold)
 {
+    collectPropertyReplies();
+    if (hold && stackingRepliesPending()) {
+        if (!stacking_held) {
+            stacking_held = true;
+            stacking_hold_time.start();
+        }
+        if (stacking_hold_time.elapsed() < STACKING_MAX_HOLD_MS) {
+            stacking_timer.start(STACKING_HOLD_POLL_MS);
+            return;
+        }
+    }
+    stacking_held = false;
     checkStacking(stacking_timeout_check_visibility,
                   stacking_timeout_timestamp);
     stacking_timeout_check_visibility = false;
@@ -2272,7 +2380,7 @@ bool MCompositeManagerPrivate::skipStartupAnim(MWindowPropertyCache *pc)
         Window w = stacking_list.at(i);
         if (w && w == stack[DESKTOP_LAYER])
             return false;
-        if (!(tmp = prop_caches.value(w, 0)) || tmp->isInputOnly()
+        if (!(tmp = registry.propertyCache(w)) || tmp->isInputOnly()
             || tmp == pc || !tmp->isMapped() || tmp->isDecorator())
             continue;
         if (tmp->meegoStackingLayer() > pc->meegoStackingLayer())
@@ -2298,21 +2406,19 @@ void MCompositeManagerPrivate::mapEvent(XMapEvent *e)
         || win == home_button_win || e->event != QX11Info::appRootWindow())
         return;
 
-    MWindowPropertyCache *wpc;
-    if (prop_caches.contains(win))
-        wpc = prop_caches.value(win);
-    else {
+    MWindowPropertyCache *wpc = registry.propertyCache(win);
+    if (!wpc) {
         wpc = new MWindowPropertyCache(win);
         if (!wpc->is_valid) {
             delete wpc;
             return;
         }
-        prop_caches[win] = wpc;
+        registry.setPropertyCache(win, wpc);
     }
     wpc->setBeingMapped(false);
     wpc->setIsMapped(true);
 
-    FrameData fd = framed_windows.value(win);
+    FrameData fd = registry.frameData(win);
     if (fd.frame) {
         QRect a = wpc->realGeometry();
         XConfigureEvent c;
@@ -2364,10 +2470,6 @@ void MCompositeManagerPrivate::mapEvent(XMapEvent *e)
         enableCompositing(true);
 
     if (item && pc) {
-        if (wtype == MCompAtoms::NORMAL)
-            pc->setWindowTypeAtom(ATOM(_NET_WM_WINDOW_TYPE_NORMAL));
-        else
-            pc->setWindowTypeAtom(atom->getType(win));
 #ifdef WINDOW_DEBUG
         if (debug_mode)
             qDebug() << "Composition overhead (existing pixmap):"
@@ -2438,13 +2540,10 @@ stack_and_return:
         return;
 
     bool stacked = false;
-    if (configure_reqs.contains(win)) {
-        foreach (XConfigureRequestEvent crq, configure_reqs.value(win)) {
-            configureWindow(item, &crq);
-            if (crq.value_mask & CWStackMode)
-                stacked = true;
-        }
-        configure_reqs.remove(win);
+    foreach (XConfigureRequestEvent crq, registry.takeConfigureRequests(win)) {
+        configureWindow(item, &crq);
+        if (crq.value_mask & CWStackMode)
+            stacked = true;
     }
 
     /* do this after bindWindow() so that the window is in stacking_list */
@@ -2457,9 +2556,10 @@ stack_and_return:
             positionWindow(win, false);
         if (win == stack[DESKTOP_LAYER]) {
             // lower always mapped windows below the desktop
-            for (QHash<Window, MCompositeWindow *>::iterator it = windows.begin();
-                 it != windows.end(); ++it) {
-                 MCompositeWindow *i = it.value();
+            for (int j = 0; j < registry.size(); ++j) {
+                 MCompositeWindow *i = registry.at(j).cw;
+                 if (!i)
+                     continue;
                  if (i->propertyCache() && i->propertyCache()->isMapped()
                      && i->propertyCache()->alwaysMapped() > 0)
                      setWindowState(i->window(), IconicState);
@@ -2487,7 +2587,7 @@ static bool should_be_pinged(MCompositeWindow *cw)
 void MCompositeManagerPrivate::rootMessageEvent(XClientMessageEvent *event)
 {
     MCompositeWindow *i = COMPOSITE_WINDOW(event->window);
-    FrameData fd = framed_windows.value(event->window);
+    FrameData fd = registry.frameData(event->window);
 
     if (event->message_type == ATOM(_NET_ACTIVE_WINDOW)) {
         // Visibility notification to desktop window. Ensure this is sent
@@ -2495,9 +2595,9 @@ void MCompositeManagerPrivate::rootMessageEvent(XClientMessageEvent *event)
         if (event->window != stack[DESKTOP_LAYER])
             setExposeDesktop(false);
 
-        MWindowPropertyCache *pc = prop_caches.value(event->window, 0);
+        MWindowPropertyCache *pc = registry.propertyCache(event->window);
         if (pc && !skipStartupAnim(pc) &&
-            (!m_extensions.values(MapNotify).isEmpty() || !getTopmostApp())) {
+            (!extensionFilters(MapNotify).isEmpty() || !getTopmostApp())) {
             // Not necessary to animate if not in desktop view or we have a plugin.
             Window raise = event->window;
             MCompositeWindow *d_item = COMPOSITE_WINDOW(stack[DESKTOP_LAYER]);
@@ -2508,7 +2608,7 @@ void MCompositeManagerPrivate::rootMessageEvent(XClientMessageEvent *event)
                 enableCompositing(true);
             }
             if (i && i->propertyCache()->windowState() == IconicState) {
-                i->setZValue(windows.size() + 1);
+                i->setZValue(registry.size() + 1);
                 QRectF iconGeometry = i->propertyCache()->iconGeometry();
                 i->restore(iconGeometry, needComp);
             }
@@ -2555,11 +2655,6 @@ void MCompositeManagerPrivate::rootMessageEvent(XClientMessageEvent *event)
     } else if (event->message_type == ATOM(_NET_WM_STATE)) {
         if (event->data.l[1] == (long)  ATOM(_NET_WM_STATE_SKIP_TASKBAR)) {
             skiptaskbar_wm_state(event->data.l[0], event->window);
-            if (i) {
-                QVector<Atom> states = atom->getAtomArray(event->window,
-                                                          ATOM(_NET_WM_STATE));
-                i->propertyCache()->setNetWmState(states.toList());
-            }
         } else if (event->data.l[1] == (long) ATOM(_NET_WM_STATE_FULLSCREEN))
             fullscreen_wm_state(this, event->data.l[0], event->window);
     }
@@ -2684,7 +2779,7 @@ void MCompositeManagerPrivate::lowerHandler(MCompositeWindow *window)
     // TODO: (work for more)
     // Handle minimize request coming from a managed window itself,
     // if there are any
-    FrameData fd = framed_windows.value(window->window());
+    FrameData fd = registry.frameData(window->window());
     if (fd.frame) {
         setWindowState(fd.frame->managedWindow(), IconicState);
         MCompositeWindow *i = COMPOSITE_WINDOW(fd.frame->winId());
@@ -2793,39 +2888,78 @@ void MCompositeManagerPrivate::activateWindow(Window w, Time timestamp,
 
 void MCompositeManagerPrivate::displayOff(bool display_off)
 {
+    if (recorder)
+        recorder->deviceState(display_off, device_state->ongoingCall());
     if (display_off) {
         // keep compositing to have synthetic events to obscure all windows
         if (!haveMappedWindow())
             enableCompositing(true);
         scene()->views()[0]->setUpdatesEnabled(false);
-        /* stop pinging to save some battery */
-        for (QHash<Window, MCompositeWindow *>::iterator it = windows.begin();
-             it != windows.end(); ++it) {
-             MCompositeWindow *i = it.value();
-             i->stopPing();
-             // stop damage tracking while the display is off
-             if (i->propertyCache())
-                 i->propertyCache()->damageTracking(false);
-        }
+        suspendRendering();
     } else {
         if (!possiblyUnredirectTopmostWindow())
             enableCompositing(false);
-        /* start pinging again */
-        pingTopmost();
-        // restart damage tracking
-        for (QHash<Window, MCompositeWindow *>::iterator it = windows.begin();
-             it != windows.end(); ++it) {
-             MCompositeWindow *i = it.value();
-             if (i->propertyCache() && (i->propertyCache()->isMapped() ||
-                                        i->propertyCache()->beingMapped()))
-                 i->propertyCache()->damageTracking(true);
-        }
+        resumeRendering();
     }
     dirtyStacking(true);  // VisibilityNotify generation
 }
 
+// Stops everything that would only produce frames nobody sees: pings,
+// damage, animation frames and optionally the pixmaps of hidden windows.
+void MCompositeManagerPrivate::suspendRendering()
+{
+    if (render_suspended)
+        return;
+    render_suspended = true;
+    animation_driver.setSuspended(true);
+
+    Window topmost = suspend_release ? getTopmostApp() : None;
+    for (int j = 0; j < registry.size(); ++j) {
+        MCompositeWindow *i = registry.at(j).cw;
+        if (!i)
+            continue;
+        /* stop pinging to save some battery */
+        i->stopPing();
+        if (i->propertyCache())
+            i->propertyCache()->damageTracking(false);
+        // Keep the top one, it's the first thing shown when we resume.
+        // resumeRendering() only gets new pixmaps for the mapped ones.
+        if (suspend_release && i->window() != topmost
+            && i->propertyCache() && i->propertyCache()->isMapped())
+            i->releaseBackingStore();
+    }
+}
+
+// Restarts damage tracking and refreshes all the pixmaps at once, since
+// the windows may have been drawn without us knowing.
+void MCompositeManagerPrivate::resumeRendering()
+{
+    if (!render_suspended)
+        return;
+    render_suspended = false;
+    animation_driver.setSuspended(false);
+
+    /* start pinging again */
+    pingTopmost();
+    for (int j = 0; j < registry.size(); ++j) {
+        MCompositeWindow *i = registry.at(j).cw;
+        if (!i || !i->propertyCache() || (!i->propertyCache()->isMapped() &&
+                                          !i->propertyCache()->beingMapped()))
+            continue;
+        i->propertyCache()->damageTracking(true);
+        if (i->isDirectRendered() || !i->propertyCache()->isMapped())
+            continue;
+        if (suspend_release)
+            i->saveBackingStore();
+        // schedules the (single) repaint
+        i->updateWindowPixmap();
+    }
+}
+
 void MCompositeManagerPrivate::callOngoing(bool ongoing_call)
 {
+    if (recorder)
+        recorder->deviceState(device_state->displayOff(), ongoing_call);
     if (ongoing_call) {
         // if we have fullscreen app on top, set it decorated without resizing
         MCompositeWindow *cw = getHighestDecorated();
@@ -2837,9 +2971,10 @@ void MCompositeManagerPrivate::callOngoing(bool ongoing_call)
         dirtyStacking(false);
     } else {
         // remove decoration from fullscreen windows
-        for (QHash<Window, MCompositeWindow *>::iterator it = windows.begin();
-             it != windows.end(); ++it) {
-            MCompositeWindow *i = it.value();
+        for (int j = 0; j < registry.size(); ++j) {
+            MCompositeWindow *i = registry.at(j).cw;
+            if (!i)
+                continue;
             if (FULLSCREEN_WINDOW(i) && i->needDecoration())
                 i->setDecorated(false);
         }
@@ -2850,7 +2985,7 @@ void MCompositeManagerPrivate::callOngoing(bool ongoing_call)
 
 void MCompositeManagerPrivate::setWindowState(Window w, int state)
 {
-    MWindowPropertyCache *pc = prop_caches.value(w, 0);
+    MWindowPropertyCache *pc = registry.propertyCache(w);
     if (pc && pc->windowState() == state)
         return;
     else if (pc && (!pc->isMapped() && !pc->beingMapped())
@@ -2924,11 +3059,12 @@ bool MCompositeManagerPrivate::x11EventFilter(XEvent *event)
 
     if (event->type == shape_event_base + ShapeNotify) {
         XShapeEvent *ev = (XShapeEvent*)event;
-        if (ev->kind == ShapeBounding && prop_caches.contains(ev->window)) {
-            MWindowPropertyCache *pc = prop_caches.value(ev->window);
-            pc->shapeRefresh();
+        MWindowPropertyCache *pc;
+        if (ev->kind == ShapeBounding
+            && (pc = registry.propertyCache(ev->window))) {
+            pc->shapeRefresh(ev->shaped);
             glwidget->update();
-            checkStacking(true); // re-check visibility
+            dirtyStacking(true); // re-check visibility
         }
         return true;
     }
@@ -2942,6 +3078,10 @@ bool MCompositeManagerPrivate::x11EventFilter(XEvent *event)
         damageEvent(e);
         return true;
     }
+    if (sync_event >= 0 && event->type == sync_event + XSyncAlarmNotify) {
+        syncAlarmEvent((XSyncAlarmNotifyEvent *)event);
+        return true;
+    }
 
     bool ret = true;
     switch (event->type) {
@@ -2951,7 +3091,10 @@ bool MCompositeManagerPrivate::x11EventFilter(XEvent *event)
         if (e->window == RootWindow(QX11Info::display(), 0)
             && e->mode == NotifyNormal) {
             prev_focus = e->window;
-            checkInputFocus(CurrentTime);
+            if (in_event_batch)
+                batch_focus_check = true;
+            else
+                checkInputFocus(CurrentTime);
         }
         break;
     }
@@ -2984,13 +3127,13 @@ bool MCompositeManagerPrivate::x11EventFilter(XEvent *event)
         XAllowEvents(QX11Info::display(), ReplayKeyboard, event->xkey.time);
         keyEvent(&event->xkey); break;
     case ReparentNotify:
-        if (prop_caches.contains(((XReparentEvent*)event)->window)) {
+        if (MWindowPropertyCache *pc = registry.propertyCache(
+                                        ((XReparentEvent*)event)->window)) {
             Window window = ((XReparentEvent*)event)->window;
             Window new_parent = ((XReparentEvent*)event)->parent;
-            MWindowPropertyCache *pc = prop_caches.value(window);
             if (new_parent != pc->parentWindow()) {
                 if (new_parent != QX11Info::appRootWindow() &&
-                    !framed_windows.contains(window)) {
+                    !registry.frameData(window).frame) {
                     // if new parent is not root/frame, forget about the window
                     if (!pc->isInputOnly()
                         && pc->parentWindow() != QX11Info::appRootWindow())
@@ -2998,7 +3141,7 @@ bool MCompositeManagerPrivate::x11EventFilter(XEvent *event)
                     MCompositeWindow *i = COMPOSITE_WINDOW(window);
                     if (i) i->deleteLater();
                     removeWindow(window);
-                    prop_caches.remove(window);
+                    registry.setPropertyCache(window, 0);
                 }
                 pc->setParentWindow(new_parent);
             }
@@ -3013,21 +3156,39 @@ bool MCompositeManagerPrivate::x11EventFilter(XEvent *event)
     return ret;
 }
 
+static void account_filter(MCompositeManagerPrivate::ExtensionFilter &f,
+                           unsigned long long t0)
+{
+    unsigned long long t = MLatencyHistogram::now() - t0;
+    f.calls++;
+    f.usecs += t;
+    if (t > f.max_usecs)
+        f.max_usecs = t;
+}
+
+// Offers @event to the extensions listening to it in installation order.
+// The first one whose x11Event() returns true consumes the event: the rest
+// of the extensions and the composite manager won't see it.
 bool MCompositeManagerPrivate::processX11EventFilters(XEvent *event, bool after)
 {
-    if (!m_extensions.contains(event->type))
+    if ((unsigned)event->type >= EXTENSION_EVENT_TYPES)
+        return false;
+    QVector<ExtensionFilter> &filters = ext_filters[event->type];
+    if (filters.isEmpty())
         return false;
 
-    QList<MCompositeManagerExtension*> evlist = m_extensions.values(event->type);
-    bool processed = false;
-    if (after)
-        for (int i = 0; i < evlist.size(); ++i)
-            evlist[i]->afterX11Event(event);
-    else
-        for (int i = 0; i < evlist.size(); ++i)
-            processed = evlist[i]->x11Event(event);
-
-    return processed;
+    // the handlers may install new filters, so don't keep references
+    for (int i = 0; i < filters.size(); ++i) {
+        unsigned long long t0 = MLatencyHistogram::now();
+        if (after)
+            filters.at(i).extension->afterX11Event(event);
+        else if (filters.at(i).extension->x11Event(event)) {
+            account_filter(filters[i], t0);
+            return true;
+        }
+        account_filter(filters[i], t0);
+    }
+    return false;
 }
 
 void MCompositeManagerPrivate::keyEvent(XKeyEvent* e)
@@ -3108,7 +3269,7 @@ void MCompositeManagerPrivate::redirectWindows()
         // Pre-create MWindowPropertyCache for likely application windows
         if (localwin != kids[i] && (attr->map_state == XCB_MAP_STATE_VIEWABLE
             || (geom->width == xres && geom->height == yres))
-            && !prop_caches.contains(kids[i])) {
+            && !registry.propertyCache(kids[i])) {
             // attr and geom are freed later
             MWindowPropertyCache *p = new MWindowPropertyCache(kids[i],
                                                                attr, geom);
@@ -3118,7 +3279,7 @@ void MCompositeManagerPrivate::redirectWindows()
                 free(geom);
                 continue;
             }
-            prop_caches[kids[i]] = p;
+            registry.setPropertyCache(kids[i], p);
             p->setParentWindow(RootWindow(QX11Info::display(), 0));
         } else {
             free(attr); attr = 0;
@@ -3170,7 +3331,10 @@ void MCompositeManagerPrivate::removeWindow(Window w)
 
     STACKING("remove 0x%lx from stack", w);
     removed += windows_as_mapped.removeAll(w);
-    removed += windows.remove(w);
+    if (registry.compositeWindow(w)) {
+        registry.setCompositeWindow(w, 0);
+        ++removed;
+    }
     removed += stacking_list.removeAll(w);
 
     for (int i = 0; i < TOTAL_LAYERS; ++i)
@@ -3179,200 +3343,58 @@ void MCompositeManagerPrivate::removeWindow(Window w)
     if (removed > 0) updateWinList();
 }
 
-// Determine whether a decorator should be ordered above or below @win.
-// If the answer is definite it is stored in *@cmpp and NULL is returned.
-// Otherwise the decorator should be ordered exatly like the returned window,
-// the decorator's managed window.
-//
-// Unused decorators should be below anything else.
-// The decorated window should be below the decorator.
-// Otherwise we don't know.
-static MCompositeWindow *compareDecorator(bool *cmpp, MCompositeWindow *win)
+// The live window model for MStackingRules.
+class MCompositeStackingModel
 {
-    MDecoratorFrame *deco = MDecoratorFrame::instance();
-    if (deco) {
-        MCompositeWindow *man = deco->managedClient();
-        if (!man)
-            // the decorator is unused
-            *cmpp = true;
-        else if (man == win)
-            // @win is the decorator's managed window, keep them together
-            *cmpp = false;
-        else
-            // Order the decorator like its managed window.
-            return man;
-    } else
-        // the decorator is so unused that we don't even know about it
-        *cmpp = true;
+public:
+    typedef MCompositeWindow *Item;
 
-    return NULL;
-}
-
-// Returns whether @cw in @layer of @type is special with regards to stacking.
-// Returns None for non-special cases, or NOTIFICATION, INPUT or DIALOG.
-// The returned Atom doesn't mean that @cw has that window type; it merely
-// indicates that it should be stacked like that.
-static Atom isSpecial(MCompositeWindow *cw, int layer, Atom type)
-{
-    if (layer < 6 && type == ATOM(_NET_WM_WINDOW_TYPE_NOTIFICATION))
-        /* @cw is maybe a notification */;
-    else if (layer < 5 &&
-        (type == ATOM(_NET_WM_WINDOW_TYPE_INPUT) ||
-         cw->propertyCache()->isOverrideRedirect() ||
-         cw->propertyCache()->netWmState().indexOf(ATOM(_NET_WM_STATE_ABOVE)) != -1))
-        // @cw is maybe input or keep-above window
-        type = ATOM(_NET_WM_WINDOW_TYPE_INPUT);
-    else if (layer < 4 && MODAL_WINDOW(cw) &&
-             type == ATOM(_NET_WM_WINDOW_TYPE_DIALOG))
-        /* @cw is maybe a system-modal dialog */;
-    else
-        // Nothing special.
-        return None;
-
-    // @cw deserves special handling only if it doesn't have
-    // a lastVisibleParent().
-    return cw->lastVisibleParent() ? None : type;
-}
-
-// Internal qStableSort() comparator.  The desired rough order of
-// @stacking_list roughly is:
-//
-// unused decorator (lowest), iconified/withdrawn windows possibly with
-// decorator on top, desktop, normal state windows with transients/decorator
-// on top, system-modal dialogs, input-type windows, notifications,
-// windows with stacking layers (highest).
-//
-// Returns true if @w_a should definitely be below @w_b, otherwise false.
-// This tells the sorting function that the sorting of @w_a is either
-// greater than or equal to @w_b's.  In other words, @w_a needn't be
-// below @w_a, but it could be, unless compareWindows(@w_b, @w_a) tells
-// explicitly otherwise (ie. that @w_a needs to be higher than @w_b).
-//
-// TODO: before this can replace checkStacking(), we need to handle at least
-// the decorator, possibly also window groups and dock windows.
-static bool compareWindows(Window w_a, Window w_b)
-{
-    int layer;
-    Atom type_a, type_b;
-
-    // qSort() should know better, but if it doesn't, tell it that
-    // no item is less than itself.
-    Q_ASSERT(w_a != w_b);
-    if (w_a == w_b)
-        return false;
-
-    // If we don't know about either of the windows let them in peace
-    // -- don't reason about what we don't know.
-    MCompositeWindow *cw_a = MCompositeWindow::compositeWindow(w_a);
-    MCompositeWindow *cw_b = MCompositeWindow::compositeWindow(w_b);
-    if (!cw_a || !cw_b)
-        return false;
-
-    // Valid MCompositeWindow:s must have a MWindowPropertyCache.
-    MWindowPropertyCache *pc_a = cw_a->propertyCache();
-    MWindowPropertyCache *pc_b = cw_b->propertyCache();
-    Q_ASSERT(pc_a != NULL && pc_b != NULL);
-
-    // Mind decorators.  Lone decorators should go below everything else,
-    // otherwise it's sorted above its managed window.
-    if (pc_a->isDecorator()) {
-        bool cmp;
-        if (!(cw_a = compareDecorator(&cmp, cw_b)))
-            // @cw_a is a lone decorator or @cw_b happens to be
-            // its managed window.
-            return  cmp;
-    } else if (pc_b->isDecorator()) {
-        bool cmp;
-        if (!(cw_b = compareDecorator(&cmp, cw_a)))
-            // Likewise.
-            return !cmp;
-    }
-
-    // Iconic/withdrawn/unmanaged windows...
-    if (pc_a->windowState() != NormalState) {
-        if (pc_b->windowState() == NormalState)
-            // ...go below NormalState windows ...
-            return true;
-        else
-            // ... otherwise we don't care.
-            return false;
-    } else if (pc_b->windowState() != NormalState) {
-        // @cw_a is NormalState, @cw_b is not.
-        return false;
+    Item item(Window w) const
+    {
+        MCompositeWindow *cw = MCompositeWindow::compositeWindow(w);
+        // Valid MCompositeWindow:s must have a MWindowPropertyCache.
+        Q_ASSERT(!cw || cw->propertyCache() != NULL);
+        return cw;
     }
-
-    // Both @cw_a and @cw_b are in NormalState.
-    // Sort the desktop below all NormalState:s.
-    // (Quiz: why do we check @cw_b before @cw_a?
-    //  Answer: to be consistent even if both windows are desktops.)
-    type_b = pc_b->windowTypeAtom();
-    if (type_b == ATOM(_NET_WM_WINDOW_TYPE_DESKTOP))
-        return false;
-    type_a = pc_a->windowTypeAtom();
-    if (type_a == ATOM(_NET_WM_WINDOW_TYPE_DESKTOP))
-        return true;
-
-    // Compare by stacking layers.
-    layer = pc_a->meegoStackingLayer();
-    int rel = layer - pc_b->meegoStackingLayer();
-    if (rel < 0)
-        // @cw_a has lower stacking layer
-        return true;
-    else if (rel > 0)
-        // @cw_a has greater stacking layer
-        return false;
-    // They're in the same layer.
-
-    // Order notifications, input windows and system-modal dialogs.
-    // We can skip it altogether if the windows' layer is too high,
-    // because for them isSpecial() will always be false.
-    if (layer < 6) {
-        type_a = isSpecial(cw_a, layer, type_a);
-        type_b = isSpecial(cw_b, layer, type_b);
-        // type_a, type_b == None || dialog || input || notification
-
-        // Skip to the next test if the windows are equally special
-        // or non-special.
-        if (type_a != type_b) {
-            if (type_b == ATOM(_NET_WM_WINDOW_TYPE_NOTIFICATION))
-                // type_a == None || dialog || input
-                return true;
-            if (type_a == ATOM(_NET_WM_WINDOW_TYPE_NOTIFICATION))
-                // type_b == None || dialog || input
-                return false;
-            if (type_b == ATOM(_NET_WM_WINDOW_TYPE_INPUT))
-                // type_a == None || dialog
-                return true;
-            if (type_a == ATOM(_NET_WM_WINDOW_TYPE_INPUT))
-                // type_b == None || dialog
-                return false;
-            if (type_b == ATOM(_NET_WM_WINDOW_TYPE_DIALOG))
-                // type_a == None
-                return true;
-            if (type_a == ATOM(_NET_WM_WINDOW_TYPE_DIALOG))
-                // type_b == None
-                return false;
-        }
+    bool isDecorator(Item cw) const
+        { return cw->propertyCache()->isDecorator(); }
+    Item decoratorClient() const
+    {
+        // the decorator may be so unused that we don't even know about it
+        MDecoratorFrame *deco = MDecoratorFrame::instance();
+        return deco ? deco->managedClient() : 0;
     }
-
-    // Order transient windows below what they are transient for.
-    // Since the sorting algorithm can infer that if trfor(@a) == @b
-    // and trfor(@b) == @c then @a is transient for @c it is not
-    // necessary for us to check if @cw_a is a grandparent of @cw_b
-    // or vica versa.  However, we *do* have to mind circular
-    // transiency between @cw_a and @cw_b otherwise we would
-    // return true for both compareWindows(@cw_a, @cw_b) and
-    // compareWindows(cw_b, @cw_a), which would make the sorting
-    // undeterministic.
-    if (pc_b->transientFor() == w_a && pc_a->transientFor() != w_b)
-      // @cw_b is transient for @cw_a, so it must be above it.
-      return true;
-
-    // Either @cw_a is transient for @cw_b or they are transient
-    // for each other, or they are not in direct relationship,
-    // or they are not in any relationship at all.
-    return false;
-}
+    int windowState(Item cw) const
+        { return cw->propertyCache()->windowState(); }
+    MStacking::WindowType windowType(Item cw) const
+    {
+        Atom type = cw->propertyCache()->windowTypeAtom();
+        if (type == ATOM(_NET_WM_WINDOW_TYPE_DESKTOP))
+            return MStacking::DesktopType;
+        if (type == ATOM(_NET_WM_WINDOW_TYPE_NOTIFICATION))
+            return MStacking::NotificationType;
+        if (type == ATOM(_NET_WM_WINDOW_TYPE_INPUT))
+            return MStacking::InputType;
+        if (type == ATOM(_NET_WM_WINDOW_TYPE_DIALOG))
+            return MStacking::DialogType;
+        return MStacking::OtherType;
+    }
+    int stackingLayer(Item cw) const
+        { return cw->propertyCache()->meegoStackingLayer(); }
+    bool isOverrideRedirect(Item cw) const
+        { return cw->propertyCache()->isOverrideRedirect(); }
+    bool isKeepAbove(Item cw) const
+    {
+        return cw->propertyCache()->netWmState().indexOf(
+                                            ATOM(_NET_WM_STATE_ABOVE)) != -1;
+    }
+    bool isModal(Item cw) const
+        { return MODAL_WINDOW(cw); }
+    bool hasVisibleParent(Item cw) const
+        { return cw->lastVisibleParent() != None; }
+    Window transientFor(Item cw) const
+        { return cw->propertyCache()->transientFor(); }
+};
 
 void MCompositeManagerPrivate::roughSort()
 {
@@ -3380,7 +3402,9 @@ void MCompositeManagerPrivate::roughSort()
     // ie. that it keeps the order unless it is necessary to change.
     STACKING("sorting stack [%s]",
              dumpWindows(stacking_list).toLatin1().constData());
-    qStableSort(stacking_list.begin(), stacking_list.end(), compareWindows);
+    MCompositeStackingModel model;
+    qStableSort(stacking_list.begin(), stacking_list.end(),
+                MStackingRules<MCompositeStackingModel>(model));
     STACKING("resulting in: [%s]",
              dumpWindows(stacking_list).toLatin1().constData());
 }
@@ -3393,16 +3417,14 @@ MCompositeWindow *MCompositeManagerPrivate::bindWindow(Window window)
     XSelectInput(display, window, PropertyChangeMask);
     XShapeSelectInput(display, window, ShapeNotifyMask);
 
-    MWindowPropertyCache *wpc;
-    if (prop_caches.contains(window)) {
-        wpc = prop_caches.value(window);
-    } else {
+    MWindowPropertyCache *wpc = registry.propertyCache(window);
+    if (!wpc) {
         wpc = new MWindowPropertyCache(window);
         if (!wpc->is_valid) {
             delete wpc;
             return 0;
         }
-        prop_caches[window] = wpc;
+        registry.setPropertyCache(window, wpc);
     }
     wpc->setIsMapped(true);
     MCompositeWindow *item = new MTexturePixmapItem(window, wpc);
@@ -3413,7 +3435,7 @@ MCompositeWindow *MCompositeManagerPrivate::bindWindow(Window window)
     MWindowPropertyCache *pc = item->propertyCache();
 
     item->saveState();
-    windows[window] = item;
+    registry.setCompositeWindow(window, item);
 
     const XWMHints &h = pc->getWMHints();
     if ((h.flags & StateHint) && (h.initial_state == IconicState)) {
@@ -3506,17 +3528,12 @@ void MCompositeManagerPrivate::addItem(MCompositeWindow *item)
 
 void MCompositeManagerPrivate::updateWinList()
 {
-    static QList<Window> prev_list;
-    if (windows_as_mapped != prev_list) {
-        XChangeProperty(QX11Info::display(),
-                        RootWindow(QX11Info::display(), 0),
-                        ATOM(_NET_CLIENT_LIST),
-                        XA_WINDOW, 32, PropModeReplace,
-                        (unsigned char *)windows_as_mapped.toVector().data(),
-                        windows_as_mapped.size());
-
-        prev_list = windows_as_mapped;
-    }
+    static QVector<Window> list, prev_list;
+    list.reserve(windows_as_mapped.size());
+    list.resize(0);
+    for (int i = 0; i < windows_as_mapped.size(); ++i)
+        list.append(windows_as_mapped.at(i));
+    update_root_window_list(ATOM(_NET_CLIENT_LIST), list, prev_list);
     dirtyStacking(false);
 }
 
@@ -3642,14 +3659,15 @@ void MCompositeManagerPrivate::showOverlayWindow(bool show)
 
 void MCompositeManagerPrivate::enableRedirection(bool emit_signal)
 {
-    for (QHash<Window, MCompositeWindow *>::iterator it = windows.begin();
-            it != windows.end(); ++it) {
-        MCompositeWindow *tp = it.value();
+    for (int j = 0; j < registry.size(); ++j) {
+        MCompositeWindow *tp = registry.at(j).cw;
+        if (!tp)
+            continue;
         if (tp->isValid() && tp->isDirectRendered() && tp->propertyCache()
             && (tp->propertyCache()->isMapped()
                 || tp->propertyCache()->beingMapped()))
             ((MTexturePixmapItem *)tp)->enableRedirectedRendering();
-        setWindowDebugProperties(it.key());
+        setWindowDebugProperties(registry.at(j).window);
     }
     compositing = true;
     // no delay: application does not need to redraw when maximizing it
@@ -3669,9 +3687,10 @@ void MCompositeManagerPrivate::disableCompositing(ForcingLevel forced)
 
     // we could still have existing decorator on-screen.
     // ensure we don't accidentally disturb it
-    for (QHash<Window, MCompositeWindow *>::iterator it = windows.begin();
-         it != windows.end(); ++it) {
-        MCompositeWindow *i  = it.value();
+    for (int j = 0; j < registry.size(); ++j) {
+        MCompositeWindow *i = registry.at(j).cw;
+        if (!i)
+            continue;
         if (i->propertyCache()->isDecorator())
             continue;
         if (i->windowVisible() && (i->propertyCache()->hasAlpha()
@@ -3683,14 +3702,15 @@ void MCompositeManagerPrivate::disableCompositing(ForcingLevel forced)
     showOverlayWindow(false);
 #endif
 
-    for (QHash<Window, MCompositeWindow *>::iterator it = windows.begin();
-            it != windows.end(); ++it) {
-        MCompositeWindow *tp  = it.value();
+    for (int j = 0; j < registry.size(); ++j) {
+        MCompositeWindow *tp = registry.at(j).cw;
+        if (!tp)
+            continue;
         // checks above fail. somehow decorator got in. stop it at this point
         if (!tp->propertyCache()->isDecorator() && !tp->isIconified()
             && !tp->propertyCache()->hasAlpha())
             ((MTexturePixmapItem *)tp)->enableDirectFbRendering();
-        setWindowDebugProperties(it.key());
+        setWindowDebugProperties(registry.at(j).window);
     }
 
 #ifndef GLES2_VERSION
@@ -3755,10 +3775,88 @@ void MCompositeManagerPrivate::exposeSwitcher()
     clientMessageEvent(&(e.xclient));
 }
 
+MLatencyHistogram &MCompositeManagerPrivate::handlerStats(int event_type)
+{
+    if (event_type == damage_event + XDamageNotify)
+        return handler_stats[STATS_DAMAGE];
+    if (event_type < 0 || event_type >= LASTEvent)
+        return handler_stats[STATS_OTHER_EXTENSION];
+    return handler_stats[event_type];
+}
+
+static const char *handler_name(int i)
+{
+    static char buf[16];
+
+    switch (i) {
+    case MapNotify:         return "mapEvent";
+    case MapRequest:        return "mapRequestEvent";
+    case UnmapNotify:       return "unmapEvent";
+    case ConfigureNotify:   return "configureEvent";
+    case ConfigureRequest:  return "configureRequestEvent";
+    case PropertyNotify:    return "propertyEvent";
+    case DestroyNotify:     return "destroyEvent";
+    case ClientMessage:     return "clientMessageEvent";
+    case ButtonPress:       return "buttonEvent(press)";
+    case ButtonRelease:     return "buttonEvent(release)";
+    case KeyPress:          return "keyEvent(press)";
+    case KeyRelease:        return "keyEvent(release)";
+    case FocusIn:           return "FocusIn";
+    case ReparentNotify:    return "ReparentNotify";
+    case MCompositeManagerPrivate::STATS_DAMAGE:
+        return "damageEvent";
+    case MCompositeManagerPrivate::STATS_OTHER_EXTENSION:
+        return "extensionEvent";
+    case MCompositeManagerPrivate::STATS_STACKING:
+        return "checkStacking";
+    case MCompositeManagerPrivate::STATS_DRAW:
+        return "drawItems";
+    case MCompositeManagerPrivate::STATS_SWAP:
+        return "swap";
+    default:
+        snprintf(buf, sizeof(buf), "event%d", i);
+        return buf;
+    }
+}
+
+// Prints the histograms which have samples, see MLatencyHistogram::print().
+void MCompositeManagerPrivate::printStats(FILE *out) const
+{
+    fprintf(out, "# handler samples total_us max_us, then the number of "
+                 "samples below 1, 2, 4 ... us\n");
+    for (int i = 0; i < STATS_HANDLERS; ++i)
+        if (handler_stats[i].count())
+            handler_stats[i].print(out, handler_name(i));
+    if (MXPingStats::shared())
+        MXPingStats::shared()->print(out);
+    fflush(out);
+}
+
+// Starts logging the events into @fname, or stops it if it's NULL.
+void MCompositeManagerPrivate::recordEvents(const char *fname)
+{
+    delete recorder;
+    recorder = fname ? MEventRecorder::open(fname, damage_event) : 0;
+    if (recorder) {
+        recorder->deviceState(device_state->displayOff(),
+                              device_state->ongoingCall());
+        qDebug("recording X events into %s", fname);
+    }
+}
+
 void MCompositeManagerPrivate::installX11EventFilter(long xevent,
                                                      MCompositeManagerExtension* extension)
 {
-    m_extensions.insert(xevent, extension);
+    if ((unsigned long)xevent >= EXTENSION_EVENT_TYPES) {
+        qWarning("%s: invalid event type %ld", __func__, xevent);
+        return;
+    }
+    QVector<ExtensionFilter> &filters = ext_filters[xevent];
+    for (int i = 0; i < filters.size(); ++i)
+        if (filters.at(i).extension == extension)
+            return;
+    ExtensionFilter f = { extension, 0, 0, 0 };
+    filters.append(f);
 }
 
 void MCompositeManagerPrivate::showLaunchIndicator(int timeout)
@@ -3817,6 +3915,8 @@ void MCompositeManager::dumpState(const char *heading)
 
     qDebug(    "display:          %s",
                d->device_state->displayOff() ? "off" : "on");
+    qDebug(    "rendering:        %s",
+               d->render_suspended ? "suspended" : "active");
     qDebug(    "call state:       %s",
                d->device_state->ongoingCall() ? "ongoing" : "idle");
 
@@ -3875,11 +3975,19 @@ void MCompositeManager::dumpState(const char *heading)
          winit > d->windows_as_mapped.constBegin(); )
         qDebug("  0x%lx", *--winit);
 
+    // Where do we still wait for the X server.
+    qDebug("synchronous round trips by event type:");
+    for (i = 0; i < 128; i++)
+        if (d->atom->round_trips[i])
+            qDebug("  %3d: %u", i, d->atom->round_trips[i]);
+
+    d->event_latency.dump("event latency");
+    d->reply_latency.dump(d->xreader ? "property reply latency (reader thread)"
+                                     : "property reply latency");
+
     // All MCompositeWindow:s we know about.
-    QHash<Window, MCompositeWindow *>::const_iterator cwit;
     qDebug("windows:");
-    for (cwit = d->windows.constBegin(); cwit != d->windows.constEnd();
-         ++cwit) {
+    for (i = 0; i < d->registry.size(); i++) {
         static const char *wintypes[] = {
             "INVALID", "DESKTOP", "NORMAL", "DIALOG", "NO_DECOR_DIALOG",
             "FRAMELESS", "DOCK", "INPUT", "ABOVE", "NOTIFICATION",
@@ -3896,8 +4004,9 @@ void MCompositeManager::dumpState(const char *heading)
         int winstate;
         char *name;
 
-        cw = *cwit;
-        Q_ASSERT(cwit.key() == cw->window());
+        if (!(cw = d->registry.at(i).cw))
+            continue;
+        Q_ASSERT(d->registry.at(i).window == cw->window());
 
         // Determine the window's name.
         name = NULL;
@@ -3916,7 +4025,7 @@ void MCompositeManager::dumpState(const char *heading)
         // Get the PID and the command line of the process which created
         // the window.
         QByteArray cmdline;
-        int pid = MCompAtoms::instance()->getPid(cw->window());
+        int pid = cw->propertyCache()->pid();
         if (pid) {
             QFile f(QString().sprintf("/proc/%d/cmdline", pid));
             if (f.open(QIODevice::ReadOnly))
@@ -3962,84 +4071,98 @@ void MCompositeManager::dumpState(const char *heading)
         // MWindowPropertyCache::transientFor() can change state,
         // transientWindows() doesn't.
         qDebug("    transients: %s", dumpWindows(cw->propertyCache()->transientWindows()).toLatin1().constData());
+        qDebug("    memory: %d bytes, property cache: %d bytes",
+               cw->memoryUsage(), cw->propertyCache()->memoryUsage());
 
         if (name)
             XFree(name);
     }
 
-    if (!d->framed_windows.isEmpty()) {
-        QHash<Window, MCompositeManagerPrivate::FrameData>::const_iterator fwit;
-
-        qDebug("framed_windows:");
-        for (fwit = d->framed_windows.constBegin();
-             fwit != d->framed_windows.constEnd(); ++fwit)
-            qDebug("  0x%lx: parent=0x%lx, mapped=%s", fwit.key(),
-                   fwit->parentWindow, fwit->mapped ? "yes" : "no");
-    } else
-        qDebug("framed_windows: <None>");
+    qDebug("object pools (used/allocated):");
+    qDebug("  property caches: %d/%d",
+           MObjectPool<MWindowPropertyCache>::inUse(),
+           MObjectPool<MWindowPropertyCache>::capacity());
+    qDebug("  items:           %d/%d",
+           MObjectPool<MTexturePixmapItem>::inUse(),
+           MObjectPool<MTexturePixmapItem>::capacity());
+    qDebug("  renderers:       %d/%d",
+           MObjectPool<MTexturePixmapPrivate>::inUse(),
+           MObjectPool<MTexturePixmapPrivate>::capacity());
+    qDebug("  animators:       %d/%d",
+           MObjectPool<MCompWindowAnimator>::inUse(),
+           MObjectPool<MCompWindowAnimator>::capacity());
+    qDebug("  running animations: %d", d->animation_driver.running());
+    d->startup_profile.dump();
+    if (MXPingStats::shared())
+        MXPingStats::shared()->dump();
+
+    qDebug("framed_windows:");
+    for (i = 0; i < d->registry.size(); i++) {
+        const MWindowRegistry::Record &rec = d->registry.at(i);
+        if (rec.frame.frame)
+            qDebug("  0x%lx: parent=0x%lx, mapped=%s", rec.window,
+                   rec.frame.parentWindow, rec.frame.mapped ? "yes" : "no");
+    }
 
     // Which windows are in the property cache?
     line = "with property cache:";
-    QHash<Window, MWindowPropertyCache*>::const_iterator pcit;
-    for (pcit = d->prop_caches.constBegin();
-         pcit != d->prop_caches.constEnd(); ++pcit)
-      line += QString().sprintf(" 0x%lx", pcit.key());
+    for (i = 0; i < d->registry.size(); i++)
+        if (d->registry.at(i).pc)
+            line += QString().sprintf(" 0x%lx", d->registry.at(i).window);
     qDebug() << line.toLatin1().constData();
 
     // Pending XConfigureRequestEvent:s.
-    if (!d->configure_reqs.isEmpty()) {
-        // Print each as "0x123456: 10x20+30+40 [XYWH] Above 0xABCDE"
-        QHash<Window, QList<XConfigureRequestEvent> >::const_iterator it;
+    // Print each as "0x123456: 10x20+30+40 [XYWH] Above 0xABCDE"
+    qDebug("configure_reqs:");
+    for (i = 0; i < d->registry.size(); i++) {
+        const MWindowRegistry::Record &rec = d->registry.at(i);
         QList<XConfigureRequestEvent>::const_iterator ot;
 
-        qDebug("configure_reqs:");
-        for (it = d->configure_reqs.constBegin();
-             it != d->configure_reqs.constEnd(); ++it) {
-            for (ot = it->constBegin(); ot != it->constEnd(); ++ot) {
-                const XConfigureRequestEvent *ev = &(*ot);
-
-                // The requested geometry
-                line = QString().sprintf("  0x%lx: %dx%d%+d%+d", it.key(),
-                                         ev->width, ev->height,
-                                         ev->x, ev->y);
-
-                // What is to be changed
-                if (ev->value_mask & (CWX|CWY|CWWidth|CWHeight)) {
-                    line += " [";
-                    if (ev->value_mask & CWX)
-                        line += 'X';
-                    if (ev->value_mask & CWY)
-                        line += 'Y';
-                    if (ev->value_mask & CWWidth)
-                        line += 'W';
-                    if (ev->value_mask & CWHeight)
-                        line += 'H';
-                    line += ']';
-                }
+        for (ot = rec.configure_reqs.constBegin();
+             ot != rec.configure_reqs.constEnd(); ++ot) {
+            const XConfigureRequestEvent *ev = &(*ot);
+
+            // The requested geometry
+            line = QString().sprintf("  0x%lx: %dx%d%+d%+d", rec.window,
+                                     ev->width, ev->height,
+                                     ev->x, ev->y);
+
+            // What is to be changed
+            if (ev->value_mask & (CWX|CWY|CWWidth|CWHeight)) {
+                line += " [";
+                if (ev->value_mask & CWX)
+                    line += 'X';
+                if (ev->value_mask & CWY)
+                    line += 'Y';
+                if (ev->value_mask & CWWidth)
+                    line += 'W';
+                if (ev->value_mask & CWHeight)
+                    line += 'H';
+                line += ']';
+            }
 
-                // Print the new stack mode and possibly the new sibling.
-                if (ev->value_mask & CWStackMode) {
-                    line += " stacking: ";
-                    if (ev->detail == Above)
-                      line += "above";
-                    else if (ev->detail == Below)
-                      line += "below";
-                    else if (ev->detail == TopIf)
-                      line += "topif";
-                    else if (ev->detail == BottomIf)
-                      line += "bottomif";
-                    else if (ev->detail == Opposite)
-                      line += "opposite";
-                    else
-                      line += QString().sprintf("%d", ev->detail);
-
-                    if (ev->value_mask & CWSibling)
-                      line += QString().sprintf(" 0x%lx", ev->above);
-                }
+            // Print the new stack mode and possibly the new sibling.
+            if (ev->value_mask & CWStackMode) {
+                line += " stacking: ";
+                if (ev->detail == Above)
+                  line += "above";
+                else if (ev->detail == Below)
+                  line += "below";
+                else if (ev->detail == TopIf)
+                  line += "topif";
+                else if (ev->detail == BottomIf)
+                  line += "bottomif";
+                else if (ev->detail == Opposite)
+                  line += "opposite";
+                else
+                  line += QString().sprintf("%d", ev->detail);
+
+                if (ev->value_mask & CWSibling)
+                  line += QString().sprintf(" 0x%lx", ev->above);
             }
+            qDebug() << line.toLatin1().constData();
         }
-    } else
-        qDebug("configure_reqs: <None>");
+    }
 
     // Dump the scene items from top to bottom.
     qDebug("scene:");
@@ -4057,12 +4180,13 @@ void MCompositeManager::dumpState(const char *heading)
     }
 
     // Show the current state of extensions.
-    // @m_extenions is a QMultiHash of X events an extension reacts to
-    // pointing to the object.  Invert the hash so we can iterate over
-    // each extension once.
+    // @ext_filters lists the extensions reacting to each X event.
+    // Invert it so we can iterate over each extension once.
     qDebug("plugins:");
-    for (QHash<int, MCompositeManagerExtension*>::const_iterator exit = d->m_extensions.constBegin(); exit != d->m_extensions.constEnd(); ++exit)
-        extensions[*exit].append(exit.key());
+    for (i = 0; i < MCompositeManagerPrivate::EXTENSION_EVENT_TYPES; i++)
+        foreach (const MCompositeManagerPrivate::ExtensionFilter &f,
+                 d->ext_filters[i])
+            extensions[f.extension].append(i);
     for (QHash<const MCompositeManagerExtension*, QList<int> >::const_iterator exit = extensions.constBegin(); exit != extensions.constEnd(); ++exit) {
         int event;
         bool first;
@@ -4093,11 +4217,33 @@ void MCompositeManager::dumpState(const char *heading)
         qDebug("-- %s for event(s) %s:",
                exit.key()->metaObject()->className(),
                events.toLatin1().constData());
+
+        // Time spent in the event handlers, to find the slow ones.
+        foreach (event, *exit)
+            foreach (const MCompositeManagerPrivate::ExtensionFilter &f,
+                     d->ext_filters[event])
+                if (f.extension == exit.key() && f.calls)
+                    qDebug("   event %d: %u calls, %llu us, max %llu us",
+                           event, f.calls, f.usecs, f.max_usecs);
         exit.key()->dumpState();
     }
 }
+#endif // WINDOW_DEBUG
 
-// Called when the remote control pipe has got input.
+// Returns the path of @name in the user's private $XDG_RUNTIME_DIR, or an
+// empty string if there is none.  The remote control pipe and the files
+// its release build commands write live there, so that other users can
+// neither send us commands nor choose where we write.
+static QByteArray runtime_file(const char *name)
+{
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    if (!dir || !*dir)
+        return QByteArray();
+    return QByteArray(dir) + '/' + name;
+}
+
+// Called when the remote control pipe has got input.  Only "stats" and
+// "trace" are available in release builds, the rest needs WINDOW_DEBUG.
 void MCompositeManager::remoteControl(int cmdfd)
 {
     int lcmd;
@@ -4109,7 +4255,37 @@ void MCompositeManager::remoteControl(int cmdfd)
         lcmd--;
     cmd[lcmd] = '\0';
 
-    if (!strcmp(cmd, "state")) {
+    if (!strcmp(cmd, "stats")) {
+        d->printStats(stderr);
+    } else if (!strcmp(cmd, "stats reset")) {
+        for (int i = 0; i < MCompositeManagerPrivate::STATS_HANDLERS; ++i)
+            d->handler_stats[i].reset();
+        qDebug("handler statistics reset");
+    } else if (!strcmp(cmd, "stats save")) {
+        QByteArray fname = runtime_file("mcompositor-stats.txt");
+        FILE *out;
+
+        if (fname.isEmpty()) {
+            qWarning("%s: XDG_RUNTIME_DIR is not set", __func__);
+            return;
+        }
+        if (!(out = fopen(fname.constData(), "w"))) {
+            qWarning("%s: %s: %s", __func__, fname.constData(),
+                     strerror(errno));
+            return;
+        }
+        d->printStats(out);
+        fclose(out);
+        qDebug("handler statistics saved into %s", fname.constData());
+    } else if (!strcmp(cmd, "trace")) {
+        QByteArray fname = runtime_file("mcompositor.trace");
+
+        if (fname.isEmpty())
+            qWarning("%s: XDG_RUNTIME_DIR is not set", __func__);
+        else if (MTrace::save(fname.constData()))
+            qDebug("trace saved into %s", fname.constData());
+#ifdef WINDOW_DEBUG
+    } else if (!strcmp(cmd, "state")) {
         dumpState();
     } else if (!strncmp(cmd, "state ", strlen("state "))) {
         const char *space = &cmd[strlen("state")];
@@ -4172,75 +4348,61 @@ void MCompositeManager::remoteControl(int cmdfd)
         qDebug("Die, you son of a bitch!");
         execv(me.toLatin1().constData(), (char **)argv);
         qDebug("Gothca!");
+    } else if (!strcmp(cmd, "record")) {
+        d->recordEvents(0);
+        qDebug("event recording stopped");
+    } else if (!strncmp(cmd, "record ", strlen("record "))) {
+        const char *fname = &cmd[strlen("record")];
+        d->recordEvents(fname + strspn(fname, " "));
     } else if (!strcmp(cmd, "exit") || !strcmp(cmd, "quit")) {
         // exit() deadlocks, go the fast route
         delete d;
         XFlush(QX11Info::display());
         _exit(0);
+#endif // WINDOW_DEBUG
     } else if (!strcmp(cmd, "help")) {
         qDebug("Commands i understand:");
+        qDebug("  stats           print the time spent in the event handlers,");
+        qDebug("                  painting and swapping");
+        qDebug("  stats save      save them into "
+               "$XDG_RUNTIME_DIR/mcompositor-stats.txt");
+        qDebug("  stats reset     clear these statistics");
+        qDebug("  trace           save the xtrace() ring buffer for tracedump");
+        qDebug("                  into $XDG_RUNTIME_DIR/mcompositor.trace");
+#ifdef WINDOW_DEBUG
         qDebug("  state [<tag>]   dump MCompositeManager, MCompositeWindow:s ");
         qDebug("                  and QGraphicsScene state information");
         qDebug("  save [<fname>]  dump it into <fname>");
+        qDebug("  record <fname>  log the X events into <fname> for eventreplay");
+        qDebug("  record          stop logging them");
         qDebug("  exit, quit      geez");
         qDebug("  restart         re-execute mcompositor");
+#endif
     } else
         qDebug("%s: unknown command", cmd);
 }
 
-void MCompositeManager::xtrace(const char *fun, const char *msg, int lmsg)
+void MCompositeManager::xtrace(const char *fun, const char *msg, int)
 {
-    MCompositeManager *p = static_cast<MCompositeManager *>(qApp);
-    char str[160];
-
-    // Normalize @fun and @msg so that @msg != NULL in the end,
-    // and turn synopsis [2] into MCompositor::xtrace(NULL, msg).
+    // Turn synopsis [2] into MCompositor::xtrace(NULL, msg).
     if (!msg) {
         if (fun) {
             msg = fun;
             fun = NULL;
-        } else {
+        } else
             msg = "HERE";
-            lmsg = strlen("HERE");
-        }
     }
-
-    // Fail if we don't have an X connection yet.
-    if (!p || !p->d || !p->d->xcb_conn) {
-        qWarning("cannot xtrace yet from %s", fun ? fun : msg);
-        return;
-    }
-
-    // Format @str to include both @fun and @msg if @fun was specified,
-    // and count the length of @str.
-    if (fun != NULL) {
-        lmsg = snprintf(str, sizeof(str), "%s from %s", msg, fun);
-        msg = str;
-    } else if (lmsg < 0)
-        lmsg = strlen(msg);
-
-    // Make @str visible in xtrace by sending it along with an innocent
-    // X request.  Unfortunately this makes this function a synchronisation
-    // point (it has to wait for the reply).  Use xcb rather than libx11
-    // because the latter maintains a hashtable of known Atom:s.
-    free(xcb_intern_atom_reply(p->d->xcb_conn,
-                               xcb_intern_atom(p->d->xcb_conn, False,
-                                               lmsg, msg),
-                               NULL));
+    MTrace::add(fun, msg);
 }
 
 void MCompositeManager::xtracef(const char *fun, const char *fmt, ...)
 {
     va_list printf_args;
-    char msg[160];
-    int lmsg;
 
     va_start(printf_args, fmt);
-    lmsg = vsnprintf(msg, sizeof(msg), fmt, printf_args);
+    MTrace::vaddf(fun, 0, fmt, printf_args);
     va_end(printf_args);
-    xtrace(fun, msg, lmsg);
 }
-#endif // WINDOW_DEBUG
 
 MCompositeManager::MCompositeManager(int &argc, char **argv)
     : QApplication(argc, argv)
@@ -4251,12 +4413,52 @@ MCompositeManager::MCompositeManager(int &argc, char **argv)
 
 #ifdef WINDOW_DEBUG
     signal(SIGUSR1, sigusr1_handler);
+#endif
 
-    // Open the remote control interface.
-    mknod("/tmp/mrc", S_IFIFO | 0666, 0);
-    connect(new QSocketNotifier(open("/tmp/mrc", O_RDWR), QSocketNotifier::Read),
-            SIGNAL(activated(int)), SLOT(remoteControl(int)));
+    // Open the remote control interface.  Debug builds fall back to the
+    // traditional /tmp/mrc, but it still has to be our own pipe.
+    QByteArray mrc = runtime_file("mrc");
+#ifdef WINDOW_DEBUG
+    if (mrc.isEmpty())
+        mrc = "/tmp/mrc";
 #endif
+    if (!mrc.isEmpty()) {
+        struct stat st;
+        int fd;
+
+        if (mknod(mrc.constData(), S_IFIFO | 0600, 0) < 0 && errno != EEXIST)
+            qWarning("%s: %s: %s", __func__, mrc.constData(),
+                     strerror(errno));
+        else if (lstat(mrc.constData(), &st) < 0 || !S_ISFIFO(st.st_mode)
+                 || st.st_uid != getuid() || (st.st_mode & 077))
+            qWarning("%s: %s is not our private pipe", __func__,
+                     mrc.constData());
+        else if ((fd = open(mrc.constData(), O_RDWR)) < 0)
+            qWarning("%s: %s: %s", __func__, mrc.constData(),
+                     strerror(errno));
+        else
+            connect(new QSocketNotifier(fd, QSocketNotifier::Read, this),
+                    SIGNAL(activated(int)), SLOT(remoteControl(int)));
+    }
+}
+
+// Measures the time of painting a frame to account the part not spent
+// in MCompositeScene::drawItems(), which is mostly the buffer swap.
+bool MCompositeManager::notify(QObject *receiver, QEvent *event)
+{
+    if (event->type() != QEvent::Paint || !d
+        || receiver != d->glwidget)
+        return QApplication::notify(receiver, event);
+
+    MTrace::add(0, "frame start");
+    unsigned long long t0 = MLatencyHistogram::now();
+    d->draw_usecs = 0;
+    bool ret = QApplication::notify(receiver, event);
+    unsigned long long t = MLatencyHistogram::now() - t0;
+    MTrace::addf(0, 0, "frame end, %llu us", t);
+    d->handler_stats[MCompositeManagerPrivate::STATS_SWAP].add(
+                                    t > d->draw_usecs ? t - d->draw_usecs : 0);
+    return ret;
 }
 
 MCompositeManager::~MCompositeManager()
@@ -4265,14 +4467,15 @@ MCompositeManager::~MCompositeManager()
     d = 0;
 }
 
-const QHash<Window, MWindowPropertyCache*>& MCompositeManager::propCaches() const
+QHash<Window, MWindowPropertyCache*> MCompositeManager::propCaches() const
 {
-    return d->prop_caches;
+    return d->registry.propertyCaches();
 }
 
 void MCompositeManager::setGLWidget(QGLWidget *glw)
 {
     d->glwidget = glw;
+    d->animation_driver.setWidget(glw);
 }
 
 QGLWidget *MCompositeManager::glWidget() const
@@ -4308,9 +4511,104 @@ void MCompositeManager::loadPlugins(const QString &overridePluginPath,
         qWarning("no plugins loaded");
 }
 
+// The server timestamp of @e, or CurrentTime if it has none.
+static Time event_time(const XEvent *e)
+{
+    switch (e->type) {
+    case KeyPress:
+    case KeyRelease:
+        return e->xkey.time;
+    case ButtonPress:
+    case ButtonRelease:
+        return e->xbutton.time;
+    case MotionNotify:
+        return e->xmotion.time;
+    case EnterNotify:
+    case LeaveNotify:
+        return e->xcrossing.time;
+    case PropertyNotify:
+        return e->xproperty.time;
+    default:
+        return CurrentTime;
+    }
+}
+
+static bool filterEvent(MCompositeManagerPrivate *d, XEvent *event)
+{
+    // The X server's time is CLOCK_MONOTONIC in milliseconds, so we can
+    // tell how long the event has been waiting for us.  Differences of
+    // more than a minute mean that the clocks are not comparable.
+    Time t = event_time(event);
+    if (t != CurrentTime) {
+        CARD32 late = (CARD32)(MLatencyHistogram::now() / 1000) - (CARD32)t;
+        if (late < 60000)
+            d->event_latency.add(late * 1000ULL);
+    }
+
+    MTrace::addf(0, event->xany.window, "event %d", event->type);
+#ifdef WINDOW_DEBUG
+    MCompAtoms::instance()->current_event = event->type;
+#endif
+    unsigned long long t0 = MLatencyHistogram::now();
+    bool ret = d->x11EventFilter(event);
+    unsigned long long t = MLatencyHistogram::now() - t0;
+    d->handlerStats(event->type).add(t);
+    if (d->recorder)
+        d->recorder->event(event, t);
+#ifdef WINDOW_DEBUG
+    MCompAtoms::instance()->current_event = 0;
+#endif
+    return ret;
+}
+
+// Upper limit of events handled in one batch, so that a flood of events
+// cannot hold back painting for long.
+#define EVENT_BATCH_MAX 64
+
+static bool is_user_input_event(const XEvent *e)
+{
+    switch (e->type) {
+    case KeyPress: case KeyRelease:
+    case ButtonPress: case ButtonRelease: case MotionNotify:
+    case EnterNotify: case LeaveNotify:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// An event we consume starts a batch: it drains the events already
+// queued on the connection, passing them through Qt as its event
+// dispatcher would.  Events Qt also handles don't, or Qt would see the
+// queued ones before them.  The drain stops at the first user input
+// event, which is left to the dispatcher so that it can honour
+// QEventLoop::ExcludeUserInputEvents.  The handlers only mark stacking
+// and focus dirty, and endEventBatch() acts on them once, so a new
+// application's map and the burst of property and configure events that
+// comes with it cost a single stacking pass.
 bool MCompositeManager::x11EventFilter(XEvent *event)
 {
-    return d->x11EventFilter(event);
+    if (d->in_event_batch)
+        // called back by x11ProcessEvent() below
+        return filterEvent(d, event);
+
+    d->in_event_batch = true;
+    bool ret = filterEvent(d, event);
+    Display *dpy = QX11Info::display();
+    int n;
+    for (n = 0; ret && n < EVENT_BATCH_MAX
+                && XEventsQueued(dpy, QueuedAfterReading); ++n) {
+        XEvent ev;
+        XPeekEvent(dpy, &ev);
+        if (is_user_input_event(&ev))
+            break;
+        XNextEvent(dpy, &ev);
+        if (!XFilterEvent(&ev, None))
+            x11ProcessEvent(&ev);
+    }
+    d->in_event_batch = false;
+    d->endEventBatch(1 + n);
+    return ret;
 }
 
 void MCompositeManager::setSurfaceWindow(Qt::HANDLE window)
@@ -4355,8 +4653,7 @@ bool MCompositeManager::isCompositing()
 
 void MCompositeManager::debug(const QString& d)
 {
-    const char* msg = d.toAscii();
-    _log("%s\n", msg);
+    MTrace::add(0, d.toAscii().constData());
 }
 
 bool MCompositeManager::displayOff()
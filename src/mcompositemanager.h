@@ -79,6 +79,12 @@ public:
      */
     virtual bool x11EventFilter(XEvent *event);
 
+    /*!
+     * Reimplemented from QApplication::notify() to measure the time
+     * of painting the frames
+     */
+    virtual bool notify(QObject *receiver, QEvent *event);
+
     /*!
      * Returns the scene where the items are rendered
      */
@@ -133,7 +139,11 @@ public:
     bool displayOff();
 
     void debug(const QString& d);
-    const QHash<Window, MWindowPropertyCache*>& propCaches() const;
+    /*!
+     * Returns the property caches of all the windows by their XIDs.
+     * The hash is built on each call.
+     */
+    QHash<Window, MWindowPropertyCache*> propCaches() const;
 
     enum StackPosition {
         STACK_BOTTOM = 0,
@@ -148,21 +158,24 @@ public:
     // to qDebug().  Only available if compiled with TESTABILITY=on
     // (-DWINDOW_DEBUG).
     void dumpState(const char *heading = 0);
+#endif
 
-    // "Print" @msg in xtrace, to show you where your program's control was
-    // between the various X requests, responses and events.
+    // Record @msg in the trace ring buffer (see MTrace) to show you where
+    // your program's control was between the various X events.  It's cheap
+    // and no X request, so it can stay in release builds.  Save the ring
+    // with the "trace" remote control command.  Only the pointer of @fun
+    // is recorded, so it must be static, like __PRETTY_FUNCTION__.
     // Synopsis:
     // [1] MCompositeManager::xtrace();
     // [2] MCompositeManager::xtrace("HEI");
     // [3] MCompositeManager::xtrace(__PRETTY_FUNCTION__, "HEI");
     //
-    // xtracef() is the same, except that it sends a formatted message.
-    // You can leave @fun NULL if you want.
+    // xtracef() is the same, except that it records a formatted message.
+    // You can leave @fun NULL if you want.  @lmsg is not needed anymore.
     static void xtrace (const char *fun = NULL, const char *msg = NULL,
                         int lmsg = -1);
     static void xtracef(const char *fun, const char *fmt, ...)
         __attribute__((format(printf, 2, 3)));
-#endif
 
 public slots:
     void enableCompositing(bool forced = false);
@@ -193,9 +206,7 @@ public slots:
      */
     const QRect &availableRect() const;
 
-#ifdef WINDOW_DEBUG
     void remoteControl(int fd);
-#endif
      
 signals:
     void decoratorRectChanged(const QRect& rect);
@@ -209,6 +220,7 @@ private:
     friend class MTexturePixmapPrivate;
     friend class MWindowPropertyCache;
     friend class MCompositeWindowGroup;
+    friend class MCompositeScene;
 };
 
 #endif
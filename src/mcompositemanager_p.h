@@ -22,6 +22,8 @@
 
 #include <QObject>
 #include <QHash>
+#include <QSet>
+#include <QTime>
 #include <QPixmap>
 #include <QTimer>
 #include <QDir>
@@ -29,8 +31,15 @@
 #include <X11/Xutil.h>
 #include <X11/Xlib.h>
 #include <X11/extensions/Xdamage.h>
+#include <X11/extensions/sync.h>
 #include <X11/Xlib-xcb.h>
 
+#include "mocclusiontracker.h"
+#include "manimationdriver.h"
+#include "mstartupprofile.h"
+#include "mwindowregistry.h"
+#include "mlatencyhistogram.h"
+
 class QGraphicsScene;
 class QGLWidget;
 
@@ -41,6 +50,8 @@ class MCompositeWindow;
 class MDeviceState;
 class MWindowPropertyCache;
 class MCompositeManagerExtension;
+class MXReader;
+class MEventRecorder;
 
 enum {
     INPUT_LAYER = 0,
@@ -84,6 +95,7 @@ public:
     void positionWindow(Window w, bool on_top);
     void addItem(MCompositeWindow *item);
     void damageEvent(XDamageNotifyEvent *);
+    void syncAlarmEvent(XSyncAlarmNotifyEvent *);
     void destroyEvent(XDestroyWindowEvent *);
     void propertyEvent(XPropertyEvent *);
     void unmapEvent(XUnmapEvent *);
@@ -112,6 +124,8 @@ public:
     Window getLastVisibleParent(MWindowPropertyCache *pc);
 
     bool possiblyUnredirectTopmostWindow();
+    void suspendRendering();
+    void resumeRendering();
     bool haveMappedWindow() const;
     bool isRedirected(Window window);
     bool x11EventFilter(XEvent *event);
@@ -123,8 +137,7 @@ public:
     
     void roughSort();
     void setCurrentApp(Window w, bool stacking_order_changed);
-    bool raiseWithTransients(MWindowPropertyCache *pc,
-                           int parent_idx, QList<int> *anewpos = NULL);
+    bool raiseWithTransients(MWindowPropertyCache *pc, int parent_idx);
     MCompositeScene *watch;
     Window localwin, localwin_parent;
     Window xoverlay;
@@ -141,20 +154,36 @@ public:
     QList<Window> stacking_list;
     QList<Window> windows_as_mapped;
 
-    QHash<Window, MCompositeWindow *> windows;
-    struct FrameData {
-        FrameData(): frame(0), parentWindow(0), mapped(false) {}
-        MSimpleWindowFrame *frame;
-        Window                parentWindow;
-        bool mapped;
+    // property caches, items, frames and early ConfigureRequests by XID
+    MWindowRegistry registry;
+    typedef MWindowRegistry::FrameData FrameData;
+    // property caches waiting for replies from the X server
+    QSet<MWindowPropertyCache*> pending_prop_caches;
+    bool stackingRepliesPending() const;
+    void releaseStackingHold();
+    // The extensions listening to each X event type in the order they
+    // were installed, with the time spent in their event handlers.
+    struct ExtensionFilter {
+        MCompositeManagerExtension *extension;
+        unsigned calls;
+        unsigned long long usecs, max_usecs;
     };
-    QHash<Window, FrameData> framed_windows;
-    QHash<Window, QList<XConfigureRequestEvent> > configure_reqs;
-    QHash<Window, MWindowPropertyCache*> prop_caches;
-    QMultiHash<int, MCompositeManagerExtension* > m_extensions;
+    enum { EXTENSION_EVENT_TYPES = 128 };
+    QVector<ExtensionFilter> ext_filters[EXTENSION_EVENT_TYPES];
+    const QVector<ExtensionFilter> &extensionFilters(int type) const {
+        static const QVector<ExtensionFilter> none;
+        return (unsigned)type < EXTENSION_EVENT_TYPES ? ext_filters[type]
+                                                      : none;
+    }
 
     int damage_event;
     int damage_error;
+    // for _NET_WM_SYNC_REQUEST, -1 if the server has no XSync
+    int sync_event;
+    // the windows waiting for their XSync alarm
+    QHash<XSyncAlarm, Window> sync_alarms;
+    // how long the clients without it take to draw their first frame
+    MStartupProfile startup_profile;
 
     bool compositing;
     bool overlay_mapped;
@@ -166,12 +195,58 @@ public:
     bool prepared;
 
     xcb_connection_t *xcb_conn;
+    // waits for the property replies if enabled with -xreader
+    MXReader *xreader;
+    // X server timestamp to the event's handling, and a window's
+    // property requests to the arrival of their last reply
+    MLatencyHistogram event_latency, reply_latency;
+    // Time spent in the X event handlers by event type and in the other
+    // hot paths, see the "stats" remote control command.
+    enum {
+        STATS_DAMAGE = LASTEvent,   // damageEvent()
+        STATS_OTHER_EXTENSION,      // events of the other extensions
+        STATS_STACKING,             // checkStacking()
+        STATS_DRAW,                 // MCompositeScene::drawItems()
+        STATS_SWAP,                 // the rest of the frame, mostly the swap
+        STATS_HANDLERS
+    };
+    MLatencyHistogram handler_stats[STATS_HANDLERS];
+    MLatencyHistogram &handlerStats(int event_type);
+    void printStats(FILE *out) const;
+    // drawItems() time of the frame being painted
+    unsigned long long draw_usecs;
+    // logs the events if enabled with -record=<file>
+    MEventRecorder *recorder;
+    void recordEvents(const char *fname);
 
     // mechanism for lazy stacking
     QTimer stacking_timer;
     bool stacking_timeout_check_visibility;
     Time stacking_timeout_timestamp;
-    void dirtyStacking(bool force_visibility_check, Time t = CurrentTime);
+    // when the stacking pass was held back to wait for property replies
+    QTime stacking_hold_time;
+    bool stacking_held;
+    // set while a batch of X events is being handled, see
+    // MCompositeManager::x11EventFilter()
+    bool in_event_batch;
+    bool batch_stacking, batch_focus_check;
+    void endEventBatch(int events);
+    // visible regions of the mapped windows, updated by checkStacking()
+    MOcclusionTracker occlusion;
+    // advances the window animations
+    MAnimationDriver animation_driver;
+    // whether the shaders evaluate the transitions, see -gpu-transitions
+    bool gpu_transitions;
+    // the display is off and nothing is rendered, see suspendRendering()
+    bool render_suspended;
+    // free the pixmaps of all but the topmost window while suspended
+    bool suspend_release;
+    enum StackingPolicy {
+        DEFER_STACKING = 0, // coalesce until the event queue is drained
+        SYNC_STACKING       // run the stacking pass right away
+    };
+    void dirtyStacking(bool force_visibility_check, Time t = CurrentTime,
+                       StackingPolicy policy = DEFER_STACKING);
     void pingTopmost();
 
 signals:
@@ -195,7 +270,8 @@ public slots:
     
     void displayOff(bool display_off);
     void callOngoing(bool call_ongoing);
-    void stackingTimeout();
+    void stackingTimeout(bool hold = true);
+    void collectPropertyReplies();
     void setupButtonWindows(Window topmost);
 };
 
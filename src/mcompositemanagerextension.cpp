@@ -20,6 +20,7 @@
 #include "mcompositemanager.h"
 #include "mcompositemanager_p.h"
 #include "mcompositemanagerextension.h"
+#include "mwindowpropertycache.h"
 
 MCompositeManagerExtension::MCompositeManagerExtension(QObject *parent)
     :QObject(parent)
@@ -43,6 +44,14 @@ void MCompositeManagerExtension::listenXEventType(long XEventType)
     p->d->installX11EventFilter(XEventType, this);
 }
 
+int MCompositeManagerExtension::registerWindowProperty(Atom atom, Atom type,
+                                                       unsigned max_len,
+                                                       bool prefetch)
+{
+    return MWindowPropertyCache::registerProperty(atom, type, max_len,
+                                                  prefetch);
+}
+
 void MCompositeManagerExtension::dumpState() const
 {
     /* NOP */
@@ -60,6 +60,19 @@ class MCompositeManagerExtension: public QObject
      */
     void listenXEventType(long XEventType);
 
+    /*!
+     * Asks the composite manager to cache property \a atom of every
+     * window, see MWindowPropertyCache::registerProperty().  The returned
+     * handle can be given to MWindowPropertyCache::propertyData() or to
+     * the typed cardinalProperty(), atomListProperty() and
+     * stringProperty(), and MWindowPropertyCache::propertyChanged()
+     * tells about changes.
+     * Properties registered with \a prefetch are requested together
+     * with the built-in ones when a window is created.
+     */
+    int registerWindowProperty(Atom atom, Atom type, unsigned max_len,
+                               bool prefetch = true);
+
     //! qDebug() any state information indented by three spaces you want
     //! to be included in MCompositeManager::dumpState()'s output.
     virtual void dumpState() const;
@@ -74,12 +87,11 @@ class MCompositeManagerExtension: public QObject
      * the event, otherwise return false to try forwarding the native event to 
      * the composite manager. 
      * 
-     * If there are other extensions that are subscribed to the same event and 
-     * this function returns true, the event will still be blocked from 
-     * propagating to the composite manager even if this function 
-     * returns false. Be careful when returning true when there are other 
-     * extensions around and only use as a last resort to reimplement core 
-     * functionality.
+     * Extensions subscribed to the same event are called in the order they
+     * subscribed, and the first one returning true consumes the event:
+     * it won't be offered to the rest of the extensions either.  Be careful
+     * when returning true when there are other extensions around and only
+     * use as a last resort to reimplement core functionality.
      */
     virtual bool x11Event(XEvent *event) = 0;
 
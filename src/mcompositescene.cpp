@@ -24,10 +24,14 @@
 #include <QTimer>
 #include <QApplication>
 #include <QDesktopWidget>
+#include <QStyleOptionGraphicsItem>
 
 #include "mcompositewindow.h"
 #include "mcompositescene.h"
 #include "mcompositewindowgroup.h"
+#include "mcompositemanager.h"
+#include "mcompositemanager_p.h"
+#include "meventrecorder.h"
 
 #include <X11/extensions/Xfixes.h>
 #ifdef HAVE_SHAPECONST
@@ -50,8 +54,13 @@ static int error_handler(Display * , XErrorEvent *error)
 }
 
 MCompositeScene::MCompositeScene(QObject *p)
-    : QGraphicsScene(p)
+    : QGraphicsScene(p),
+      next_add_order(0)
 {
+    // The index is only useful for finding items at a position, and
+    // every setPos() and setZValue() has to update it.
+    if (qApp->arguments().contains("-noindex"))
+        setItemIndexMethod(QGraphicsScene::NoIndex);
     setBackgroundBrush(Qt::NoBrush);
     setForegroundBrush(Qt::NoBrush);
     setSceneRect(QRect(0, 0,
@@ -78,8 +87,67 @@ void MCompositeScene::prepareRoot()
     XSetErrorHandler(error_handler);
 }
 
+void MCompositeScene::insertToRenderList(QGraphicsItem *item)
+{
+    // binary search for the first item painted after this one
+    qreal z = item->zValue();
+    unsigned order = add_order.value(item);
+    int lo = 0, hi = render_list.size();
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        const QGraphicsItem *m = render_list.at(mid);
+        if (m->zValue() < z
+            || (m->zValue() == z && add_order.value(m) < order))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    render_list.insert(lo, item);
+}
+
+void MCompositeScene::addToRenderList(QGraphicsItem *item)
+{
+    if (add_order.contains(item))
+        return;
+    add_order.insert(item, next_add_order++);
+    insertToRenderList(item);
+}
+
+void MCompositeScene::removeFromRenderList(QGraphicsItem *item)
+{
+    if (!add_order.contains(item))
+        return;
+    render_list.remove(render_list.indexOf(item));
+    add_order.remove(item);
+}
+
+void MCompositeScene::renderListChanged(QGraphicsItem *item)
+{
+    if (!add_order.contains(item))
+        return;
+    render_list.remove(render_list.indexOf(item));
+    insertToRenderList(item);
+}
+
 void MCompositeScene::drawItems(QPainter *painter, int numItems, QGraphicsItem *items[], const QStyleOptionGraphicsItem options[], QWidget *widget)
 {
+    MCompositeManagerPrivate *d = ((MCompositeManager *)qApp)->d;
+    unsigned long long t0 = MLatencyHistogram::now();
+    // Paint our windows rather than what the view found in the scene.
+    // MCompositeWindow::paint() doesn't look at the style options.
+    // Take a copy in case a window is restacked while we're painting.
+    static const QStyleOptionGraphicsItem option;
+    const QVector<QGraphicsItem *> list = renderList();
+    // Other items the view found, like the launch indicator, are painted
+    // over the windows.
+    QVector<int> others;
+    for (int i = 0; i < numItems; ++i)
+        if (!add_order.contains(items[i]))
+            others.append(i);
+    QGraphicsItem **other_items = items;
+    numItems = list.size();
+    items = const_cast<QGraphicsItem **>(list.constData());
+
     QRegion visible(sceneRect().toRect());
     QVector<int> to_paint(10);
     int size = 0;
@@ -135,6 +203,7 @@ void MCompositeScene::drawItems(QPainter *painter, int numItems, QGraphicsItem *
         if (!cw->isWindowTransitioning()
             && !cw->propertyCache()->hasAlpha() 
             && cw->opacity() == 1.0
+            && !cw->transition()
             && !cw->group()) // window is not renderered off-screen)
             visible -= r;
     }
@@ -161,8 +230,20 @@ void MCompositeScene::drawItems(QPainter *painter, int numItems, QGraphicsItem *
             }
             // TODO: paint only the intersected region (glScissor?)
             painter->setMatrix(cw->sceneMatrix(), true);
-            cw->paint(painter, &options[item_i], widget);
+            cw->paint(painter, &option, widget);
             painter->restore();
         }
     }
+    for (int i = 0; i < others.size(); ++i) {
+        QGraphicsItem *item = other_items[others.at(i)];
+        painter->save();
+        painter->setMatrix(item->sceneMatrix(), true);
+        item->paint(painter, &options[others.at(i)], widget);
+        painter->restore();
+    }
+    unsigned long long t = MLatencyHistogram::now() - t0;
+    d->handler_stats[MCompositeManagerPrivate::STATS_DRAW].add(t);
+    d->draw_usecs += t;
+    if (d->recorder)
+        d->recorder->frame(t, size);
 }
@@ -22,6 +22,8 @@
 
 #include <QGraphicsScene>
 #include <QGraphicsItem>
+#include <QVector>
+#include <QHash>
 #include <X11/Xlib.h>
 #include <map>
 
@@ -52,6 +54,20 @@ public:
      */
     void prepareRoot();
 
+    /*!
+     * Returns the windows of the scene bottom-up, in the order
+     * QGraphicsScene would paint them.  drawItems() paints from this list,
+     * so rendering doesn't depend on the scene index, which can be turned
+     * off with the -noindex option.
+     */
+    const QVector<QGraphicsItem *> &renderList() const { return render_list; }
+
+    // maintained by MCompositeWindow
+    void addToRenderList(QGraphicsItem *item);
+    void removeFromRenderList(QGraphicsItem *item);
+    // moves item to its new place after a Z-value change
+    void renderListChanged(QGraphicsItem *item);
+
 protected:
     void drawItems(QPainter *painter, int numItems, QGraphicsItem *items[], const QStyleOptionGraphicsItem options[], QWidget *widget);
 
@@ -60,6 +76,13 @@ private:
     Window root;
     bool drawActive;
 
+    void insertToRenderList(QGraphicsItem *item);
+
+    // the windows by Z, and those with equal Z in the order of adding
+    QVector<QGraphicsItem *> render_list;
+    QHash<const QGraphicsItem *, unsigned> add_order;
+    unsigned next_add_order;
+
 signals:
 
     void switchWindow();
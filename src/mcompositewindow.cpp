@@ -26,6 +26,9 @@
 #include "mcompositemanagerextension.h"
 #include "mcompositewindowgroup.h"
 
+#include "mcompositescene.h"
+#include "mtimerwheel.h"
+
 #include <QX11Info>
 #include <QGraphicsScene>
 #include <QGraphicsSceneMouseEvent>
@@ -57,6 +60,12 @@ MCompositeWindow::MCompositeWindow(Qt::HANDLE window,
       is_transitioning(false),
       dimmed_effect(false),
       waiting_for_damage(0),
+      gpu_transition(0),
+      sync_alarm(None),
+      sync_counter(None),
+      sync_value(0),
+      waiting_for_sync(false),
+      sync_for_map(false),
       win_id(window)
 {
     thumb_mode = false;
@@ -64,7 +73,7 @@ MCompositeWindow::MCompositeWindow(Qt::HANDLE window,
         is_valid = false;
         anim = 0;
         newly_mapped = false;
-        t_ping = t_reappear = damage_timer = 0;
+        t_ping = t_reappear = damage_timer = sync_timer = 0;
         window_visible = false;
         return;
     } else
@@ -75,29 +84,10 @@ MCompositeWindow::MCompositeWindow(Qt::HANDLE window,
     connect(mpc, SIGNAL(iconGeometryUpdated()), SLOT(updateIconGeometry()));
     setAcceptHoverEvents(true);
 
-    // this could be configurable. But will do for now. Most WMs use 5s delay
-    t_ping = new QTimer(this);
-    t_ping->setInterval(5000);
-    connect(t_ping, SIGNAL(timeout()), SLOT(pingTimeout()));
-    t_reappear = new QTimer(this);
-    t_reappear->setSingleShot(true);
-    t_reappear->setInterval(30 * 1000);
-    connect(t_reappear, SIGNAL(timeout()), SLOT(reappearTimeout()));
-
-    damage_timer = new QTimer(this);
-    damage_timer->setSingleShot(true);
-    damage_timer->setInterval(500);
-    connect(damage_timer, SIGNAL(timeout()), SLOT(damageTimeout()));
-    
-    MCompAtoms* atoms = MCompAtoms::instance(); 
-    if (pc->windowType() == MCompAtoms::NORMAL)
-        pc->setWindowTypeAtom(ATOM(_NET_WM_WINDOW_TYPE_NORMAL));
-    else
-        pc->setWindowTypeAtom(atoms->getType(window));
+    t_ping = t_reappear = damage_timer = sync_timer = 0;
 
-    // needed before calling isAppWindow()
-    QVector<Atom> states = atoms->getAtomArray(window, ATOM(_NET_WM_STATE));
-    pc->setNetWmState(states.toList());
+    // needed before calling isAppWindow(), also sets windowTypeAtom()
+    pc->windowType();
 
     // Newly-mapped non-decorated application windows are not initially 
     // visible to prevent flickering when animation is started.
@@ -126,15 +116,30 @@ MCompositeWindow::~MCompositeWindow()
 
     if (window()) {
         stopPing();
-        t_ping = t_reappear = 0;
     }
+    // not QObjects, so not deleted with us
+    delete t_ping;
+    delete t_reappear;
+    delete damage_timer;
+    delete sync_timer;
+    t_ping = t_reappear = damage_timer = sync_timer = 0;
     endAnimation();
     
     anim = 0;
+
+    p->d->startup_profile.forget(window());
+    if (sync_alarm != None) {
+        p->d->sync_alarms.remove(sync_alarm);
+        XSyncDestroyAlarm(QX11Info::display(), sync_alarm);
+    }
+
+    // ~QGraphicsItem() removes us from the scene without telling
+    if (MCompositeScene *sc = qobject_cast<MCompositeScene *>(scene()))
+        sc->removeFromRenderList(this);
     
     if (pc) {
         pc->damageTracking(false);
-        p->d->prop_caches.remove(window());
+        p->d->registry.setPropertyCache(window(), 0);
         pc->deleteLater();
     }    
 }
@@ -188,9 +193,10 @@ void MCompositeWindow::iconify(const QRectF &icongeometry, bool defer)
     
     // Custom iconify handler
     MCompositeManager *p = (MCompositeManager *) qApp;
-    QList<MCompositeManagerExtension*> evlist = p->d->m_extensions.values(MapNotify);
+    const QVector<MCompositeManagerPrivate::ExtensionFilter> &evlist =
+                                    p->d->extensionFilters(MapNotify);
     for (int i = 0; i < evlist.size(); ++i) { 
-        if (evlist[i]->windowIconified(this, defer)) {
+        if (evlist[i].extension->windowIconified(this, defer)) {
             iconified = true;
             window_status = Normal;
             return;
@@ -248,21 +254,25 @@ void MCompositeWindow::setIconifyState(MCompositeWindow::IconifyState state)
 }
 
 void MCompositeWindow::setWindowObscured(bool obscured, bool no_notify)
+{
+    setWindowVisibility(obscured ? VisibilityFullyObscured :
+                                   VisibilityUnobscured, no_notify);
+}
+
+void MCompositeWindow::setWindowVisibility(int state, bool no_notify)
 {
     MCompositeManager *p = (MCompositeManager *) qApp;
-    short new_value = obscured ? 1 : 0;
-    if ((new_value == window_obscured && !newly_mapped)
-        || (!obscured && p->displayOff()))
+    if ((state == window_obscured && !newly_mapped)
+        || (state != VisibilityFullyObscured && p->displayOff()))
         return;
-    window_obscured = new_value;
+    window_obscured = state;
 
     if (!no_notify) {
         XVisibilityEvent c;
         c.type       = VisibilityNotify;
         c.send_event = True;
         c.window     = window();
-        c.state      = obscured ? VisibilityFullyObscured :
-                                  VisibilityUnobscured;
+        c.state      = state;
         XSendEvent(QX11Info::display(), window(), true,
                    VisibilityChangeMask, (XEvent *)&c);
     }
@@ -312,9 +322,10 @@ void MCompositeWindow::restore(const QRectF &icongeometry, bool defer)
 {
      // Custom restore handler
     MCompositeManager *p = (MCompositeManager *) qApp;
-    QList<MCompositeManagerExtension*> evlist = p->d->m_extensions.values(MapNotify);
+    const QVector<MCompositeManagerPrivate::ExtensionFilter> &evlist =
+                                    p->d->extensionFilters(MapNotify);
     for (int i = 0; i < evlist.size(); ++i) { 
-        if (evlist[i]->windowRestored(this, defer)) {
+        if (evlist[i].extension->windowRestored(this, defer)) {
             iconified = false;
             return;
         }
@@ -353,10 +364,35 @@ bool MCompositeWindow::showWindow()
         // NB#180628 - some stupid apps are listening for visibilitynotifies.
         // Well, all of the toolkit anyways
         setWindowObscured(false);
-        // waiting for two damage events seems to work for Meegotouch apps
-        // at least, for the rest, there is a timeout
-        waiting_for_damage = 2;
-        damage_timer->start();
+        if (requestSync()) {
+            // a synthetic ConfigureNotify makes the client draw a frame
+            // and update the counter
+            const QRect &g = pc->realGeometry();
+            XEvent ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.xconfigure.type = ConfigureNotify;
+            ev.xconfigure.event = ev.xconfigure.window = window();
+            ev.xconfigure.x = g.x();
+            ev.xconfigure.y = g.y();
+            ev.xconfigure.width = g.width();
+            ev.xconfigure.height = g.height();
+            ev.xconfigure.above = None;
+            ev.xconfigure.override_redirect = False;
+            XSendEvent(QX11Info::display(), window(), False,
+                       StructureNotifyMask, &ev);
+            sync_for_map = true;
+        } else {
+            // wait for as many damage events and as long as this
+            // application has taken to draw its first frame before
+            MStartupProfile &profile =
+                        ((MCompositeManager *) qApp)->d->startup_profile;
+            QByteArray key = profile.key(pc);
+            MStartupProfile::Prediction pred = profile.predict(key);
+            waiting_for_damage = pred.damages;
+            timer(damage_timer, pred.timeout, true,
+                  SLOT(damageTimeout()))->start(pred.timeout);
+            profile.observe(window(), key);
+        }
     } else
         q_fadeIn();
     return true;
@@ -367,10 +403,95 @@ void MCompositeWindow::damageTimeout()
     damageReceived(true);
 }
 
+bool MCompositeWindow::requestSync()
+{
+    MCompositeManager *p = (MCompositeManager *) qApp;
+    Display *dpy = QX11Info::display();
+    if (p->d->sync_event < 0 || !pc || !pc->is_valid
+        || pc->supportedProtocols().indexOf(ATOM(_NET_WM_SYNC_REQUEST)) == -1)
+        return false;
+    XSyncCounter counter = pc->syncCounter();
+    if (counter == None)
+        return false;
+
+    // The client may have set its counter to anything before we got to
+    // ask, so continue from its current value, which is also what the
+    // client increments from.  Same if it has replaced the counter.
+    XSyncValue v;
+    if (counter != sync_counter) {
+        SYNC_ROUND_TRIP();
+        if (!XSyncQueryCounter(dpy, counter, &v))
+            return false;
+        sync_counter = counter;
+        sync_value = ((quint64)(unsigned)XSyncValueHigh32(v) << 32)
+                     | XSyncValueLow32(v);
+    }
+
+    // wait for the counter to reach the next value
+    XSyncAlarmAttributes attr;
+    ++sync_value;
+    XSyncIntsToValue(&v, (unsigned)(sync_value & 0xffffffff),
+                     (int)(sync_value >> 32));
+    attr.trigger.counter = counter;
+    attr.trigger.value_type = XSyncAbsolute;
+    attr.trigger.wait_value = v;
+    attr.trigger.test_type = XSyncPositiveComparison;
+    if (sync_alarm == None) {
+        attr.events = True;
+        XSyncIntToValue(&attr.delta, 0);
+        sync_alarm = XSyncCreateAlarm(dpy, XSyncCACounter | XSyncCAValueType
+                                      | XSyncCAValue | XSyncCATestType
+                                      | XSyncCADelta | XSyncCAEvents, &attr);
+        p->d->sync_alarms.insert(sync_alarm, window());
+    } else
+        // the counter may have been replaced since the last request
+        XSyncChangeAlarm(dpy, sync_alarm, XSyncCACounter | XSyncCAValue,
+                         &attr);
+
+    XEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.xclient.type = ClientMessage;
+    ev.xclient.window = window();
+    ev.xclient.message_type = ATOM(WM_PROTOCOLS);
+    ev.xclient.format = 32;
+    ev.xclient.data.l[0] = ATOM(_NET_WM_SYNC_REQUEST);
+    ev.xclient.data.l[1] = CurrentTime;
+    ev.xclient.data.l[2] = XSyncValueLow32(v);
+    ev.xclient.data.l[3] = XSyncValueHigh32(v);
+    XSendEvent(dpy, window(), False, NoEventMask, &ev);
+
+    waiting_for_sync = true;
+    timer(sync_timer, 500, true, SLOT(syncTimeout()))->start();
+    return true;
+}
+
+void MCompositeWindow::syncTimeout()
+{
+    syncReceived();
+}
+
+void MCompositeWindow::syncReceived()
+{
+    if (!waiting_for_sync)
+        return;
+    waiting_for_sync = false;
+    if (sync_timer)
+        sync_timer->stop();
+
+    // the client has drawn the frame for its current size
+    if (pc && pc->windowState() != IconicState)
+        resize(pc->realGeometry().width(), pc->realGeometry().height());
+    if (sync_for_map) {
+        sync_for_map = false;
+        damageReceived(true);
+    }
+}
+
 void MCompositeWindow::damageReceived(bool timeout)
 {
     if (timeout || (waiting_for_damage > 0 && !--waiting_for_damage)) {
-        damage_timer->stop();
+        if (damage_timer)
+            damage_timer->stop();
         waiting_for_damage = 0;
         q_fadeIn();
     }
@@ -389,9 +510,10 @@ void MCompositeWindow::q_fadeIn()
     
     // Custom fade-in handler
     MCompositeManager *p = (MCompositeManager *) qApp;
-    QList<MCompositeManagerExtension*> evlist = p->d->m_extensions.values(MapNotify);
+    const QVector<MCompositeManagerPrivate::ExtensionFilter> &evlist =
+                                    p->d->extensionFilters(MapNotify);
     for (int i = 0; i < evlist.size(); ++i) { 
-        if (evlist[i]->windowShown(this)) 
+        if (evlist[i].extension->windowShown(this)) 
             return;
     }
     
@@ -437,9 +559,10 @@ void MCompositeWindow::closeWindowAnimation()
     origPosition = pos();
     
     // Custom close window animation handler    
-    QList<MCompositeManagerExtension*> evlist = p->d->m_extensions.values(MapNotify);
+    const QVector<MCompositeManagerPrivate::ExtensionFilter> &evlist =
+                                    p->d->extensionFilters(MapNotify);
     for (int i = 0; i < evlist.size(); ++i) { 
-        if (evlist[i]->windowClosed(this)) {
+        if (evlist[i].extension->windowClosed(this)) {
             window_status = Normal; // can't guarantee that Closing is cleared
             return;
         }
@@ -548,25 +671,28 @@ void MCompositeWindow::setVisible(bool visible)
 
 void MCompositeWindow::startPing()
 {
-    if (t_ping->isActive())
+    if (t_ping && t_ping->isActive())
         // this function can be called repeatedly without extending the timeout
         return;
     // startup: send ping now, otherwise it is sent after timeout
     pingWindow();
-    t_ping->start();
+    // this could be configurable. But will do for now. Most WMs use 5s delay
+    timer(t_ping, 5000, false, SLOT(pingTimeout()))->start();
 }
 
 void MCompositeWindow::stopPing()
 {
-    t_ping->stop();
-    t_reappear->stop();
+    if (t_ping)
+        t_ping->stop();
+    if (t_reappear)
+        t_reappear->stop();
 }
 
 void MCompositeWindow::startDialogReappearTimer()
 {
     if (window_status != Hung)
         return;
-    t_reappear->start();
+    timer(t_reappear, 30 * 1000, true, SLOT(reappearTimeout()))->start();
 }
 
 void MCompositeWindow::reappearTimeout()
@@ -586,7 +712,8 @@ void MCompositeWindow::receivedPing(ulong serverTimeStamp)
     }
     if (blurred())
         setBlurred(false);
-    t_reappear->stop();
+    if (t_reappear)
+        t_reappear->stop();
 }
 
 void MCompositeWindow::pingTimeout()
@@ -597,11 +724,40 @@ void MCompositeWindow::pingTimeout()
         window_status = Hung;
         emit windowHung(this, true);
     }
-    if (t_ping->isActive())
+    if (t_ping && t_ping->isActive())
         // interval timer is still active
         pingWindow();
 }
 
+MWheelTimer *MCompositeWindow::timer(MWheelTimer *&t, int interval,
+                                     bool single_shot, const char *slot)
+{
+    if (!t) {
+        t = new MWheelTimer(this, slot);
+        t->setInterval(interval);
+        t->setSingleShot(single_shot);
+    }
+    return t;
+}
+
+int MCompositeWindow::memoryUsage() const
+{
+    int n = sizeof(MTexturePixmapItem) + sizeof(MTexturePixmapPrivate);
+    if (anim)
+        n += sizeof(MCompWindowAnimator);
+    if (t_ping)
+        n += sizeof(MWheelTimer);
+    if (t_reappear)
+        n += sizeof(MWheelTimer);
+    if (damage_timer)
+        n += sizeof(MWheelTimer);
+    if (sync_timer)
+        n += sizeof(MWheelTimer);
+    if (pc)
+        n += pc->memoryUsage();
+    return n;
+}
+
 void MCompositeWindow::pingWindow()
 {
     if (window_status == Hung)
@@ -643,7 +799,7 @@ void MCompositeWindow::setDecorated(bool decorated)
 MCompositeWindow *MCompositeWindow::compositeWindow(Qt::HANDLE window)
 {
     MCompositeManager *p = (MCompositeManager *) qApp;
-    return p->d->windows.value(window, 0);
+    return p->d->registry.compositeWindow(window);
 }
 
 void MCompositeWindow::beginAnimation()
@@ -674,10 +830,21 @@ QVariant MCompositeWindow::itemChange(GraphicsItemChange change, const QVariant
 {
     MCompositeManager *p = (MCompositeManager *) qApp;
     if (change == ItemZValueHasChanged) {
+        if (MCompositeScene *sc = qobject_cast<MCompositeScene *>(scene()))
+            sc->renderListChanged(this);
         findBehindWindow();
         p->d->setWindowDebugProperties(window());
     }
 
+    if (change == ItemSceneChange) {
+        if (MCompositeScene *sc = qobject_cast<MCompositeScene *>(scene()))
+            sc->removeFromRenderList(this);
+    } else if (change == ItemSceneHasChanged) {
+        if (MCompositeScene *sc = qobject_cast<MCompositeScene *>(
+                                          value.value<QGraphicsScene *>()))
+            sc->addToRenderList(this);
+    }
+
     if (change == ItemVisibleHasChanged) {
         // Be careful not to update if this item whose visibility is about
         // to change is behind a visible item, to not reopen NB#189519.
@@ -685,12 +852,11 @@ QVariant MCompositeWindow::itemChange(GraphicsItemChange change, const QVariant
         // (other visible items get redrawn also).  Case requiring this:
         // status menu closed on top of an mdecorated window.
         bool ok_to_update = true;
-        if (scene()) {
-            QList<QGraphicsItem*> l = scene()->items();
-            for (QList<QGraphicsItem*>::const_iterator i = l.begin();
-                 i != l.end(); ++i)
-                if ((*i)->isVisible()) {
-                    ok_to_update = zValue() >= (*i)->zValue();
+        if (MCompositeScene *sc = qobject_cast<MCompositeScene *>(scene())) {
+            const QVector<QGraphicsItem *> &l = sc->renderList();
+            for (int i = l.size() - 1; i >= 0; --i)
+                if (l[i]->isVisible()) {
+                    ok_to_update = zValue() >= l[i]->zValue();
                     break;
                 }
         }
@@ -752,11 +918,11 @@ bool MCompositeWindow::isAppWindow(bool include_transients)
 QPainterPath MCompositeWindow::shape() const
 {    
     QPainterPath path;
-    const QRegion &shape = propertyCache()->shapeRegion();
-    if (QRegion(boundingRect().toRect()).subtracted(shape).isEmpty())
+    MWindowPropertyCache *pc = propertyCache();
+    if (!pc->isShaped() || pc->shapeCovers(boundingRect().toRect()))
         path.addRect(boundingRect());
     else
-        path.addRegion(shape);
+        path.addRegion(pc->shapeRegion());
     return path;
 }
 
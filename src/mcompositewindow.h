@@ -27,8 +27,10 @@
 #include "mwindowpropertycache.h"
 
 class MCompWindowAnimator;
+struct MWindowTransition;
 class MTexturePixmapPrivate;
 class MCompositeWindowGroup;
+class MWheelTimer;
 
 /*!
  * This is the base class for composited window items. It provided general
@@ -107,6 +109,13 @@ public:
      */
     void setWindowObscured(bool obscured, bool no_notify = false);
 
+    /*!
+     * Like setWindowObscured() but takes one of the X visibility states
+     * (VisibilityUnobscured, VisibilityPartiallyObscured or
+     * VisibilityFullyObscured), so partial coverage can be reported too.
+     */
+    void setWindowVisibility(int state, bool no_notify = false);
+
     /*!
      * Returns whether this item is iconified or not
      */
@@ -174,6 +183,14 @@ public:
      */
     bool waitingForDamage() const { return waiting_for_damage > 0; }
 
+    /*!
+     * Sends a _NET_WM_SYNC_REQUEST to the client if it supports it, so
+     * syncReceived() is called when it has drawn the frame for the next
+     * ConfigureNotify.  Returns whether the request was sent.
+     */
+    bool requestSync();
+    bool waitingForSync() const { return waiting_for_sync; }
+
     /*!
      * Returns how this window was iconified.
      */
@@ -246,6 +263,12 @@ public:
      */
     virtual void saveBackingStore() = 0;
 
+    /*!
+     * Frees the offscreen pixmap and the texture image made of it until
+     * the next saveBackingStore(), while the window isn't shown anyway.
+     */
+    virtual void releaseBackingStore() = 0;
+
     /*!
       Clears the texture that is associated with the offscreen pixmap
      */
@@ -287,6 +310,12 @@ public:
     bool isClosing() const { return window_status == Closing; }
 
     MWindowPropertyCache *propertyCache() const { return pc; }
+
+    /*!
+     * Returns the approximate number of bytes allocated for this window,
+     * including its renderer, animator, timers and property cache.
+     */
+    int memoryUsage() const;
     
     /*!
      * Convenience function returns last visible parent of this window
@@ -313,6 +342,12 @@ public:
     void setDimmedEffect(bool dimmed) { dimmed_effect = dimmed; }
     
     bool dimmedEffect() const { return dimmed_effect; }
+
+    /*!
+     * The transition the shaders are animating this window with, if any.
+     */
+    void setTransition(const MWindowTransition *t) { gpu_transition = t; }
+    const MWindowTransition *transition() const { return gpu_transition; }
     
 public slots:
 
@@ -346,6 +381,12 @@ public slots:
      */
     void damageReceived(bool timeout);
 
+    /*!
+     * Called when the client has drawn the frame requested by requestSync()
+     * or it failed to do so in time.
+     */
+    void syncReceived();
+
     /*!
      * Called to start a reappearance timer for the application hung dialog.
      */
@@ -361,6 +402,7 @@ private slots:
     void pingTimeout();
     void reappearTimeout();
     void damageTimeout();
+    void syncTimeout();
     void pingWindow();
     void q_itemRestored();
     void q_fadeIn();
@@ -393,6 +435,8 @@ private:
       between shader effects */
     virtual MTexturePixmapPrivate* renderer() const = 0;
     void findBehindWindow();
+    MWheelTimer *timer(MWheelTimer *&t, int interval, bool single_shot,
+                       const char *slot);
 
     QPointer<MWindowPropertyCache> pc;
     QPointer<MCompositeWindow> behind_window;
@@ -412,12 +456,21 @@ private:
     WindowStatus window_status;
     bool need_decor;
     bool window_visible;
-    short window_obscured;
+    short window_obscured; // last VisibilityNotify state sent, -1 if none
     bool is_valid;
     bool newly_mapped;
     bool is_transitioning;
     bool dimmed_effect;
     char waiting_for_damage;
+    const MWindowTransition *gpu_transition;
+
+    // _NET_WM_SYNC_REQUEST state: the alarm is created at the first request
+    // and @sync_value is the last value we asked @sync_counter to reach
+    XID sync_alarm, sync_counter;
+    quint64 sync_value;
+    bool waiting_for_sync;
+    // the fade-in waits for the sync rather than for damage
+    bool sync_for_map;
 
     static int window_transitioning;
 
@@ -425,9 +478,11 @@ private:
     QRectF iconGeometry;
     QPointF origPosition;
 
-    // Main ping timer
-    QTimer *t_ping, *t_reappear;
-    QTimer *damage_timer;
+    // Main ping timer, these are created when first needed and run
+    // on the shared MTimerWheel
+    MWheelTimer *t_ping, *t_reappear;
+    MWheelTimer *damage_timer;
+    MWheelTimer *sync_timer;
     Qt::HANDLE win_id;
 
     friend class MTexturePixmapPrivate;
@@ -221,6 +221,8 @@ void MCompositeWindowGroup::q_removeWindow()
 
 void MCompositeWindowGroup::saveBackingStore() {}
 
+void MCompositeWindowGroup::releaseBackingStore() {}
+
 void MCompositeWindowGroup::resize(int , int) {}
 
 void MCompositeWindowGroup::clearTexture() {}
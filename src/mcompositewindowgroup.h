@@ -43,6 +43,7 @@ class MCompositeWindowGroup: public MCompositeWindow
     virtual void updateWindowPixmap(XRectangle *rects = 0, int num = 0, 
                                     Time = 0);
     virtual void saveBackingStore();
+    virtual void releaseBackingStore();
     virtual void resize(int , int);
     virtual void clearTexture();
     virtual bool isDirectRendered() const;
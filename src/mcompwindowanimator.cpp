@@ -21,31 +21,138 @@
 #include "mcompositewindow.h"
 #include "mcompositemanager.h"
 #include "mcompositemanager_p.h"
+#include "manimationdriver.h"
 
-static int Fps = 60;
+static MAnimationDriver *driver()
+{
+    return &((MCompositeManager *)qApp)->d->animation_driver;
+}
 
 static qreal interpolate(qreal step, qreal x1, qreal x2)
 {
     return ((x2 - x1) * step) + x1;
 }
 
+#define OPAQUE 1.0
+#define DIMMED 0.1
+
 MCompWindowAnimator::MCompWindowAnimator(MCompositeWindow *comp_win)
     : QObject(comp_win),
-      timer(200),
+      timeline(200),
       reversed(false),
-      deferred_animation(false)
+      deferred_animation(false),
+      gpu_active(false)
 {
     item = comp_win;
-    timer.setFrameRange(0, 2000);
-    timer.setUpdateInterval(int(1000.0 / Fps));
 
     // So that we have complete control of the transformation
     // we don't call setitem
     // anim.setItem(item);
-    //anim.setTimeLine(&timer);
-    connect(&timer, SIGNAL(valueChanged(qreal)), SLOT(advanceFrame(qreal)));
-    connect(&timer, SIGNAL(finished()), SIGNAL(transitionDone()));
-    connect(&timer, SIGNAL(finished()), SLOT(resetState()));
+}
+
+MCompWindowAnimator::~MCompWindowAnimator()
+{
+    MCompositeManager *p = (MCompositeManager *) qApp;
+    if (p && p->d)
+        driver()->stop(this);
+    // @item is being destroyed, but the window behind it may still use
+    // our transition
+    if (gpu_behind && gpu_behind->transition() == &behind_transition)
+        gpu_behind->setTransition(0);
+}
+
+void MCompWindowAnimator::start()
+{
+    if (!isActive()) {
+        emit transitionStart();
+        if (((MCompositeManager *)qApp)->d->gpu_transitions)
+            startGpuTransition();
+        driver()->start(this);
+    }
+}
+
+void MCompWindowAnimator::finish()
+{
+    if (gpu_active) {
+        stopGpuTransition();
+        setFrame(1.0);
+    }
+    emit transitionDone();
+    resetState();
+}
+
+// What setFrame() sets the transformation of the item to at @step.
+QTransform MCompWindowAnimator::transformAt(qreal step) const
+{
+    QPointF pos = anim.posAt(step);
+    return QTransform::fromScale(anim.horizontalScaleAt(step),
+                                 anim.verticalScaleAt(step))
+        * matrix * QTransform::fromTranslate(pos.x(), pos.y());
+}
+
+// Opacity of the item or the window behind it at @step.
+qreal MCompWindowAnimator::opacityAt(qreal step, bool behind) const
+{
+    return reversed != behind ? interpolate(step, DIMMED, OPAQUE)
+                              : interpolate(step, OPAQUE, DIMMED);
+}
+
+// Sets up the first frame and describes the rest of the transition to the
+// vertex shader, so advanceFrame() doesn't need to touch the items (and
+// invalidate the scene) until the last frame.  Both the transformation
+// and the opacity change linearly with the step, so the shader can blend
+// the first and the last frame.
+void MCompWindowAnimator::startGpuTransition()
+{
+    bool invertible;
+    QTransform from = transformAt(0).inverted(&invertible);
+    if (!invertible)
+        // leave it to the CPU
+        return;
+
+    setFrame(0);
+    item_transition.to = transformAt(1) * from;
+    item_transition.opacity_to = opacityAt(1, false) / opacityAt(0, false);
+    item_transition.step = 0;
+    item->setTransition(&item_transition);
+
+    gpu_behind = item->behind();
+    if (gpu_behind) {
+        behind_transition.to = QTransform();
+        behind_transition.opacity_to = opacityAt(1, true)
+                                       / opacityAt(0, true);
+        behind_transition.step = 0;
+        gpu_behind->setTransition(&behind_transition);
+    }
+    gpu_active = true;
+}
+
+void MCompWindowAnimator::stopGpuTransition()
+{
+    if (!gpu_active)
+        return;
+    if (item->transition() == &item_transition)
+        item->setTransition(0);
+    if (gpu_behind && gpu_behind->transition() == &behind_transition)
+        gpu_behind->setTransition(0);
+    gpu_behind = 0;
+    gpu_active = false;
+}
+
+// Windows unknown to the occlusion tracker (like the unmapped ones being
+// animated away) are considered visible.
+static bool obscured(MCompositeWindow *cw)
+{
+    const MOcclusionTracker &occlusion =
+                                ((MCompositeManager *)qApp)->d->occlusion;
+    return occlusion.contains(cw->window())
+        && occlusion.state(cw->window()) == MOcclusionTracker::FullyObscured;
+}
+
+bool MCompWindowAnimator::isObscured() const
+{
+    MCompositeWindow *behind = item->behind();
+    return obscured(item) && (!behind || obscured(behind));
 }
 
 // restore original global state w/ animation
@@ -62,20 +169,23 @@ void MCompWindowAnimator::restore()
     anim.setScaleAt(0, item->transform().m11(), item->transform().m22());
     anim.setScaleAt(1.0, 1.0, 1.0);
 
-    if (timer.state() == QTimeLine::NotRunning) {
-        emit transitionStart();
-        timer.start();
-    }
+    start();
 
     // item->setPos(initpos);
 }
 
-// item transition
 void MCompWindowAnimator::advanceFrame(qreal step)
 {
-#define OPAQUE 1.0
-#define DIMMED 0.1
+    if (gpu_active)
+        // the shaders do the rest
+        item_transition.step = behind_transition.step = step;
+    else
+        setFrame(step);
+}
 
+// item transition
+void MCompWindowAnimator::setFrame(qreal step)
+{
     //item->setTransform(QTransform(anim.matrixAt(step)) );
     item->setTransform(matrix);
 
@@ -83,21 +193,14 @@ void MCompWindowAnimator::advanceFrame(qreal step)
                 anim.verticalScaleAt(step));
     item->setPos(anim.posAt(step));
 
-    qreal opac_norm = interpolate(step, OPAQUE, DIMMED);
-    qreal opac_rev = interpolate(step, DIMMED, OPAQUE);
-    
-    // TODO: move calculation to GPU to imrpove speed
     // TODO: Use QPropertyAnimation instead
     item->setDimmedEffect(false);
-    item->setOpacity(!reversed ? opac_norm : opac_rev);
+    item->setOpacity(opacityAt(step, false));
     MCompositeWindow* behind = item->behind();
     if (behind) {
         behind->setDimmedEffect(true);
-        behind->setOpacity(!reversed ? opac_rev : opac_norm);
+        behind->setOpacity(opacityAt(step, true));
     }
-    
-    MCompositeManager *p = (MCompositeManager *) qApp;
-    p->d->glwidget->update();
 }
 
 void MCompWindowAnimator::resetState()
@@ -122,14 +225,14 @@ void MCompWindowAnimator::translateScale(qreal fromSx, qreal fromSy,
     reversed = reverse;
 
     if (!reverse) {
-        timer.setCurveShape(QTimeLine::EaseInCurve);
+        timeline.setCurveShape(QTimeLine::EaseInCurve);
         
         anim.setScaleAt(0, fromSx, fromSy);
         anim.setScaleAt(1.0, toSx, toSy);
         anim.setPosAt(0, item->pos());
         anim.setPosAt(1.0, newPos);
     } else {
-        timer.setCurveShape(QTimeLine::EaseOutCurve);
+        timeline.setCurveShape(QTimeLine::EaseOutCurve);
         
         if (item->transform().m22() == 1.0 && item->transform().m11() == 1.0)
             item->scale(toSx, toSy);
@@ -141,10 +244,7 @@ void MCompWindowAnimator::translateScale(qreal fromSx, qreal fromSy,
     }
 
     if (!deferred_animation)
-        if (timer.state() == QTimeLine::NotRunning) {
-            emit transitionStart();
-            timer.start();
-        }
+        start();
 }
 
 // call this after item is scaled to desired size
@@ -193,22 +293,19 @@ void MCompWindowAnimator::restoreState(int states)
 
 bool MCompWindowAnimator::isActive()
 {
-    return !(timer.state() == QTimeLine::NotRunning);
+    return driver()->isRunning(this);
 }
 
 void MCompWindowAnimator::startAnimation()
 {
-    if (deferred_animation) {
-        if (timer.state() == QTimeLine::NotRunning) {
-            emit transitionStart();
-            timer.start();
-        }
-    }
+    if (deferred_animation)
+        start();
 }
 
 void MCompWindowAnimator::stopAnimation()
 {
-    timer.stop();
+    driver()->stop(this);
+    stopGpuTransition();
     item->setTransform(matrix);
 }
 
@@ -24,10 +24,26 @@
 #include <QTimeLine>
 #include <QGraphicsItemAnimation>
 #include <QTransform>
+#include <QPointer>
+#include "mobjectpool.h"
 
 class QGraphicsItem;
 class MCompositeWindow;
 
+/*!
+ * A window transition evaluated by the vertex shader.  The window is
+ * drawn with its current transformation blended into \a to by \a step,
+ * and its opacity scaled from 1 to \a opacity_to the same way.
+ */
+struct MWindowTransition
+{
+    //! the last frame relative to the current transformation
+    QTransform to;
+    qreal opacity_to;
+    //! eased progress of the transition, 0..1
+    qreal step;
+};
+
 /*!
  * This class is responsible for complete control of the animation of
  * MCompositeWindow items. It provides a way to save and restore
@@ -50,6 +66,12 @@ public:
     };
 
     MCompWindowAnimator(MCompositeWindow *item);
+    ~MCompWindowAnimator();
+    // allocated from a pool, see MObjectPool
+    static void *operator new(size_t size)
+        { return MObjectPool<MCompWindowAnimator>::allocate(size); }
+    static void operator delete(void *p, size_t size)
+        { MObjectPool<MCompWindowAnimator>::release(p, size); }
 
     //! Restores original item with animation. (TODO: deprecate this!(
     void restore();
@@ -79,16 +101,30 @@ public:
     //! There is a pending animation to be executed soon
     bool pendingAnimation() const;
 
-public slots:
+    // interface for MAnimationDriver
+    int duration() const { return timeline.duration(); }
+    qreal valueForTime(int msecs) const
+        { return timeline.valueForTime(msecs); }
+    //! Neither the item nor the window behind it can be seen
+    bool isObscured() const;
+    //! Called by the driver after the last frame
+    void finish();
+
     /*!
-     * Direct interface to timeline. MTexturePixmapItem doesn't support
-     * standard QGraphicsItem scale and rotation. So we call this for each
-     * item's frame for complete control of the transitions
+     * MTexturePixmapItem doesn't support standard QGraphicsItem scale
+     * and rotation. So the driver calls this for each item's frame for
+     * complete control of the transitions
      */
     void advanceFrame(qreal step);
 
-private slots:
+private:
     void resetState();
+    void start();
+    void setFrame(qreal step);
+    QTransform transformAt(qreal step) const;
+    qreal opacityAt(qreal step, bool behind) const;
+    void startGpuTransition();
+    void stopGpuTransition();
 
 signals:
     void transitionDone();
@@ -102,13 +138,21 @@ private:
     bool visibility;
     MCompositeWindow *item;
     QGraphicsItemAnimation anim;
-    QTimeLine timer;
+    // only describes the duration and the curve of the animation,
+    // it is run by MAnimationDriver
+    QTimeLine timeline;
     int zval;
     QPointF initpos;
 
     // reverse animation
     bool reversed;
     bool deferred_animation;
+
+    // transitions of the item and the window behind it if the shaders
+    // are animating them (-gpu-transitions)
+    bool gpu_active;
+    MWindowTransition item_transition, behind_transition;
+    QPointer<MCompositeWindow> gpu_behind;
 };
 
 #endif
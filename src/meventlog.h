@@ -0,0 +1,168 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MEVENTLOG_H
+#define MEVENTLOG_H
+
+#include <QtGlobal>
+#include <stdio.h>
+
+/*
+ * Binary format of the X event log written by MEventRecorder and read by
+ * tests/eventreplay.  The file starts with a MEventLogHeader followed by
+ * records: a MEventLogRecord and @length bytes of payload, whose layout
+ * depends on the record's @type.  Everything is in host byte order.
+ *
+ * Atoms are stored by name and windows by their XID in the recording
+ * session, so the log can be replayed against another X server.
+ */
+
+#define MEVENTLOG_MAGIC   "MCEL"
+#define MEVENTLOG_VERSION 1
+
+struct MEventLogHeader
+{
+    char magic[4];
+    quint32 version;
+    quint16 screen_width, screen_height;
+    quint32 root;           // the root window of the recording session
+};
+
+struct MEventLogRecord
+{
+    // Core X event types are recorded as they are.  Extension events
+    // and what the composite manager does by itself get these numbers.
+    enum {
+        Damage = 128,       // MEventLogRect
+        ShapeNotify,        // no payload
+        Frame,              // MEventLogFrame, @handler_usecs is painting
+        DeviceState,        // MEventLogDeviceState, @window is 0
+        Clock,              // MEventLogClock, @window is 0
+    };
+
+    quint32 usecs;          // since the previous record
+    quint16 type;
+    quint16 length;         // of the payload
+    quint32 window;
+    quint32 handler_usecs;  // time spent handling the event
+
+    // name of a @type for the tools; unknown types are numbered in a
+    // static buffer
+    static const char *typeName(int type)
+    {
+        static const char *core[] = {
+            NULL, NULL, "KeyPress", "KeyRelease", "ButtonPress",
+            "ButtonRelease", "MotionNotify", "EnterNotify", "LeaveNotify",
+            "FocusIn", "FocusOut", "KeymapNotify", "Expose",
+            "GraphicsExpose", "NoExpose", "VisibilityNotify",
+            "CreateNotify", "DestroyNotify", "UnmapNotify", "MapNotify",
+            "MapRequest", "ReparentNotify", "ConfigureNotify",
+            "ConfigureRequest", "GravityNotify", "ResizeRequest",
+            "CirculateNotify", "CirculateRequest", "PropertyNotify",
+            "SelectionClear", "SelectionRequest", "SelectionNotify",
+            "ColormapNotify", "ClientMessage", "MappingNotify",
+            "GenericEvent",
+        };
+        static char buf[16];
+
+        if (type >= 0 && type < (int)(sizeof(core) / sizeof(core[0]))
+            && core[type])
+            return core[type];
+        switch (type) {
+        case Damage:      return "Damage";
+        case ShapeNotify: return "ShapeNotify";
+        case Frame:       return "Frame";
+        case DeviceState: return "DeviceState";
+        case Clock:       return "Clock";
+        }
+        snprintf(buf, sizeof(buf), "%d", type);
+        return buf;
+    }
+};
+
+// CreateNotify, ConfigureRequest, ConfigureNotify
+struct MEventLogConfigure
+{
+    qint16 x, y;
+    quint16 width, height;
+    quint32 parent;         // CreateNotify
+    quint32 above;          // ConfigureRequest/Notify
+    quint16 value_mask;     // ConfigureRequest
+    quint8 detail;          // ConfigureRequest
+    quint8 override_redirect;
+};
+
+// MapNotify, UnmapNotify, ReparentNotify
+struct MEventLogMap
+{
+    quint32 parent;         // ReparentNotify
+    quint8 override_redirect;
+    quint8 pad[3];
+};
+
+// Damage
+struct MEventLogRect
+{
+    qint16 x, y;
+    quint16 width, height;
+};
+
+// PropertyNotify, followed by the name of the property, the name of
+// its type and the value.  ATOM values are stored as a list of
+// \0-terminated names with @format 8.
+struct MEventLogProperty
+{
+    quint8 deleted;
+    quint8 format;
+    quint16 name_length, type_length;
+    quint16 pad;
+    quint32 value_length;   // in bytes
+};
+
+// ClientMessage, followed by the name of the message type and the names
+// of the atoms in @data whose bit is set in @atoms, each \0-terminated.
+struct MEventLogClientMessage
+{
+    quint8 format;
+    quint8 atoms;
+    quint16 name_length;
+    quint32 data[5];
+};
+
+struct MEventLogFrame
+{
+    quint16 items;          // painted
+    quint16 pad;
+};
+
+struct MEventLogDeviceState
+{
+    quint8 display_off;
+    quint8 call_ongoing;
+    quint16 pad;
+};
+
+// The first record, to match the log with the MTrace ring buffer and
+// other CLOCK_MONOTONIC timestamps.  Logs of older builds don't have it.
+struct MEventLogClock
+{
+    quint64 usecs;          // CLOCK_MONOTONIC when the record was written
+};
+
+#endif
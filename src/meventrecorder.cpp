@@ -0,0 +1,289 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "meventrecorder.h"
+#include "meventlog.h"
+#include "mlatencyhistogram.h"
+#include "mcompatoms_p.h"
+#include <QX11Info>
+#include <X11/Xatom.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/shape.h>
+#include <string.h>
+
+// properties longer than this are cut
+#define MAX_PROPERTY_LONGS 1024
+
+template<class T> static void append(QByteArray &payload, const T &s)
+{
+    payload.append((const char *)&s, sizeof(s));
+}
+
+MEventRecorder *MEventRecorder::open(const char *fname, int damage_event)
+{
+    FILE *out;
+    if (!(out = fopen(fname, "w"))) {
+        qWarning("%s: couldn't open %s", __func__, fname);
+        return 0;
+    }
+
+    Display *dpy = QX11Info::display();
+    MEventLogHeader h;
+    memcpy(h.magic, MEVENTLOG_MAGIC, sizeof(h.magic));
+    h.version = MEVENTLOG_VERSION;
+    h.screen_width = DisplayWidth(dpy, DefaultScreen(dpy));
+    h.screen_height = DisplayHeight(dpy, DefaultScreen(dpy));
+    h.root = QX11Info::appRootWindow();
+    fwrite(&h, sizeof(h), 1, out);
+    return new MEventRecorder(out, damage_event);
+}
+
+MEventRecorder::MEventRecorder(FILE *out, int damage_event)
+    : out(out),
+      damage_event(damage_event),
+      shape_event(0),
+      last(MLatencyHistogram::now())
+{
+    int i;
+    if (!XShapeQueryExtension(QX11Info::display(), &shape_event, &i))
+        shape_event = -1;
+
+    QByteArray payload;
+    MEventLogClock c = { last };
+    append(payload, c);
+    record(MEventLogRecord::Clock, 0, 0, payload);
+}
+
+MEventRecorder::~MEventRecorder()
+{
+    fclose(out);
+}
+
+void MEventRecorder::record(int type, Window w,
+                            unsigned long long handler_usecs,
+                            const QByteArray &payload)
+{
+    unsigned long long now = MLatencyHistogram::now();
+    MEventLogRecord r;
+
+    r.usecs = qMin(now - last, 0xffffffffULL);
+    r.type = type;
+    r.length = payload.size();
+    r.window = w;
+    r.handler_usecs = qMin(handler_usecs, 0xffffffffULL);
+    last = now;
+
+    fwrite(&r, sizeof(r), 1, out);
+    fwrite(payload.constData(), payload.size(), 1, out);
+}
+
+const QByteArray &MEventRecorder::atomName(Atom a)
+{
+    QHash<Atom, QByteArray>::iterator it = atom_names.find(a);
+    if (it == atom_names.end()) {
+        char *name = a ? XGetAtomName(QX11Info::display(), a) : 0;
+        it = atom_names.insert(a, name ? name : "");
+        if (name)
+            XFree(name);
+    }
+    return *it;
+}
+
+void MEventRecorder::property(const XPropertyEvent *e, QByteArray &payload)
+{
+    MEventLogProperty p;
+    QByteArray name = atomName(e->atom), type, value;
+
+    memset(&p, 0, sizeof(p));
+    p.deleted = e->state == PropertyDelete;
+    if (!p.deleted) {
+        Atom actual;
+        int format;
+        unsigned long n, left;
+        unsigned char *data = 0;
+
+        // the window may be gone already, which counts as deletion
+        if (XGetWindowProperty(QX11Info::display(), e->window, e->atom, 0,
+                               MAX_PROPERTY_LONGS, False, AnyPropertyType,
+                               &actual, &format, &n, &left, &data) != Success
+            || actual == None) {
+            p.deleted = true;
+        } else if (actual == XA_ATOM && format == 32) {
+            type = atomName(actual);
+            p.format = 8;
+            for (unsigned long i = 0; i < n; ++i) {
+                value += atomName(((Atom *)data)[i]);
+                value += '\0';
+            }
+        } else {
+            // Xlib gives the 32-bit items in longs and 16-bit ones in shorts
+            type = atomName(actual);
+            p.format = format;
+            for (unsigned long i = 0; i < n; ++i)
+                if (format == 32)
+                    append(value, (quint32)((long *)data)[i]);
+                else if (format == 16)
+                    append(value, (quint16)((short *)data)[i]);
+                else
+                    value += (char)data[i];
+        }
+        if (data)
+            XFree(data);
+    }
+
+    p.name_length = name.size();
+    p.type_length = type.size();
+    p.value_length = value.size();
+    append(payload, p);
+    payload += name;
+    payload += type;
+    payload += value;
+}
+
+void MEventRecorder::clientMessage(const XClientMessageEvent *e,
+                                   QByteArray &payload)
+{
+    MEventLogClientMessage m;
+    QByteArray name = atomName(e->message_type), atoms;
+
+    memset(&m, 0, sizeof(m));
+    m.format = e->format;
+    // the data words which are atoms in the messages we care about
+    if (e->format == 32) {
+        if (e->message_type == ATOM(_NET_WM_STATE))
+            m.atoms = (1 << 1) | (1 << 2);
+        else if (e->message_type == ATOM(WM_PROTOCOLS))
+            m.atoms = 1 << 0;
+    }
+    for (int i = 0; i < 5; ++i) {
+        m.data[i] = e->data.l[i];
+        if (m.atoms & (1 << i)) {
+            atoms += atomName(e->data.l[i]);
+            atoms += '\0';
+        }
+    }
+    m.name_length = name.size();
+    append(payload, m);
+    payload += name;
+    payload += atoms;
+}
+
+void MEventRecorder::event(const XEvent *e, unsigned long long handler_usecs)
+{
+    QByteArray payload;
+    Window w = e->xany.window;
+    int type = e->type;
+    MEventLogConfigure c;
+    MEventLogMap m;
+
+    memset(&c, 0, sizeof(c));
+    memset(&m, 0, sizeof(m));
+    if (type == damage_event + XDamageNotify) {
+        const XDamageNotifyEvent *de = (const XDamageNotifyEvent *)e;
+        MEventLogRect r = { de->area.x, de->area.y,
+                            de->area.width, de->area.height };
+        type = MEventLogRecord::Damage;
+        w = de->drawable;
+        append(payload, r);
+    } else if (type == shape_event + ShapeNotify) {
+        type = MEventLogRecord::ShapeNotify;
+        w = ((const XShapeEvent *)e)->window;
+    } else switch (type) {
+    case CreateNotify:
+        w = e->xcreatewindow.window;
+        c.x = e->xcreatewindow.x;
+        c.y = e->xcreatewindow.y;
+        c.width = e->xcreatewindow.width;
+        c.height = e->xcreatewindow.height;
+        c.parent = e->xcreatewindow.parent;
+        c.override_redirect = e->xcreatewindow.override_redirect;
+        append(payload, c);
+        break;
+    case ConfigureRequest:
+        w = e->xconfigurerequest.window;
+        c.x = e->xconfigurerequest.x;
+        c.y = e->xconfigurerequest.y;
+        c.width = e->xconfigurerequest.width;
+        c.height = e->xconfigurerequest.height;
+        c.above = e->xconfigurerequest.above;
+        c.value_mask = e->xconfigurerequest.value_mask;
+        c.detail = e->xconfigurerequest.detail;
+        append(payload, c);
+        break;
+    case ConfigureNotify:
+        w = e->xconfigure.window;
+        c.x = e->xconfigure.x;
+        c.y = e->xconfigure.y;
+        c.width = e->xconfigure.width;
+        c.height = e->xconfigure.height;
+        c.above = e->xconfigure.above;
+        c.override_redirect = e->xconfigure.override_redirect;
+        append(payload, c);
+        break;
+    case MapRequest:
+        w = e->xmaprequest.window;
+        break;
+    case MapNotify:
+        w = e->xmap.window;
+        m.override_redirect = e->xmap.override_redirect;
+        append(payload, m);
+        break;
+    case UnmapNotify:
+        w = e->xunmap.window;
+        append(payload, m);
+        break;
+    case ReparentNotify:
+        w = e->xreparent.window;
+        m.parent = e->xreparent.parent;
+        m.override_redirect = e->xreparent.override_redirect;
+        append(payload, m);
+        break;
+    case DestroyNotify:
+        w = e->xdestroywindow.window;
+        break;
+    case PropertyNotify:
+        property(&e->xproperty, payload);
+        break;
+    case ClientMessage:
+        clientMessage(&e->xclient, payload);
+        break;
+    default:
+        // other extensions' events would collide with our own types
+        if (type >= LASTEvent)
+            return;
+        break;
+    }
+    record(type, w, handler_usecs, payload);
+}
+
+void MEventRecorder::frame(unsigned long long paint_usecs, int items)
+{
+    QByteArray payload;
+    MEventLogFrame f = { (quint16)items, 0 };
+    append(payload, f);
+    record(MEventLogRecord::Frame, 0, paint_usecs, payload);
+}
+
+void MEventRecorder::deviceState(bool display_off, bool call_ongoing)
+{
+    QByteArray payload;
+    MEventLogDeviceState s = { display_off, call_ongoing, 0 };
+    append(payload, s);
+    record(MEventLogRecord::DeviceState, 0, 0, payload);
+}
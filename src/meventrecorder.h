@@ -0,0 +1,62 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MEVENTRECORDER_H
+#define MEVENTRECORDER_H
+
+#include <QHash>
+#include <QByteArray>
+#include <X11/Xlib.h>
+#include <stdio.h>
+
+/*!
+ * Writes the X events the composite manager handles, the time spent on
+ * them, the painted frames and the device state changes into a binary
+ * log (see meventlog.h), which tests/eventreplay can play back against
+ * another X server.  The values of the changed properties are read and
+ * logged as well, which costs a round trip for each PropertyNotify.
+ *
+ * Enabled with the -record=<file> command line option.
+ */
+class MEventRecorder
+{
+public:
+    //! Starts a new log in \a fname.  Returns 0 if it cannot be created.
+    static MEventRecorder *open(const char *fname, int damage_event);
+    ~MEventRecorder();
+
+    void event(const XEvent *e, unsigned long long handler_usecs);
+    void frame(unsigned long long paint_usecs, int items);
+    void deviceState(bool display_off, bool call_ongoing);
+
+private:
+    MEventRecorder(FILE *out, int damage_event);
+    void record(int type, Window w, unsigned long long handler_usecs,
+                const QByteArray &payload);
+    const QByteArray &atomName(Atom a);
+    void property(const XPropertyEvent *e, QByteArray &payload);
+    void clientMessage(const XClientMessageEvent *e, QByteArray &payload);
+
+    FILE *out;
+    int damage_event, shape_event;
+    unsigned long long last;
+    QHash<Atom, QByteArray> atom_names;
+};
+
+#endif
@@ -0,0 +1,120 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MLATENCYHISTOGRAM_H
+#define MLATENCYHISTOGRAM_H
+
+#include <QtGlobal>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*!
+ * Histogram of latencies in microseconds with power-of-two buckets:
+ * bucket 0 counts the samples below 1 us, bucket i those in
+ * [2^(i-1), 2^i) us and the last bucket everything above.
+ */
+class MLatencyHistogram
+{
+public:
+    enum { BUCKETS = 22 };
+
+    MLatencyHistogram() { reset(); }
+
+    void reset()
+    {
+        memset(buckets, 0, sizeof(buckets));
+        samples = 0;
+        total = max = 0;
+    }
+
+    void add(unsigned long long usecs)
+    {
+        int i = 0;
+        while (i < BUCKETS - 1 && (1ULL << i) <= usecs)
+            ++i;
+        buckets[i]++;
+        samples++;
+        total += usecs;
+        if (usecs > max)
+            max = usecs;
+    }
+
+    unsigned count() const { return samples; }
+
+    //! CLOCK_MONOTONIC in microseconds, for measuring the samples
+    static unsigned long long now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    }
+
+    //! qDebug()s the histogram, one line per non-empty bucket
+    void dump(const char *name) const
+    {
+        if (!samples) {
+            qDebug("%s: no samples", name);
+            return;
+        }
+        qDebug("%s: %u samples, avg %llu us, max %llu us", name, samples,
+               total / samples, max);
+        for (int i = 0; i < BUCKETS; ++i)
+            if (buckets[i]) {
+                if (i < BUCKETS - 1)
+                    qDebug("  < %8llu us: %u", 1ULL << i, buckets[i]);
+                else
+                    qDebug("  >=%8llu us: %u", 1ULL << (i - 1), buckets[i]);
+            }
+    }
+
+    /*!
+     * Prints the histogram in one line for scripts:
+     * "<name> <samples> <total us> <max us> <bucket 0> ... <bucket 21>"
+     */
+    void print(FILE *out, const char *name) const
+    {
+        fprintf(out, "%s %u %llu %llu", name, samples, total, max);
+        for (int i = 0; i < BUCKETS; ++i)
+            fprintf(out, " %u", buckets[i]);
+        fputc('\n', out);
+    }
+
+private:
+    unsigned buckets[BUCKETS];
+    unsigned samples;
+    unsigned long long total, max;
+};
+
+/*!
+ * Adds the time from its construction to its destruction to a histogram.
+ */
+class MLatencyTimer
+{
+public:
+    explicit MLatencyTimer(MLatencyHistogram &h)
+        : histogram(h), start(MLatencyHistogram::now()) {}
+    ~MLatencyTimer() { histogram.add(MLatencyHistogram::now() - start); }
+
+private:
+    MLatencyHistogram &histogram;
+    unsigned long long start;
+};
+
+#endif
@@ -0,0 +1,106 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MOBJECTPOOL_H
+#define MOBJECTPOOL_H
+
+#include <new>
+#include <stddef.h>
+
+/*!
+ * Allocator for the objects we create for every window.  Memory is taken
+ * from the heap in slabs of SlabSize objects and never given back, freed
+ * objects are reused in LIFO order.  This way opening and closing windows
+ * for days does not fragment the heap and the memory use only depends on
+ * the peak number of windows.
+ *
+ * Use it by overriding the class-specific operator new and delete:
+ *
+ *  static void *operator new(size_t size)
+ *      { return MObjectPool<Class>::allocate(size); }
+ *  static void operator delete(void *p, size_t size)
+ *      { MObjectPool<Class>::release(p, size); }
+ *
+ * Objects of subclasses of different size are passed to the global heap.
+ * Not thread-safe.
+ */
+template<class T> class MObjectPool
+{
+public:
+    static void *allocate(size_t size)
+    {
+        if (size != sizeof(T))
+            return ::operator new(size);
+        if (!free_list)
+            grow();
+        Slot *s = free_list;
+        free_list = s->next;
+        ++in_use;
+        return s;
+    }
+
+    static void release(void *p, size_t size)
+    {
+        if (!p)
+            return;
+        if (size != sizeof(T)) {
+            ::operator delete(p);
+            return;
+        }
+        Slot *s = (Slot*)p;
+        s->next = free_list;
+        free_list = s;
+        --in_use;
+    }
+
+    // number of objects allocated from the pool
+    static int inUse() { return in_use; }
+    // number of objects the pool has memory for
+    static int capacity() { return slots; }
+
+private:
+    union Slot {
+        Slot *next;
+        // for alignment
+        double d;
+        long long ll;
+        char data[sizeof(T)];
+    };
+    enum { SlabSize = 16 };
+
+    static void grow()
+    {
+        Slot *slab = (Slot*)::operator new(SlabSize * sizeof(Slot));
+        for (int i = SlabSize - 1; i >= 0; --i) {
+            slab[i].next = free_list;
+            free_list = &slab[i];
+        }
+        slots += SlabSize;
+    }
+
+    static Slot *free_list;
+    static int in_use, slots;
+};
+
+template<class T>
+typename MObjectPool<T>::Slot *MObjectPool<T>::free_list = 0;
+template<class T> int MObjectPool<T>::in_use = 0;
+template<class T> int MObjectPool<T>::slots = 0;
+
+#endif
@@ -0,0 +1,97 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "mocclusiontracker.h"
+
+#include <QX11Info>
+
+MOcclusionTracker::MOcclusionTracker()
+    : screen_r(0, 0,
+               DisplayWidth(QX11Info::display(),
+                            DefaultScreen(QX11Info::display())),
+               DisplayHeight(QX11Info::display(),
+                             DefaultScreen(QX11Info::display()))),
+      screen_region(screen_r)
+{
+}
+
+void MOcclusionTracker::invalidate()
+{
+    nodes.clear();
+    index.clear();
+}
+
+void MOcclusionTracker::update(const QVector<Layer> &stack)
+{
+    // find the topmost layer that differs from the previous round;
+    // everything above it keeps its visible region
+    int first = 0;
+    int common = qMin(stack.size(), nodes.size());
+    while (first < common) {
+        const Layer &o = nodes.at(first).layer;
+        const Layer &n = stack.at(first);
+        if (o.window != n.window || o.opaque != n.opaque || o.shape != n.shape)
+            break;
+        ++first;
+    }
+    if (first == stack.size() && first == nodes.size())
+        return;
+
+    nodes.resize(stack.size());
+    for (int i = first; i < stack.size(); ++i) {
+        Node &n = nodes[i];
+        n.layer = stack.at(i);
+        if (i == 0)
+            n.above = QRegion();
+        else {
+            const Node &prev = nodes.at(i - 1);
+            n.above = prev.layer.opaque ? prev.above + prev.layer.shape
+                                        : prev.above;
+        }
+
+        QRegion onscreen = n.layer.shape & screen_r;
+        n.visible = onscreen - n.above;
+        if (onscreen.isEmpty())
+            // nothing to paint, but tell the client about the screen anyway
+            n.state = (screen_region - n.above).isEmpty() ?
+                      FullyObscured : Unobscured;
+        else if (n.visible.isEmpty())
+            n.state = FullyObscured;
+        else if (n.visible == onscreen)
+            n.state = Unobscured;
+        else
+            n.state = PartiallyObscured;
+    }
+
+    index.clear();
+    for (int i = 0; i < nodes.size(); ++i)
+        index.insert(nodes.at(i).layer.window, i);
+}
+
+MOcclusionTracker::State MOcclusionTracker::state(Window w) const
+{
+    int i = index.value(w, -1);
+    return i < 0 ? FullyObscured : nodes.at(i).state;
+}
+
+QRegion MOcclusionTracker::visibleRegion(Window w) const
+{
+    int i = index.value(w, -1);
+    return i < 0 ? QRegion() : nodes.at(i).visible;
+}
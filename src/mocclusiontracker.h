@@ -0,0 +1,88 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MOCCLUSIONTRACKER_H
+#define MOCCLUSIONTRACKER_H
+
+#include <QVector>
+#include <QHash>
+#include <QRegion>
+#include <X11/Xlib.h>
+
+/*!
+ * Keeps track of the visible region of each mapped window.  The tracker is
+ * fed the stack top-down and recalculates only the part of it below the
+ * topmost window whose position in the stack, shape or opaqueness changed,
+ * so restacking a window near the top does not walk the whole stack again.
+ */
+class MOcclusionTracker
+{
+public:
+    // values match the X VisibilityNotify states
+    enum State {
+        Unobscured = VisibilityUnobscured,
+        PartiallyObscured = VisibilityPartiallyObscured,
+        FullyObscured = VisibilityFullyObscured
+    };
+
+    struct Layer {
+        Window window;
+        // what the window paints, in root coordinates
+        QRegion shape;
+        // whether the window hides everything below its shape
+        bool opaque;
+    };
+
+    MOcclusionTracker();
+
+    /*!
+     * Updates the visible regions for \a stack, which lists the mapped
+     * windows from the topmost one down.
+     */
+    void update(const QVector<Layer> &stack);
+
+    /*!
+     * Drops everything, so the next update() recalculates the whole stack.
+     */
+    void invalidate();
+
+    //! Whether \a w was in the stack of the last update().
+    bool contains(Window w) const { return index.contains(w); }
+    State state(Window w) const;
+    QRegion visibleRegion(Window w) const;
+    const QRect &screen() const { return screen_r; }
+    // the same region each time, so layers using it compare cheaply
+    const QRegion &screenRegion() const { return screen_region; }
+
+private:
+    struct Node {
+        Layer layer;
+        // region covered by the opaque windows above this one
+        QRegion above;
+        QRegion visible;
+        State state;
+    };
+
+    QRect screen_r;
+    QRegion screen_region;
+    QVector<Node> nodes;
+    QHash<Window, int> index;
+};
+
+#endif
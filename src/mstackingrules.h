@@ -0,0 +1,376 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MSTACKINGRULES_H
+#define MSTACKINGRULES_H
+
+#include <QList>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+/*!
+ * Window classes the stacking rules care about.
+ */
+struct MStacking
+{
+    enum WindowType {
+        OtherType = 0,
+        DialogType,
+        InputType,
+        NotificationType,
+        DesktopType
+    };
+};
+
+/*!
+ * The rough stacking order rules used by MCompositeManagerPrivate::roughSort()
+ * as a qStableSort() comparator.  The rules only see windows through
+ * \a Model, so they can be run against a fake window model as well
+ * (see tests/stackingbench).  The model has to provide:
+ *
+ *  typedef ... Item;                       // pointer-like, 0 if unknown
+ *  Item item(Window w) const;
+ *  bool isDecorator(Item) const;
+ *  Item decoratorClient() const;           // 0 if the decorator is unused
+ *  int windowState(Item) const;            // NormalState, IconicState...
+ *  MStacking::WindowType windowType(Item) const;
+ *  int stackingLayer(Item) const;
+ *  bool isOverrideRedirect(Item) const;
+ *  bool isKeepAbove(Item) const;
+ *  bool isModal(Item) const;
+ *  bool hasVisibleParent(Item) const;
+ *  Window transientFor(Item) const;
+ *
+ * The desired rough order is:
+ *
+ * unused decorator (lowest), iconified/withdrawn windows possibly with
+ * decorator on top, desktop, normal state windows with transients/decorator
+ * on top, system-modal dialogs, input-type windows, notifications,
+ * windows with stacking layers (highest).
+ */
+template<class Model>
+class MStackingRules: public MStacking
+{
+public:
+    typedef typename Model::Item Item;
+
+    MStackingRules(const Model &model) : m(model) {}
+
+    // Returns true if @w_a should definitely be below @w_b, otherwise false.
+    // This tells the sorting function that the sorting of @w_a is either
+    // greater than or equal to @w_b's.  In other words, @w_a needn't be
+    // below @w_a, but it could be, unless compareWindows(@w_b, @w_a) tells
+    // explicitly otherwise (ie. that @w_a needs to be higher than @w_b).
+    //
+    // TODO: before this can replace checkStacking(), we need to handle at
+    // least the decorator, possibly also window groups and dock windows.
+    bool operator()(Window w_a, Window w_b) const
+    {
+        int layer;
+        WindowType type_a, type_b;
+
+        // qSort() should know better, but if it doesn't, tell it that
+        // no item is less than itself.
+        if (w_a == w_b)
+            return false;
+
+        // If we don't know about either of the windows let them in peace
+        // -- don't reason about what we don't know.
+        Item a = m.item(w_a);
+        Item b = m.item(w_b);
+        if (!a || !b)
+            return false;
+
+        // Mind decorators.  Lone decorators should go below everything else,
+        // otherwise it's sorted above its managed window.
+        if (m.isDecorator(a)) {
+            bool cmp;
+            if (!(a = compareDecorator(&cmp, b)))
+                // @a is a lone decorator or @b happens to be
+                // its managed window.
+                return  cmp;
+        } else if (m.isDecorator(b)) {
+            bool cmp;
+            if (!(b = compareDecorator(&cmp, a)))
+                // Likewise.
+                return !cmp;
+        }
+
+        // Iconic/withdrawn/unmanaged windows...
+        if (m.windowState(a) != NormalState) {
+            // ...go below NormalState windows, otherwise we don't care.
+            return m.windowState(b) == NormalState;
+        } else if (m.windowState(b) != NormalState) {
+            // @a is NormalState, @b is not.
+            return false;
+        }
+
+        // Both @a and @b are in NormalState.
+        // Sort the desktop below all NormalState:s.
+        // (Quiz: why do we check @b before @a?
+        //  Answer: to be consistent even if both windows are desktops.)
+        type_b = m.windowType(b);
+        if (type_b == DesktopType)
+            return false;
+        type_a = m.windowType(a);
+        if (type_a == DesktopType)
+            return true;
+
+        // Compare by stacking layers.
+        layer = m.stackingLayer(a);
+        int rel = layer - m.stackingLayer(b);
+        if (rel != 0)
+            // @a is below if it has a lower stacking layer
+            return rel < 0;
+        // They're in the same layer.
+
+        // Order notifications, input windows and system-modal dialogs.
+        // We can skip it altogether if the windows' layer is too high,
+        // because for them isSpecial() will always be false.
+        if (layer < 6) {
+            type_a = isSpecial(a, layer, type_a);
+            type_b = isSpecial(b, layer, type_b);
+            // type_a, type_b == Other || Dialog || Input || Notification,
+            // which are enumerated in their stacking order.
+            if (type_a != type_b)
+                return type_a < type_b;
+        }
+
+        // Order transient windows below what they are transient for.
+        // Since the sorting algorithm can infer that if trfor(@a) == @b
+        // and trfor(@b) == @c then @a is transient for @c it is not
+        // necessary for us to check if @a is a grandparent of @b
+        // or vica versa.  However, we *do* have to mind circular
+        // transiency between @a and @b otherwise we would return
+        // true for both compareWindows(@a, @b) and compareWindows(@b, @a),
+        // which would make the sorting undeterministic.
+        if (m.transientFor(b) == w_a && m.transientFor(a) != w_b)
+          // @b is transient for @a, so it must be above it.
+          return true;
+
+        // Either @a is transient for @b or they are transient
+        // for each other, or they are not in direct relationship,
+        // or they are not in any relationship at all.
+        return false;
+    }
+
+private:
+    // Determine whether a decorator should be ordered above or below @win.
+    // If the answer is definite it is stored in *@cmpp and 0 is returned.
+    // Otherwise the decorator should be ordered exatly like the returned
+    // item, the decorator's managed window.
+    //
+    // Unused decorators should be below anything else.
+    // The decorated window should be below the decorator.
+    // Otherwise we don't know.
+    Item compareDecorator(bool *cmpp, Item win) const
+    {
+        Item man = m.decoratorClient();
+        if (!man)
+            // the decorator is unused
+            *cmpp = true;
+        else if (man == win)
+            // @win is the decorator's managed window, keep them together
+            *cmpp = false;
+        else
+            // Order the decorator like its managed window.
+            return man;
+        return 0;
+    }
+
+    // Returns whether @item in @layer of @type is special with regards to
+    // stacking.  Returns OtherType for non-special cases, or Notification,
+    // Input or Dialog.  The returned type doesn't mean that @item has that
+    // window type; it merely indicates that it should be stacked like that.
+    WindowType isSpecial(Item item, int layer, WindowType type) const
+    {
+        if (layer < 6 && type == NotificationType)
+            /* @item is maybe a notification */;
+        else if (layer < 5 &&
+                 (type == InputType || m.isOverrideRedirect(item) ||
+                  m.isKeepAbove(item)))
+            // @item is maybe input or keep-above window
+            type = InputType;
+        else if (layer < 4 && type == DialogType && m.isModal(item))
+            /* @item is maybe a system-modal dialog */;
+        else
+            // Nothing special.
+            return OtherType;
+
+        // @item deserves special handling only if it doesn't have
+        // a visible parent.
+        return m.hasVisibleParent(item) ? OtherType : type;
+    }
+
+    const Model &m;
+};
+
+/*!
+ * The fine placement MCompositeManagerPrivate::checkStacking() does after
+ * the rough order: raising windows together with their transients and
+ * putting the decorator right above its managed window.  Like the rules
+ * it's shared with tests/stackingbench, which checks the result.  The
+ * model has to provide:
+ *
+ *  // NULL if @w is unknown
+ *  const QList<Window> *transientWindows(Window w) const;
+ */
+template<class Model>
+class MStackingPlacement
+{
+public:
+    MStackingPlacement(const Model &model, QList<Window> &stack)
+        : m(model), stacking_list(stack) {}
+
+    // Raise @w together with its transiency tree to the top of the stack.
+    // @parent_idx is expected to be the index of @w in the stack.
+    bool raiseWithTransients(Window w, int parent_idx,
+                             QList<int> *anewpos = NULL)
+    {
+        int nprev;
+        QList<int> *newpos;
+
+        const QList<Window> *transients = m.transientWindows(w);
+        if (!transients)
+            return true;
+
+        // @newpos is a list of @stacking_list indices which should be
+        // topped.  If it contains [ @i1, @i2, ..., @in ] then
+        // [ @stacking_list[@i1], @stacking_list[@i2], ...,
+        // @stacking_list[@in] ] will be the tail of the list when we have
+        // finished.
+        //
+        // @nprev is the number of elements already in @newpos.  It is
+        // used for error recovery, when we encounter a transiency cycle.
+        QList<int> ownpos;
+        if (!anewpos) {
+            // Non-recursive call.
+            newpos = &ownpos;
+            nprev = 0;
+        } else {
+            // Recursive call.
+            newpos = anewpos;
+            nprev = newpos->size();
+        }
+
+        // @stacking_list[@parent_idx] -> top of the stack
+        Q_ASSERT(parent_idx == stacking_list.indexOf(w));
+        newpos->push_front(parent_idx);
+
+        // @isok denotes whether the caller should stop iterating, because
+        // the callee found a better root of window hierarchy.  This can
+        // only happen if we were asked to raise a transiency cycle, but
+        // checkStacking() didn't gave us the lowest-stacked element of
+        // the cycle, for example if [@w1, @w2] is the stack and we had
+        // been asked to raise @w2.  Then we would restack needlessly,
+        // which we seek to avoid.
+        bool isok = true;
+        for (QList<Window>::const_iterator it = transients->begin();
+             it != transients->end(); ++it) {
+            int idx = stacking_list.indexOf(*it);
+            if (idx < 0)
+                continue;
+            if (newpos->contains(idx)) {
+                // Transiency loop.  Having seen @idx means we are
+                // transient for it, but if we are stacked lower we make
+                // for a better root of the hierarchy.
+                if (parent_idx < idx) {
+                    // Undo all positionings not done by us.
+                    isok = false;
+                    for (; nprev > 0; nprev--)
+                        newpos->pop_back();
+                } else
+                    // We already have a new position for @idx.
+                    continue;
+            }
+
+            if (!raiseWithTransients(*it, idx, newpos)) {
+                // Callee found a new root, stop what we're doing.
+                isok = false;
+                break;
+            }
+        }
+
+        // If it was a recursive call we're finished.
+        if (anewpos)
+            return isok;
+
+        // Change @stacking_list according to @newpos.  The new position
+        // of @stacking_list[@newpos[0]] is length(@stacking_list)-1,
+        // @stacking_list[@newpos[1]] goes to length(@stacking_list)-2,
+        // and so on.
+        Q_ASSERT(newpos->size() > 0);
+        QList<int>::iterator it = newpos->begin();
+        for (int new_idx = stacking_list.size() - 1; ; new_idx--) {
+            bool moved = false;
+            int old_idx = *it;
+            if (old_idx != new_idx) {
+                Q_ASSERT(new_idx >= 0);
+                stacking_list.move(old_idx, new_idx);
+                moved = true;
+            }
+
+            if (++it == newpos->end())
+                break;
+            if (!moved)
+                // No need to update @newpos indices.
+                continue;
+
+            // Since we have moved @stacking_list[@old_idx] all windows
+            // above drop down by one index.  Update @newpos according to
+            // this.
+            for (QList<int>::iterator ot = it; ot != newpos->end(); ++ot)
+                if (*ot > old_idx)
+                    (*ot)--;
+        }
+        return true;
+    }
+
+    // Moves the decorator at @deco_i right above its managed window at
+    // @client_i.
+    void placeDecorator(int deco_i, int client_i)
+    {
+        if (deco_i < 0 || client_i < 0)
+            return;
+        if (deco_i < client_i)
+            // the client drops by one when the decorator is taken out
+            move(deco_i, client_i);
+        else
+            move(deco_i, client_i + 1);
+    }
+
+    // Moves the unused decorator at @deco_i to the bottom.
+    void lowerDecorator(int deco_i)
+    {
+        move(deco_i, 0);
+    }
+
+private:
+    void move(int from, int to)
+    {
+        if (from != to && from >= 0 && from < stacking_list.size()
+            && to >= 0 && to < stacking_list.size())
+            stacking_list.move(from, to);
+    }
+
+    const Model &m;
+    QList<Window> &stacking_list;
+};
+
+#endif
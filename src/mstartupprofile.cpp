@@ -0,0 +1,254 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "mstartupprofile.h"
+#include "mwindowpropertycache.h"
+#include "mlatencyhistogram.h"
+#include <xcb/xcb.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#define PROFILE_MAGIC   "MCSP"
+#define PROFILE_VERSION 1
+#define PROFILE_RECORDS 64
+
+// the first frame is complete when the damage stops for this long (ms)
+#define QUIET_MSECS     150
+// give up measuring after this long (ms)
+#define MAX_MSECS       3000
+// what we do for the applications we don't know
+#define DEFAULT_DAMAGES 2
+#define DEFAULT_TIMEOUT 500
+
+#define PROFILE_SIZE    (sizeof(Header) + sizeof(Record) * PROFILE_RECORDS)
+
+struct MStartupProfile::Header {
+    char magic[4];
+    quint32 version;
+    quint32 records;
+    // incremented for each update, to find the least recently used record
+    quint32 clock;
+};
+
+struct MStartupProfile::Record {
+    char key[48];
+    quint32 samples;
+    quint32 used;
+    // moving averages
+    float damages;
+    float msecs;
+};
+
+int MStartupProfile::wm_class_prop = -1;
+
+MStartupProfile::MStartupProfile()
+    : header(0), records(0), fallback(0)
+{
+    // "instance\0class\0"
+    wm_class_prop = MWindowPropertyCache::registerProperty(XCB_ATOM_WM_CLASS,
+                                                           XCB_ATOM_STRING,
+                                                           32);
+    quiet_timer.setInterval(QUIET_MSECS / 3);
+    connect(&quiet_timer, SIGNAL(timeout()), SLOT(checkQuiet()));
+
+    fallback = new char[PROFILE_SIZE];
+    memset(fallback, 0, PROFILE_SIZE);
+    header = (Header *)fallback;
+    records = (Record *)(header + 1);
+}
+
+MStartupProfile::~MStartupProfile()
+{
+    if ((char *)header != fallback)
+        munmap(header, PROFILE_SIZE);
+    delete[] fallback;
+}
+
+bool MStartupProfile::open(const char *fname)
+{
+    const size_t size = PROFILE_SIZE;
+    int fd;
+    struct stat st;
+    void *p;
+
+    if ((fd = ::open(fname, O_RDWR | O_CREAT, 0644)) < 0) {
+        qWarning("%s: %s: %s", __func__, fname, strerror(errno));
+        return false;
+    }
+    if (fstat(fd, &st) < 0 || ((size_t)st.st_size != size
+                               && ftruncate(fd, size) < 0)) {
+        qWarning("%s: %s: %s", __func__, fname, strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        qWarning("%s: %s: %s", __func__, fname, strerror(errno));
+        return false;
+    }
+
+    Header *h = (Header *)p;
+    if (memcmp(h->magic, PROFILE_MAGIC, sizeof(h->magic))
+        || h->version != PROFILE_VERSION || h->records != PROFILE_RECORDS) {
+        // new or incompatible, start over
+        memset(p, 0, size);
+        memcpy(h->magic, PROFILE_MAGIC, sizeof(h->magic));
+        h->version = PROFILE_VERSION;
+        h->records = PROFILE_RECORDS;
+    }
+    if ((char *)header != fallback)
+        munmap(header, size);
+    header = h;
+    records = (Record *)(h + 1);
+    return true;
+}
+
+QByteArray MStartupProfile::key(MWindowPropertyCache *pc)
+{
+    const QByteArray &wm_class = pc->propertyData(wm_class_prop);
+    int i = wm_class.indexOf('\0');
+    if (i >= 0 && i + 1 < wm_class.size())
+        return QByteArray(wm_class.constData() + i + 1);
+
+    int pid = pc->pid();
+    if (pid > 0) {
+        char path[32], exe[256];
+        int len;
+        snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+        if ((len = readlink(path, exe, sizeof(exe) - 1)) > 0) {
+            exe[len] = '\0';
+            const char *base = strrchr(exe, '/');
+            return QByteArray(base ? base + 1 : exe);
+        }
+    }
+    return QByteArray();
+}
+
+MStartupProfile::Record *MStartupProfile::find(const QByteArray &key) const
+{
+    if (key.isEmpty())
+        return 0;
+    for (int i = 0; i < PROFILE_RECORDS; ++i)
+        if (records[i].samples
+            && !strncmp(records[i].key, key.constData(),
+                        sizeof(records[i].key) - 1))
+            return &records[i];
+    return 0;
+}
+
+// Replaces the least recently used record.
+MStartupProfile::Record *MStartupProfile::add(const QByteArray &key)
+{
+    Record *r = &records[0];
+    for (int i = 1; i < PROFILE_RECORDS && r->samples; ++i)
+        if (!records[i].samples || records[i].used < r->used)
+            r = &records[i];
+    memset(r, 0, sizeof(*r));
+    strncpy(r->key, key.constData(), sizeof(r->key) - 1);
+    return r;
+}
+
+MStartupProfile::Prediction MStartupProfile::predict(const QByteArray &key)
+                                                                        const
+{
+    Prediction p;
+    const Record *r = find(key);
+    if (!r || r->samples < 2) {
+        p.damages = DEFAULT_DAMAGES;
+        p.timeout = DEFAULT_TIMEOUT;
+    } else {
+        // leave some slack for the slower starts
+        p.damages = qBound(1, int(r->damages + 0.5), 10);
+        p.timeout = qBound(50, int(r->msecs * 1.5) + 50, DEFAULT_TIMEOUT);
+    }
+    return p;
+}
+
+void MStartupProfile::observe(Window w, const QByteArray &key)
+{
+    if (key.isEmpty())
+        return;
+    Observation o;
+    o.key = key;
+    o.start = o.last = MLatencyHistogram::now();
+    o.damages = 0;
+    observed.insert(w, o);
+    if (!quiet_timer.isActive())
+        quiet_timer.start();
+}
+
+void MStartupProfile::damaged(Window w)
+{
+    QHash<Window, Observation>::iterator it = observed.find(w);
+    if (it != observed.end()) {
+        it->last = MLatencyHistogram::now();
+        it->damages++;
+    }
+}
+
+void MStartupProfile::checkQuiet()
+{
+    unsigned long long now = MLatencyHistogram::now();
+    QHash<Window, Observation>::iterator it = observed.begin();
+    while (it != observed.end()) {
+        const Observation &o = *it;
+        if (o.damages && now - o.last >= QUIET_MSECS * 1000ULL) {
+            learn(o);
+            it = observed.erase(it);
+        } else if (now - o.start >= MAX_MSECS * 1000ULL)
+            // never drew or never stopped drawing, nothing to learn
+            it = observed.erase(it);
+        else
+            ++it;
+    }
+    if (observed.isEmpty())
+        quiet_timer.stop();
+}
+
+void MStartupProfile::learn(const Observation &o)
+{
+    Record *r = find(o.key);
+    if (!r)
+        r = add(o.key);
+
+    // average the first samples, then adapt slowly
+    float msecs = (o.last - o.start) / 1000.0;
+    float w = 1.0 / qMin(r->samples + 1, 8u);
+    r->damages += (o.damages - r->damages) * w;
+    r->msecs += (msecs - r->msecs) * w;
+    r->samples++;
+    r->used = ++header->clock;
+}
+
+void MStartupProfile::dump() const
+{
+    qDebug("startup profile (damages, ms, samples):");
+    for (int i = 0; i < PROFILE_RECORDS; ++i)
+        if (records[i].samples)
+            qDebug("  %-32s %5.1f %6.0f %u", records[i].key,
+                   records[i].damages, records[i].msecs, records[i].samples);
+    if (!observed.isEmpty())
+        qDebug("  %d window(s) being measured", observed.size());
+}
@@ -0,0 +1,99 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MSTARTUPPROFILE_H
+#define MSTARTUPPROFILE_H
+
+#include <QObject>
+#include <QHash>
+#include <QTimer>
+#include <QByteArray>
+#include <X11/Xlib.h>
+
+class MWindowPropertyCache;
+
+/*!
+ * Learns for each application (by WM_CLASS or the executable of
+ * _NET_WM_PID) how many damage events and how much time it takes from
+ * showing a window to its first complete frame, so that the startup
+ * animation of clients without _NET_WM_SYNC_REQUEST can start as early
+ * as the application allows.  A frame is considered complete when the
+ * damage stops for a while.  The figures are kept in a small file which
+ * is mapped into memory, so they survive restarts.
+ */
+class MStartupProfile: public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Prediction {
+        // damage events to wait for before starting the animation
+        int damages;
+        // but no longer than this, in milliseconds
+        int timeout;
+    };
+
+    MStartupProfile();
+    ~MStartupProfile();
+
+    /*!
+     * Maps the profile \a fname, creating it if necessary.  Nothing is
+     * remembered across restarts if this fails.
+     */
+    bool open(const char *fname);
+
+    //! Returns what \a pc is profiled by, or an empty string.
+    QByteArray key(MWindowPropertyCache *pc);
+    Prediction predict(const QByteArray &key) const;
+
+    //! Starts measuring the startup of \a w, which is shown just now.
+    void observe(Window w, const QByteArray &key);
+    void damage(Window w) { if (!observed.isEmpty()) damaged(w); }
+    void forget(Window w) { observed.remove(w); }
+
+    //! qDebug()s what has been learnt
+    void dump() const;
+
+private slots:
+    void checkQuiet();
+
+private:
+    struct Header;
+    struct Record;
+    struct Observation {
+        QByteArray key;
+        unsigned long long start, last;
+        int damages;
+    };
+
+    void damaged(Window w);
+    void learn(const Observation &o);
+    Record *find(const QByteArray &key) const;
+    Record *add(const QByteArray &key);
+
+    QHash<Window, Observation> observed;
+    QTimer quiet_timer;
+    Header *header;
+    Record *records;
+    // header and records in memory if the file couldn't be mapped
+    char *fallback;
+    static int wm_class_prop;
+};
+
+#endif
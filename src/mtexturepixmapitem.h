@@ -52,6 +52,12 @@ public:
      */
     MTexturePixmapItem(Window window, MWindowPropertyCache *mpc,
                        QGraphicsItem *parent = 0);
+
+    // allocated from a pool, see MObjectPool
+    static void *operator new(size_t size)
+        { return MObjectPool<MTexturePixmapItem>::allocate(size); }
+    static void operator delete(void *p, size_t size)
+        { MObjectPool<MTexturePixmapItem>::release(p, size); }
     /*!
      * Destroys the MTexturePixmapItem and frees the allocated
      * surface and texture
@@ -71,6 +77,12 @@ public:
      */
     void saveBackingStore();
 
+    /*!
+     * Frees the offscreen pixmap and the texture image made of it until
+     * the next saveBackingStore().
+     */
+    void releaseBackingStore();
+
     /*!
       Clears the texture that is associated with the offscreen pixmap
      */
@@ -158,6 +158,16 @@ void MTexturePixmapItem::saveBackingStore()
     d->saveBackingStore();
 }
 
+void MTexturePixmapItem::releaseBackingStore()
+{
+    // the custom texture_from_pixmap keeps using the pixmap
+    if (!d->windowp || d->direct_fb_render || d->custom_tfp)
+        return;
+    XFreePixmap(QX11Info::display(), d->windowp);
+    d->windowp = 0;
+    rebindPixmap(); // destroys the EGLImage
+}
+
 void MTexturePixmapItem::rebindPixmap()
 {
     if (!d->custom_tfp && d->egl_image != EGL_NO_IMAGE_KHR) {
@@ -349,17 +359,18 @@ void MTexturePixmapItem::paint(QPainter *painter,
 
 void MTexturePixmapItem::renderTexture(const QTransform& transform)
 {    
-    if (propertyCache()->hasAlpha() || (opacity() < 1.0f && !dimmedEffect()) ) {
+    if (propertyCache()->hasAlpha()
+        || ((opacity() < 1.0f || transition()) && !dimmedEffect())) {
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     }
     glBindTexture(GL_TEXTURE_2D, d->textureId);
 
-    const QRegion &shape = propertyCache()->shapeRegion();
     // FIXME: not optimal. probably would be better to replace with 
     // eglSwapBuffersRegionNOK()
 
-    bool shape_on = !QRegion(boundingRect().toRect()).subtracted(shape).isEmpty();
+    bool shape_on = propertyCache()->isShaped()
+                    && !propertyCache()->shapeCovers(boundingRect().toRect());
     bool scissor_on = d->damageRegion.numRects() > 1 || shape_on;
     
     if (scissor_on)
@@ -378,6 +389,7 @@ void MTexturePixmapItem::renderTexture(const QTransform& transform)
         }
     } else if (shape_on) {
         // draw a shaped window using glScissor
+        const QRegion shape = propertyCache()->shapeRegion();
         for (int i = 0; i < shape.numRects(); ++i) {
             glScissor(shape.rects().at(i).x(),
                       d->brect.height() -
@@ -183,6 +183,12 @@ void MTexturePixmapItem::saveBackingStore()
     d->saveBackingStore();
 }
 
+void MTexturePixmapItem::releaseBackingStore()
+{
+    // rebindPixmap() can't recreate the GLX pixmap from scratch,
+    // so keep it; this backend is for the desktop anyway
+}
+
 void MTexturePixmapItem::rebindPixmap()
 {
     const int pixmapAttribs[] = {
@@ -334,7 +340,8 @@ void MTexturePixmapItem::paint(QPainter *painter,
 #endif
 
     glEnable(GL_TEXTURE_2D);
-    if (propertyCache()->hasAlpha() || (opacity() < 1.0f && !dimmedEffect()) ) {
+    if (propertyCache()->hasAlpha()
+        || ((opacity() < 1.0f || transition()) && !dimmedEffect())) {
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         glColor4f(1.0, 1.0, 1.0, opacity());
@@ -342,8 +349,8 @@ void MTexturePixmapItem::paint(QPainter *painter,
 
     glBindTexture(GL_TEXTURE_2D, d->custom_tfp ? d->ctextureId : d->textureId);
 
-    const QRegion &shape = propertyCache()->shapeRegion();
-    bool shape_on = !QRegion(boundingRect().toRect()).subtracted(shape).isEmpty();
+    bool shape_on = propertyCache()->isShaped()
+                    && !propertyCache()->shapeCovers(boundingRect().toRect());
     bool scissor_on = d->damageRegion.numRects() > 1 || shape_on;
     
     if (scissor_on)
@@ -362,6 +369,7 @@ void MTexturePixmapItem::paint(QPainter *painter,
         }
     } else if (shape_on) {
         // draw a shaped window using glScissor
+        const QRegion shape = propertyCache()->shapeRegion();
         for (int i = 0; i < shape.numRects(); ++i) {
             glScissor(shape.rects().at(i).x(),
                       d->brect.height() -
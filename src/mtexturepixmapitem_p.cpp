@@ -24,6 +24,7 @@
 #include "texturepixmapshaders.h"
 #include "mcompositewindowshadereffect.h"
 #include "mcompositemanager.h"
+#include "mcompwindowanimator.h"
 
 #include <QX11Info>
 #include <QRect>
@@ -66,6 +67,8 @@ public:
         texture = -1;
         opacity = -1;
         blurstep = -1;
+        animStep = -1;
+        animOpacity = -1;
     }
     void setWorldMatrix(GLfloat m[4][4]) {
         static bool init = true;
@@ -96,10 +99,25 @@ public:
         }
     }
 
+    // @end is only used while a transition is in progress
+    void setTransition(GLfloat end[4][4], GLfloat step, GLfloat opacity_to) {
+        if (step != animStep) {
+            setUniformValue("animStep", step);
+            animStep = step;
+        }
+        if (opacity_to != animOpacity) {
+            setUniformValue("animOpacity", opacity_to);
+            animOpacity = opacity_to;
+        }
+        if (step != 0)
+            setUniformValue("matWorldEnd", end);
+    }
+
 private:
     // static because this is set in the shared vertex shader
     static GLfloat worldMatrix[4][4];
     GLfloat opacity, blurstep;
+    GLfloat animStep, animOpacity;
     GLuint texture;
 };
 
@@ -204,6 +222,25 @@ public:
         worldMatrix[3][3] = t.m33();
     }
 
+    // Sets up the transition of the item being drawn with @t, or resets
+    // it if @tr is NULL.
+    void updateTransition(const QTransform &t, const MWindowTransition *tr)
+    {
+        if (!tr) {
+            currentShader->setTransition(0, 0, 1);
+            return;
+        }
+
+        QTransform e = tr->to * t;
+        GLfloat end[4][4] = {
+            { e.m11(), e.m12(), 0, e.m13() },
+            { e.m21(), e.m22(), 0, e.m23() },
+            { 0,       0,       1, 0       },
+            { e.dx(),  e.dy(),  0, e.m33() }
+        };
+        currentShader->setTransition(end, tr->step, tr->opacity_to);
+    }
+
     void updateVertices(const QTransform &t, ShaderType type) 
     {        
         if (shader[type] != currentShader)
@@ -344,6 +381,7 @@ void MTexturePixmapPrivate::q_drawTexture(const QTransform &transform,
         current_effect->setUniforms(glresource->currentShader);
     else if (item->blurred())
         glresource->currentShader->setBlurStep((GLfloat) 0.5);
+    glresource->updateTransition(transform, item->transition());
     glresource->currentShader->setOpacity((GLfloat) opacity);
     glresource->currentShader->setTexture(0);
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
@@ -25,6 +25,7 @@
 #include <QRegion>
 #include <QPointer>
 #include <X11/Xlib.h>
+#include "mobjectpool.h"
 
 #ifdef GLES2_VERSION
 #include <EGL/egl.h>
@@ -54,6 +55,11 @@ class MTexturePixmapPrivate: QObject
 public:
     MTexturePixmapPrivate(Window window, MTexturePixmapItem *item);
     ~MTexturePixmapPrivate();
+    // allocated from a pool, see MObjectPool
+    static void *operator new(size_t size)
+        { return MObjectPool<MTexturePixmapPrivate>::allocate(size); }
+    static void operator delete(void *p, size_t size)
+        { MObjectPool<MTexturePixmapPrivate>::release(p, size); }
     void init();
     void updateWindowPixmap(XRectangle *rects = 0, int num = 0);
     void saveBackingStore();
@@ -0,0 +1,204 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "mtimerwheel.h"
+#include "mlatencyhistogram.h"
+#include <QMetaObject>
+#include <QMetaMethod>
+
+MTimerWheel *MTimerWheel::d = 0;
+
+MWheelTimer::MWheelTimer(QObject *receiver, const char *slot)
+    : prev(0), next(0), expires(0), interval(0), single_shot(false),
+      receiver(receiver)
+{
+    // skip the code of the SLOT() macro
+    method = receiver->metaObject()->indexOfMethod(
+                            QMetaObject::normalizedSignature(slot + 1));
+    if (method < 0)
+        qWarning("%s: no such slot: %s", __func__, slot + 1);
+}
+
+void MWheelTimer::start()
+{
+    MTimerWheel *w = MTimerWheel::instance();
+    if (isActive())
+        w->remove(this);
+    w->add(this);
+}
+
+void MWheelTimer::stop()
+{
+    if (isActive())
+        MTimerWheel::instance()->remove(this);
+}
+
+MTimerWheel *MTimerWheel::instance()
+{
+    if (!d)
+        d = new MTimerWheel();
+    return d;
+}
+
+MTimerWheel::MTimerWheel()
+    : tick(0), wakeup(0), armed(0)
+{
+    for (int l = 0; l < LEVELS; ++l)
+        for (int s = 0; s < SLOTS; ++s)
+            wheel[l][s] = new MWheelTimer();
+    epoch = MLatencyHistogram::now();
+    os_timer.setSingleShot(true);
+    connect(&os_timer, SIGNAL(timeout()), SLOT(advance()));
+}
+
+quint32 MTimerWheel::currentTick() const
+{
+    return (MLatencyHistogram::now() - epoch) / (TICK_MSECS * 1000);
+}
+
+void MTimerWheel::insert(MWheelTimer *t)
+{
+    quint32 delta = t->expires - tick;
+    MWheelTimer *h;
+    if (delta < SLOTS)
+        h = wheel[0][t->expires % SLOTS];
+    else if (delta < SLOTS * SLOTS)
+        h = wheel[1][(t->expires / SLOTS) % SLOTS];
+    else
+        // further than we can see, look again in the last round
+        h = wheel[1][(tick / SLOTS + SLOTS - 1) % SLOTS];
+    t->next = h;
+    t->prev = h->prev;
+    h->prev->next = t;
+    h->prev = t;
+}
+
+void MTimerWheel::add(MWheelTimer *t)
+{
+    if (!armed)
+        // nothing happened while we were idle
+        tick = currentTick();
+    // the tick nearest to the expiry, but not one we have done already
+    t->expires = (MLatencyHistogram::now() - epoch
+                  + qMax(t->interval, 0) * 1000ULL + TICK_MSECS * 500)
+                 / (TICK_MSECS * 1000);
+    if ((qint32)(t->expires - tick) <= 0)
+        t->expires = tick + 1;
+    insert(t);
+    armed++;
+    if (!os_timer.isActive() || (qint32)(t->expires - wakeup) < 0)
+        schedule();
+}
+
+void MTimerWheel::remove(MWheelTimer *t)
+{
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->prev = t->next = 0;
+    armed--;
+    // os_timer may wake us up for nothing, that's cheaper than rescheduling
+}
+
+// Sets os_timer for the next tick with something to do.
+void MTimerWheel::schedule()
+{
+    if (!armed) {
+        os_timer.stop();
+        return;
+    }
+
+    // the first tick with timers on the first level
+    quint32 t;
+    for (t = tick + 1; t != tick + SLOTS; ++t) {
+        MWheelTimer *h = wheel[0][t % SLOTS];
+        if (h->next != h)
+            break;
+    }
+    // or the first timer of the first round with any on the second
+    // level, if it's earlier.  advance() moves the timers of the rounds
+    // it passes to the first level on its way, so they don't need a
+    // wakeup of their own.
+    bool found = t != tick + SLOTS;
+    for (quint32 r = tick / SLOTS + 1; r != tick / SLOTS + SLOTS; ++r) {
+        if (found && (qint32)(r * SLOTS - t) >= 0)
+            break;
+        MWheelTimer *h = wheel[1][r % SLOTS];
+        if (h->next == h)
+            continue;
+        quint32 first = h->next->expires;
+        for (MWheelTimer *i = h->next->next; i != h; i = i->next)
+            if ((qint32)(i->expires - first) < 0)
+                first = i->expires;
+        // the last round also has the timers we can't see yet
+        if ((qint32)(first - (r + 1) * SLOTS) >= 0)
+            first = r * SLOTS;
+        if (!found || (qint32)(first - t) < 0)
+            t = first;
+        break;
+    }
+    wakeup = t;
+
+    qint64 msecs = (qint64)t * TICK_MSECS
+                   - (qint64)((MLatencyHistogram::now() - epoch) / 1000);
+    os_timer.start(qMax(msecs, (qint64)0));
+}
+
+void MTimerWheel::advance()
+{
+    quint32 now = currentTick();
+    MWheelTimer expired;
+
+    while ((qint32)(now - tick) > 0 && armed) {
+        tick++;
+        if (tick % SLOTS == 0) {
+            // move the timers of this round to the first level
+            MWheelTimer *h = wheel[1][(tick / SLOTS) % SLOTS];
+            while (h->next != h) {
+                MWheelTimer *t = h->next;
+                h->next = t->next;
+                t->next->prev = h;
+                insert(t);
+            }
+        }
+
+        // fire this tick's timers from a separate list, so they can
+        // start and stop each other
+        MWheelTimer *h = wheel[0][tick % SLOTS];
+        if (h->next == h)
+            continue;
+        expired.prev = h->prev;
+        expired.next = h->next;
+        expired.prev->next = expired.next->prev = &expired;
+        h->prev = h->next = h;
+        while (expired.next != &expired) {
+            MWheelTimer *t = expired.next;
+            remove(t);
+            if (!t->single_shot)
+                add(t);
+            if (t->method >= 0)
+                t->receiver->metaObject()->method(t->method)
+                                                        .invoke(t->receiver);
+        }
+    }
+    // the list head must not stop anything when it goes out of scope
+    expired.prev = expired.next = 0;
+    if (!armed)
+        tick = now;
+    schedule();
+}
@@ -0,0 +1,109 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MTIMERWHEEL_H
+#define MTIMERWHEEL_H
+
+#include <QObject>
+#include <QTimer>
+
+class MTimerWheel;
+
+/*!
+ * A timer driven by the shared MTimerWheel, with the interface of the
+ * parts of QTimer we use.  Starting and stopping it is O(1) and it isn't
+ * a QObject, so windows can have several of them cheaply.  It fires
+ * at the tick of MTimerWheel nearest to its interval, so within half a
+ * TICK_MSECS of it, calling \a slot of \a receiver (given with the
+ * SLOT() macro).
+ */
+class MWheelTimer
+{
+public:
+    MWheelTimer(QObject *receiver, const char *slot);
+    ~MWheelTimer() { stop(); }
+
+    void setInterval(int msecs) { interval = msecs; }
+    void setSingleShot(bool s) { single_shot = s; }
+    void start();
+    void start(int msecs) { interval = msecs; start(); }
+    void stop();
+    bool isActive() const { return prev != 0; }
+
+private:
+    friend class MTimerWheel;
+    // list heads of the wheel
+    MWheelTimer()
+        : prev(this), next(this), expires(0), interval(0), single_shot(false),
+          receiver(0), method(-1) {}
+
+    // links in the slot of the wheel, NULL when stopped
+    MWheelTimer *prev, *next;
+    // in ticks of the wheel
+    quint32 expires;
+    int interval;
+    bool single_shot;
+    QObject *receiver;
+    int method;
+};
+
+/*!
+ * Hierarchical timing wheel for the MWheelTimers.  Time is counted in
+ * ticks, and one QTimer wakes us up only for the ticks that have
+ * something to do, so timers expiring close to each other share the
+ * wakeup.  The first level has a slot for each of the next SLOTS ticks,
+ * the second for each of the next SLOTS rounds of the first, whose
+ * timers are moved to the first level when their round comes.  The tick
+ * is fine enough for the short damage timeouts of MStartupProfile, and
+ * the second level reaches 40 s, past the ping and reappear timeouts.
+ */
+class MTimerWheel: public QObject
+{
+    Q_OBJECT
+
+public:
+    enum { TICK_MSECS = 10, SLOTS = 64, LEVELS = 2 };
+
+    static MTimerWheel *instance();
+
+    void add(MWheelTimer *t);
+    void remove(MWheelTimer *t);
+
+private slots:
+    void advance();
+
+private:
+    MTimerWheel();
+    quint32 currentTick() const;
+    void insert(MWheelTimer *t);
+    void schedule();
+
+    // circular lists with the heads as sentinels
+    MWheelTimer *wheel[LEVELS][SLOTS];
+    quint32 tick;
+    unsigned long long epoch;
+    // the tick os_timer is set for, if active
+    quint32 wakeup;
+    int armed;
+    QTimer os_timer;
+
+    static MTimerWheel *d;
+};
+
+#endif
@@ -0,0 +1,110 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "mtrace.h"
+#include "mlatencyhistogram.h"
+#include <QHash>
+#include <QVector>
+#include <QByteArray>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+MTrace::Entry MTrace::ring[MTrace::RECORDS];
+unsigned MTrace::head = 0;
+
+MTrace::Entry *MTrace::next(const char *fun, quint32 window)
+{
+    Entry *r = &ring[head++ % RECORDS];
+    r->usecs = MLatencyHistogram::now();
+    r->fun = fun;
+    r->window = window;
+    return r;
+}
+
+void MTrace::add(const char *fun, const char *msg, quint32 window)
+{
+    Entry *r = next(fun, window);
+    strncpy(r->text, msg, sizeof(r->text) - 1);
+    r->text[sizeof(r->text) - 1] = '\0';
+}
+
+void MTrace::addf(const char *fun, quint32 window, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vaddf(fun, window, fmt, args);
+    va_end(args);
+}
+
+void MTrace::vaddf(const char *fun, quint32 window, const char *fmt,
+                   va_list args)
+{
+    vsnprintf(next(fun, window)->text, sizeof(ring[0].text), fmt, args);
+}
+
+bool MTrace::save(const char *fname)
+{
+    FILE *out;
+    if (!(out = fopen(fname, "w"))) {
+        qWarning("%s: %s: %s", __func__, fname, strerror(errno));
+        return false;
+    }
+
+    MTraceHeader h;
+    memcpy(h.magic, MTRACE_MAGIC, sizeof(h.magic));
+    h.version = MTRACE_VERSION;
+    h.records = qMin(head, (unsigned)RECORDS);
+    h.lost = head - h.records;
+
+    // oldest first, with the function names gathered into a table
+    QVector<MTraceRecord> records(h.records);
+    QHash<const char *, quint32> offsets;
+    QByteArray strings;
+    unsigned first = head - h.records;
+    for (unsigned i = 0; i < h.records; ++i) {
+        const Entry &e = ring[(first + i) % RECORDS];
+        MTraceRecord &r = records[i];
+        r.usecs = e.usecs;
+        r.window = e.window;
+        memcpy(r.text, e.text, sizeof(r.text));
+        if (!e.fun)
+            r.fun = MTRACE_NO_FUN;
+        else if (offsets.contains(e.fun))
+            r.fun = offsets.value(e.fun);
+        else {
+            r.fun = strings.size();
+            offsets.insert(e.fun, r.fun);
+            strings.append(e.fun, strlen(e.fun) + 1);
+        }
+    }
+    h.strings = strings.size();
+
+    fwrite(&h, sizeof(h), 1, out);
+    fwrite(records.constData(), sizeof(MTraceRecord), records.size(), out);
+    fwrite(strings.constData(), 1, strings.size(), out);
+
+    bool ok = !ferror(out);
+    if (fclose(out) || !ok) {
+        qWarning("%s: %s: %s", __func__, fname, strerror(errno));
+        return false;
+    }
+    return true;
+}
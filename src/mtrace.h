@@ -0,0 +1,95 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MTRACE_H
+#define MTRACE_H
+
+#include <QtGlobal>
+#include <stdarg.h>
+
+/*
+ * In-memory ring buffer of trace messages, cheap enough to be always
+ * on: adding a message is a copy into a fixed-size record, without
+ * system calls.  The "trace" remote control command saves the ring,
+ * which tests/tracedump prints, merged with an X event log of the same
+ * session if there is one.
+ *
+ * Binary format of the saved ring: a MTraceHeader followed by @records
+ * MTraceRecord:s, oldest first, and @strings bytes of \0-terminated
+ * function names the records refer to.  Everything is in host byte
+ * order.
+ */
+
+#define MTRACE_MAGIC   "MCTR"
+#define MTRACE_VERSION 2
+
+struct MTraceHeader
+{
+    char magic[4];
+    quint32 version;
+    quint32 records;
+    quint32 lost;           // overwritten before the ring was saved
+    quint32 strings;        // size of the function name table
+};
+
+// MTraceRecord::fun of records without one
+#define MTRACE_NO_FUN  0xffffffff
+
+struct MTraceRecord
+{
+    quint64 usecs;          // CLOCK_MONOTONIC
+    quint32 window;         // the message is about, or 0
+    quint32 fun;            // offset of the function name or MTRACE_NO_FUN
+    char text[48];          // \0-terminated, cut if it was longer
+};
+
+class MTrace
+{
+public:
+    enum { RECORDS = 4096 };
+
+    //! Records @msg from @fun, which may be NULL.  Only the pointer of
+    //! @fun is kept, so it must be static, like __PRETTY_FUNCTION__.
+    static void add(const char *fun, const char *msg, quint32 window = 0);
+    //! Same with a formatted message.
+    static void addf(const char *fun, quint32 window, const char *fmt, ...)
+        __attribute__((format(printf, 3, 4)));
+    static void vaddf(const char *fun, quint32 window, const char *fmt,
+                      va_list args);
+
+    //! Saves the ring into @fname, returns whether it succeeded.
+    static bool save(const char *fname);
+
+private:
+    struct Entry
+    {
+        quint64 usecs;
+        const char *fun;
+        quint32 window;
+        char text[sizeof(((MTraceRecord *)0)->text)];
+    };
+
+    static Entry *next(const char *fun, quint32 window);
+
+    static Entry ring[RECORDS];
+    // number of records added so far
+    static unsigned head;
+};
+
+#endif
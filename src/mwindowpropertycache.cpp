@@ -29,10 +29,22 @@
 #include "mcompositemanager.h"
 #include "mwindowpropertycache.h"
 #include "mcompositemanager_p.h"
+#include "mxreader.h"
 
 #define MAX_TYPES 10
 
 xcb_connection_t *MWindowPropertyCache::xcb_conn;
+QVector<MWindowPropertyCache::RegisteredProperty>
+                                    MWindowPropertyCache::registry;
+int MWindowPropertyCache::always_mapped_prop = -1;
+int MWindowPropertyCache::cannot_minimize_prop = -1;
+int MWindowPropertyCache::orientation_angle_prop = -1;
+int MWindowPropertyCache::global_alpha_prop = -1;
+int MWindowPropertyCache::video_global_alpha_prop = -1;
+int MWindowPropertyCache::pid_prop = -1;
+int MWindowPropertyCache::sync_counter_prop = -1;
+QHash<xcb_visualid_t, MWindowPropertyCache::VisualFormat>
+                                    MWindowPropertyCache::visual_formats;
 
 void MWindowPropertyCache::init()
 {
@@ -41,12 +53,14 @@ void MWindowPropertyCache::init()
     icon_geometry_valid = false;
     decor_buttons_valid = false;
     shape_rects_valid = false;
+    root_shape_valid = false;
+    is_shaped = -1;
+    shape_rectangular = -1;
+    shape_covers_n = 0;
     real_geom_valid = false;
     net_wm_state_valid = false;
     wm_state_query = false;
     has_alpha = -1;
-    global_alpha = -1;
-    video_global_alpha = -1;
     is_decorator = -1;
     wmhints = 0;
     attrs = 0;
@@ -54,14 +68,11 @@ void MWindowPropertyCache::init()
     window_state = -1;
     window_type = MCompAtoms::INVALID;
     parent_window = QX11Info::appRootWindow();
-    always_mapped = -1;
-    cannot_minimize = -1;
     desktop_view = -1;
     being_mapped = false;
     dont_iconify = false;
     custom_region = 0;
     custom_region_request_fired = false;
-    orientation_angle = 0;
     xcb_real_geom = 0;
     damage_object = 0;
 
@@ -81,20 +92,13 @@ void MWindowPropertyCache::init_invalid()
     memset(&xcb_is_decorator_cookie, 0, sizeof(xcb_is_decorator_cookie));
     memset(&xcb_window_type_cookie, 0, sizeof(xcb_window_type_cookie));
     memset(&xcb_decor_buttons_cookie, 0, sizeof(xcb_decor_buttons_cookie));
-    memset(&xcb_orientation_angle_cookie, 0,
-           sizeof(xcb_orientation_angle_cookie));
     memset(&xcb_statusbar_cookie, 0, sizeof(xcb_statusbar_cookie));
     memset(&xcb_wm_protocols_cookie, 0, sizeof(xcb_wm_protocols_cookie));
     memset(&xcb_wm_state_cookie, 0, sizeof(xcb_wm_state_cookie));
     memset(&xcb_wm_hints_cookie, 0, sizeof(xcb_wm_hints_cookie));
     memset(&xcb_icon_geom_cookie, 0, sizeof(xcb_icon_geom_cookie));
-    memset(&xcb_global_alpha_cookie, 0, sizeof(xcb_global_alpha_cookie));
-    memset(&xcb_video_global_alpha_cookie, 0,
-           sizeof(xcb_video_global_alpha_cookie));
     memset(&xcb_net_wm_state_cookie, 0, sizeof(xcb_net_wm_state_cookie));
-    memset(&xcb_always_mapped_cookie, 0, sizeof(xcb_always_mapped_cookie));
-    memset(&xcb_cannot_minimize_cookie, 0, sizeof(xcb_always_mapped_cookie));
-    memset(&xcb_pict_formats_cookie, 0, sizeof(xcb_pict_formats_cookie));
+    memset(&xcb_shape_extents_cookie, 0, sizeof(xcb_shape_extents_cookie));
     memset(&xcb_shape_rects_cookie, 0, sizeof(xcb_shape_rects_cookie));
     memset(&real_geom, 0, sizeof(real_geom));
     memset(&statusbar_geom, 0, sizeof(statusbar_geom));
@@ -126,6 +130,7 @@ MWindowPropertyCache::MWindowPropertyCache(Window w,
     }
     is_valid = true;
     damage_object = damage_obj;
+    registerBuiltinProperties();
 
     if (!isMapped()) {
         // required to get property changes happening before mapping
@@ -146,14 +151,9 @@ MWindowPropertyCache::MWindowPropertyCache(Window w,
     xcb_window_type_cookie = xcb_get_property(xcb_conn, 0, window,
                                               ATOM(_NET_WM_WINDOW_TYPE),
                                               XCB_ATOM_ATOM, 0, MAX_TYPES);
-    // FIXME: pict formats do not seem window-specific -- get them only once
-    xcb_pict_formats_cookie = xcb_render_query_pict_formats(xcb_conn);
     xcb_decor_buttons_cookie = xcb_get_property(xcb_conn, 0, window,
                                        ATOM(_MEEGOTOUCH_DECORATOR_BUTTONS),
                                        XCB_ATOM_CARDINAL, 0, 8);
-    xcb_orientation_angle_cookie = xcb_get_property(xcb_conn, 0, window,
-                                    ATOM(_MEEGOTOUCH_ORIENTATION_ANGLE),
-                                    XCB_ATOM_CARDINAL, 0, 1);
     xcb_statusbar_cookie = xcb_get_property(xcb_conn, 0, window,
                                     ATOM(_MEEGOTOUCH_MSTATUSBAR_GEOMETRY),
                                     XCB_ATOM_CARDINAL, 0, 4);
@@ -168,28 +168,34 @@ MWindowPropertyCache::MWindowPropertyCache(Window w,
     xcb_icon_geom_cookie = xcb_get_property(xcb_conn, 0, window,
                                             ATOM(_NET_WM_ICON_GEOMETRY),
                                             XCB_ATOM_CARDINAL, 0, 4);
-    xcb_global_alpha_cookie = xcb_get_property(xcb_conn, 0, window,
-                                               ATOM(_MEEGOTOUCH_GLOBAL_ALPHA),
-                                               XCB_ATOM_CARDINAL, 0, 1);
-    xcb_video_global_alpha_cookie = xcb_get_property(xcb_conn, 0, window,
-                                               ATOM(_MEEGOTOUCH_VIDEO_ALPHA),
-                                               XCB_ATOM_CARDINAL, 0, 1);
-    xcb_shape_rects_cookie = xcb_shape_get_rectangles(xcb_conn, window,
-                                                      ShapeBounding);
+    // the rectangles are fetched only if the window turns out to be shaped
+    xcb_shape_extents_cookie = xcb_shape_query_extents(xcb_conn, window);
     xcb_net_wm_state_cookie = xcb_get_property(xcb_conn, 0, window,
                                                ATOM(_NET_WM_STATE),
                                                XCB_ATOM_ATOM, 0, 100);
-    xcb_always_mapped_cookie = xcb_get_property(xcb_conn, 0, window,
-                                                ATOM(_MEEGOTOUCH_ALWAYS_MAPPED),
-                                                XCB_ATOM_CARDINAL, 0, 1);
-    xcb_cannot_minimize_cookie = xcb_get_property(xcb_conn, 0, window,
-                                         ATOM(_MEEGOTOUCH_CANNOT_MINIMIZE),
-                                         XCB_ATOM_CARDINAL, 0, 1);
+    if (!geom)
+        requestFired(xcb_real_geom_cookie.sequence);
+    requestFired(xcb_is_decorator_cookie.sequence);
+    requestFired(xcb_transient_for_cookie.sequence);
+    requestFired(xcb_meego_layer_cookie.sequence);
+    requestFired(xcb_window_type_cookie.sequence);
+    requestFired(xcb_decor_buttons_cookie.sequence);
+    requestFired(xcb_statusbar_cookie.sequence);
+    requestFired(xcb_wm_protocols_cookie.sequence);
+    requestFired(xcb_wm_state_cookie.sequence);
+    requestFired(xcb_wm_hints_cookie.sequence);
+    requestFired(xcb_icon_geom_cookie.sequence);
+    requestFired(xcb_shape_extents_cookie.sequence);
+    requestFired(xcb_net_wm_state_cookie.sequence);
+    properties.resize(registry.size());
+    for (int i = 0; i < registry.size(); ++i)
+        if (registry.at(i).prefetch)
+            fetchProperty(i);
     // add any transients to the transients list
     MCompositeManager *m = (MCompositeManager*)qApp;
     for (QList<Window>::const_iterator it = m->d->stacking_list.begin();
          it != m->d->stacking_list.end(); ++it) {
-        MWindowPropertyCache *p = m->d->prop_caches.value(*it, 0);
+        MWindowPropertyCache *p = m->d->registry.propertyCache(*it);
         if (p && p != this && p->transientFor() == window)
             transients.append(*it);
     }
@@ -213,80 +219,300 @@ MWindowPropertyCache::~MWindowPropertyCache()
             XFree(wmhints);
         return;
     }
-    if (!wmhints)
-        getWMHints();
-    XFree(wmhints);
+    if (wmhints)
+        XFree(wmhints);
     if (attrs) {
         free(attrs);
         attrs = 0;
     }
-    if (!xcb_real_geom)
-        xcb_real_geom = xcb_get_geometry_reply(xcb_conn,
-                                               xcb_real_geom_cookie, 0);
     if (xcb_real_geom) {
         free(xcb_real_geom);
         xcb_real_geom = 0;
     }
+    MCompositeManager *m = (MCompositeManager*)qApp;
     if (transient_for && transient_for != (Window)-1) {
-        MCompositeManager *m = (MCompositeManager*)qApp;
         // remove reference from the old "parent"
-        MWindowPropertyCache *p = m->d->prop_caches.value(transient_for, 0);
+        MWindowPropertyCache *p = m->d->registry.propertyCache(transient_for);
         if (p) p->transients.removeAll(window);
     }
-    if (transient_for == (Window)-1)
-        xcb_discard_reply(xcb_conn, xcb_transient_for_cookie.sequence);
-    if (always_mapped < 0)
-        xcb_discard_reply(xcb_conn, xcb_always_mapped_cookie.sequence);
-    if (cannot_minimize < 0)
-        xcb_discard_reply(xcb_conn, xcb_cannot_minimize_cookie.sequence);
     desktopView(false);  // free the reply if it has been requested
-    if (meego_layer < 0)
-        xcb_discard_reply(xcb_conn, xcb_meego_layer_cookie.sequence);
-    if (is_decorator < 0)
-        xcb_discard_reply(xcb_conn, xcb_is_decorator_cookie.sequence);
-    if (window_type == MCompAtoms::INVALID)
-        xcb_discard_reply(xcb_conn, xcb_window_type_cookie.sequence);
-    if (has_alpha < 0)
-        xcb_discard_reply(xcb_conn, xcb_pict_formats_cookie.sequence);
-    if (!decor_buttons_valid)
-        xcb_discard_reply(xcb_conn, xcb_decor_buttons_cookie.sequence);
-    if (!wm_protocols_valid)
-        xcb_discard_reply(xcb_conn, xcb_wm_protocols_cookie.sequence);
-    if (custom_region_request_fired)
-        xcb_discard_reply(xcb_conn, xcb_custom_region_cookie.sequence);
-    xcb_discard_reply(xcb_conn, xcb_orientation_angle_cookie.sequence);
-    xcb_discard_reply(xcb_conn, xcb_statusbar_cookie.sequence);
-    if (wm_state_query)
-        windowState();
-    if (!icon_geometry_valid)
-        iconGeometry();
-    if (global_alpha < 0)
-        globalAlpha();
-    if (video_global_alpha < 0)
-        videoGlobalAlpha();
-    if (!shape_rects_valid)
-        shapeRegion();
-    if (!net_wm_state_valid)
-        netWmState();
+
+    // drop the replies nobody has asked for
+    while (!pending_replies.isEmpty())
+        discardReply(pending_replies.first());
+    foreach (void *r, collected_replies)
+        free(r);
+    m->d->pending_prop_caches.remove(this);
     damageTracking(false);
 }
 
-bool MWindowPropertyCache::hasAlpha()
+int MWindowPropertyCache::memoryUsage() const
 {
-    if (!is_valid || has_alpha >= 0)
-        return has_alpha == 1 ? true : false;
+    int n = sizeof(*this);
+    if (attrs)
+        n += sizeof(*attrs);
+    if (xcb_real_geom)
+        n += sizeof(*xcb_real_geom);
+    if (wmhints)
+        n += sizeof(*wmhints);
+    if (custom_region)
+        n += sizeof(*custom_region) + custom_region->numRects() * sizeof(QRect);
+    n += shape_region.numRects() * sizeof(QRect);
+    n += root_shape.numRects() * sizeof(QRect);
+    n += (transients.size() + wm_protocols.size() + net_wm_state.size())
+         * sizeof(void*);
+    for (int i = 0; i < properties.size(); ++i)
+        n += sizeof(PropertyValue) + properties.at(i).data.capacity()
+             + properties.at(i).atoms.size() * sizeof(void*)
+             + properties.at(i).string.capacity() * sizeof(QChar);
+    n += pending_replies.size() * sizeof(void*);
+    for (QHash<unsigned int, void*>::const_iterator it
+                = collected_replies.begin();
+         it != collected_replies.end(); ++it)
+        // failed requests are collected as NULL
+        if (*it)
+            n += 32 + ((xcb_generic_reply_t*)*it)->length * 4;
+    return n;
+}
+
+void MWindowPropertyCache::registerBuiltinProperties()
+{
+    if (always_mapped_prop >= 0)
+        return;
+    always_mapped_prop = registerProperty(ATOM(_MEEGOTOUCH_ALWAYS_MAPPED),
+                                          XCB_ATOM_CARDINAL, 1);
+    cannot_minimize_prop = registerProperty(ATOM(_MEEGOTOUCH_CANNOT_MINIMIZE),
+                                            XCB_ATOM_CARDINAL, 1);
+    orientation_angle_prop = registerProperty(
+                                    ATOM(_MEEGOTOUCH_ORIENTATION_ANGLE),
+                                    XCB_ATOM_CARDINAL, 1);
+    global_alpha_prop = registerProperty(ATOM(_MEEGOTOUCH_GLOBAL_ALPHA),
+                                         XCB_ATOM_CARDINAL, 1);
+    video_global_alpha_prop = registerProperty(ATOM(_MEEGOTOUCH_VIDEO_ALPHA),
+                                               XCB_ATOM_CARDINAL, 1);
+    // only needed when killing or debugging the client
+    pid_prop = registerProperty(ATOM(_NET_WM_PID), XCB_ATOM_CARDINAL, 1,
+                                false);
+    sync_counter_prop = registerProperty(ATOM(_NET_WM_SYNC_REQUEST_COUNTER),
+                                         XCB_ATOM_CARDINAL, 1);
+}
+
+int MWindowPropertyCache::registerProperty(Atom atom, Atom type,
+                                           unsigned max_len, bool prefetch)
+{
+    for (int i = 0; i < registry.size(); ++i)
+        if (registry.at(i).atom == atom && registry.at(i).type == type) {
+            // registered already, take the larger of the two
+            registry[i].max_len = qMax(registry.at(i).max_len, max_len);
+            registry[i].prefetch |= prefetch;
+            return i;
+        }
+    RegisteredProperty p;
+    p.atom = atom;
+    p.type = type;
+    p.max_len = max_len;
+    p.prefetch = prefetch;
+    registry.append(p);
+    return registry.size() - 1;
+}
+
+void MWindowPropertyCache::fetchProperty(int handle)
+{
+    if (properties.size() <= handle)
+        properties.resize(registry.size());
+    PropertyValue &v = properties[handle];
+    if (v.sequence)
+        discardReply(v.sequence);
+    const RegisteredProperty &p = registry.at(handle);
+    v.sequence = xcb_get_property(xcb_conn, 0, window, p.atom, p.type,
+                                  0, p.max_len).sequence;
+    requestFired(v.sequence);
+}
+
+const QByteArray &MWindowPropertyCache::propertyData(int handle)
+{
+    static const QByteArray empty;
+    if (!is_valid || handle < 0 || handle >= registry.size())
+        return empty;
+    if (properties.size() <= handle)
+        properties.resize(registry.size());
+    if (!properties.at(handle).valid && !properties.at(handle).sequence)
+        // not prefetched
+        fetchProperty(handle);
+
+    PropertyValue &v = properties[handle];
+    if (v.sequence) {
+        xcb_get_property_reply_t *r;
+        r = (xcb_get_property_reply_t*)takeReply(v.sequence);
+        v.sequence = 0;
+        v.data.clear();
+        v.type = None;
+        v.decoded = 0;
+        v.atoms.clear();
+        v.string.clear();
+        if (r) {
+            int len = xcb_get_property_value_length(r);
+            if (len > 0)
+                v.data = QByteArray((const char*)xcb_get_property_value(r),
+                                    len);
+            v.type = r->type;
+            free(r);
+        }
+        v.valid = true;
+    }
+    return v.data;
+}
 
-    // the following code is replacing a XRenderFindVisualFormat() call...
+unsigned MWindowPropertyCache::cardinalProperty(int handle, unsigned def)
+{
+    const QByteArray &d = propertyData(handle);
+    if ((unsigned)d.size() < sizeof(CARD32))
+        return def;
+    return *(const CARD32*)d.constData();
+}
+
+const QList<Atom> &MWindowPropertyCache::atomListProperty(int handle)
+{
+    static const QList<Atom> empty;
+    propertyData(handle);
+    if (!is_valid || handle < 0 || handle >= properties.size())
+        return empty;
+
+    PropertyValue &v = properties[handle];
+    if (!(v.decoded & PropertyValue::Atoms)) {
+        const CARD32 *a = (const CARD32*)v.data.constData();
+        if (v.type == XA_ATOM)
+            for (unsigned i = 0; i < v.data.size() / sizeof(CARD32); ++i)
+                v.atoms.append(a[i]);
+        v.decoded |= PropertyValue::Atoms;
+    }
+    return v.atoms;
+}
+
+const QString &MWindowPropertyCache::stringProperty(int handle)
+{
+    static const QString empty;
+    propertyData(handle);
+    if (!is_valid || handle < 0 || handle >= properties.size())
+        return empty;
+
+    PropertyValue &v = properties[handle];
+    if (!(v.decoded & PropertyValue::String)) {
+        // QByteArray::constData() is \0-terminated
+        const char *s = v.data.constData();
+        if (v.type == XA_STRING)
+            v.string = QString::fromLatin1(s);
+        else if (v.type != None)
+            v.string = QString::fromUtf8(s);
+        v.decoded |= PropertyValue::String;
+    }
+    return v.string;
+}
+
+void MWindowPropertyCache::requestFired(unsigned int sequence)
+{
+    MCompositeManager *m = (MCompositeManager*)qApp;
+    if (pending_replies.isEmpty()) {
+        m->d->pending_prop_caches.insert(this);
+        requests_sent = MLatencyHistogram::now();
+    }
+    pending_replies.append(sequence);
+    if (m->d->xreader)
+        m->d->xreader->expect(sequence);
+}
+
+void *MWindowPropertyCache::takeReply(unsigned int sequence)
+{
+    if (collected_replies.contains(sequence))
+        return collected_replies.take(sequence);
+    if (!pending_replies.removeOne(sequence))
+        // already taken
+        return 0;
+    // not arrived yet, we have to wait for it
+    MCompositeManager *m = (MCompositeManager*)qApp;
+    if (m->d->xreader)
+        return m->d->xreader->waitForReply(sequence);
+    return xcb_wait_for_reply(xcb_conn, sequence, 0);
+}
+
+void MWindowPropertyCache::discardReply(unsigned int sequence)
+{
+    if (collected_replies.contains(sequence))
+        free(collected_replies.take(sequence));
+    else if (pending_replies.removeOne(sequence)) {
+        MCompositeManager *m = (MCompositeManager*)qApp;
+        if (m->d->xreader)
+            m->d->xreader->discard(sequence);
+        else
+            xcb_discard_reply(xcb_conn, sequence);
+    }
+}
+
+bool MWindowPropertyCache::collectReplies()
+{
+    MCompositeManager *m = (MCompositeManager*)qApp;
+    bool was_ready = stackingAttributesReady();
+    bool had_pending = !pending_replies.isEmpty();
+    // replies arrive in the order of the requests, so we can stop
+    // at the first one which is not there yet
+    while (!pending_replies.isEmpty()) {
+        void *r = 0;
+        if (m->d->xreader) {
+            if (!m->d->xreader->poll(pending_replies.first(), &r))
+                break;
+        } else {
+            xcb_generic_error_t *e = 0;
+            if (!xcb_poll_for_reply(xcb_conn, pending_replies.first(),
+                                    &r, &e))
+                break;
+            if (e)
+                free(e);
+        }
+        // the getters handle the missing reply of a failed request
+        collected_replies.insert(pending_replies.takeFirst(), r);
+    }
+    if (had_pending && pending_replies.isEmpty())
+        m->d->reply_latency.add(MLatencyHistogram::now() - requests_sent);
+    if (!was_ready && stackingAttributesReady())
+        emit repliesReady(this);
+    return !pending_replies.isEmpty();
+}
+
+bool MWindowPropertyCache::stackingAttributesReady() const
+{
+    if (pending_replies.isEmpty())
+        return true;
+    return !pending_replies.contains(xcb_transient_for_cookie.sequence)
+        && !pending_replies.contains(xcb_window_type_cookie.sequence)
+        && !pending_replies.contains(xcb_meego_layer_cookie.sequence)
+        && !pending_replies.contains(xcb_wm_state_cookie.sequence)
+        && !pending_replies.contains(xcb_net_wm_state_cookie.sequence)
+        && !pending_replies.contains(xcb_is_decorator_cookie.sequence);
+}
+
+// Visual formats don't change during the lifetime of the X connection,
+// so they are fetched once for all windows.  The following code is
+// replacing XRenderFindVisualFormat() calls.
+void MWindowPropertyCache::buildVisualFormats()
+{
     xcb_render_query_pict_formats_reply_t *pict_formats_reply;
     pict_formats_reply = xcb_render_query_pict_formats_reply(xcb_conn,
-                                xcb_pict_formats_cookie, 0);
+                                xcb_render_query_pict_formats(xcb_conn), 0);
+    visual_formats.clear();
     if (!pict_formats_reply) {
-        qWarning("%s: querying alpha for 0x%lx has failed", __func__, window);
-        has_alpha = 0;
-        return false;
+        qWarning("%s: querying picture formats has failed", __func__);
+        return;
     }
 
-    xcb_render_pictformat_t format = 0;
+    // alpha of each format
+    QHash<xcb_render_pictformat_t, bool> format_alpha;
+    xcb_render_pictforminfo_iterator_t pictform_i;
+    pictform_i = xcb_render_query_pict_formats_formats_iterator(
+                                                      pict_formats_reply);
+    for (; pictform_i.rem; xcb_render_pictforminfo_next(&pictform_i))
+        format_alpha.insert(pictform_i.data->id,
+                            pictform_i.data->direct.alpha_mask != 0);
+
     xcb_render_pictscreen_iterator_t scr_i;
     scr_i = xcb_render_query_pict_formats_screens_iterator(pict_formats_reply);
     for (; scr_i.rem; xcb_render_pictscreen_next(&scr_i)) {
@@ -296,44 +522,96 @@ bool MWindowPropertyCache::hasAlpha()
             xcb_render_pictvisual_iterator_t visual_i;
             visual_i = xcb_render_pictdepth_visuals_iterator(depth_i.data);
             for (; visual_i.rem; xcb_render_pictvisual_next(&visual_i)) {
-                if (visual_i.data->visual == attrs->visual) {
-                    format = visual_i.data->format;
-                    break;
-                }
+                VisualFormat f;
+                f.format = visual_i.data->format;
+                f.has_alpha = format_alpha.value(f.format, false);
+                f.depth = depth_i.data->depth;
+                visual_formats.insert(visual_i.data->visual, f);
             }
         }
     }
-    // now we have the format, next find details for it
-    xcb_render_pictforminfo_iterator_t pictform_i;
-    pictform_i = xcb_render_query_pict_formats_formats_iterator(
-                                                      pict_formats_reply);
-    for (; pictform_i.rem; xcb_render_pictforminfo_next(&pictform_i)) {
-        if (pictform_i.data->id == format) {
-            if (pictform_i.data->direct.alpha_mask)
-                has_alpha = 1;
-            else
-                has_alpha = 0;
-            break;
-        }
-    }
+    free(pict_formats_reply);
+}
+
+bool MWindowPropertyCache::hasAlpha()
+{
+    if (!is_valid || has_alpha >= 0)
+        return has_alpha == 1 ? true : false;
+
+    QHash<xcb_visualid_t, VisualFormat>::const_iterator i;
+    i = visual_formats.find(attrs->visual);
+    if (i == visual_formats.end()) {
+        qWarning("%s: querying alpha for 0x%lx has failed", __func__, window);
+        has_alpha = 0;
+    } else
+        has_alpha = i->has_alpha ? 1 : 0;
     return has_alpha ? true : false;
 }
 
+bool MWindowPropertyCache::isShaped()
+{
+    if (!is_valid)
+        return false;
+    if (is_shaped < 0) {
+        xcb_shape_query_extents_reply_t *r;
+        r = (xcb_shape_query_extents_reply_t*)
+            takeReply(xcb_shape_extents_cookie.sequence);
+        xcb_shape_extents_cookie.sequence = 0;
+        if (r && r->bounding_shaped) {
+            is_shaped = 1;
+            shape_rects_valid = false;
+            xcb_shape_rects_cookie = xcb_shape_get_rectangles(xcb_conn,
+                                                    window, ShapeBounding);
+            requestFired(xcb_shape_rects_cookie.sequence);
+        } else
+            is_shaped = 0;
+        free(r);
+    }
+    return is_shaped == 1;
+}
+
+void MWindowPropertyCache::shapeRefresh(bool shaped)
+{
+    if (!is_valid)
+        return;
+    if (is_shaped < 0)
+        // collect the old reply
+        isShaped();
+    if (is_shaped == 1 && !shape_rects_valid)
+        discardReply(xcb_shape_rects_cookie.sequence);
+    shape_rectangular = -1;
+    shape_covers_n = 0;
+    shape_rects_valid = false;
+    root_shape_valid = false;
+    shape_region = QRegion();
+    if (!shaped) {
+        is_shaped = 0;
+        return;
+    }
+    is_shaped = 1;
+    shape_rects_valid = false;
+    xcb_shape_rects_cookie = xcb_shape_get_rectangles(xcb_conn, window,
+                                                      ShapeBounding);
+    requestFired(xcb_shape_rects_cookie.sequence);
+}
+
 const QRegion &MWindowPropertyCache::shapeRegion()
 {
-    if (!is_valid || shape_rects_valid) {
-        if (!shape_region.isEmpty() && isInputOnly())
-            // InputOnly window obstructs nothing
-            shape_region = QRegion(0, 0, 0, 0);
-        if (shape_region.isEmpty())
-            shape_region = QRegion(realGeometry());
+    if (shape_rects_valid)
+        return shape_region;
+    root_shape_valid = false;
+    if (!isShaped()) {
+        shape_region = QRegion(QRect(QPoint(0, 0), realGeometry().size()));
+        shape_rects_valid = true;
         return shape_region;
     }
+
     xcb_shape_get_rectangles_reply_t *r;
-    r = xcb_shape_get_rectangles_reply(xcb_conn, xcb_shape_rects_cookie, 0);
+    r = (xcb_shape_get_rectangles_reply_t*)
+        takeReply(xcb_shape_rects_cookie.sequence);
+    shape_rects_valid = true;
     if (!r) {
-        shape_rects_valid = true;
-        shape_region = QRegion(realGeometry());
+        shape_region = QRegion(QRect(QPoint(0, 0), realGeometry().size()));
         return shape_region;
     }
     xcb_rectangle_iterator_t i;
@@ -343,10 +621,47 @@ const QRegion &MWindowPropertyCache::shapeRegion()
         shape_region += QRect(i.data->x, i.data->y, i.data->width,
                               i.data->height);
     free(r);
-    shape_rects_valid = true;
     return shape_region;
 }
 
+const QRegion &MWindowPropertyCache::rootShapeRegion()
+{
+    const QRegion &shape = shapeRegion();
+    if (!root_shape_valid) {
+        root_shape = shape.translated(realGeometry().topLeft());
+        root_shape_valid = true;
+    }
+    return root_shape;
+}
+
+bool MWindowPropertyCache::shapeIsRectangular()
+{
+    if (!isShaped())
+        return true;
+    if (shape_rectangular < 0)
+        shape_rectangular = shapeRegion().numRects() <= 1 ? 1 : 0;
+    return shape_rectangular == 1;
+}
+
+bool MWindowPropertyCache::shapeCovers(const QRect &r)
+{
+    for (int i = 0; i < shape_covers_n; ++i)
+        if (shape_covers[i].rect == r)
+            return shape_covers[i].covers;
+
+    bool covers;
+    if (shapeIsRectangular())
+        covers = shapeRegion().boundingRect().contains(r);
+    else
+        covers = QRegion(r).subtracted(shapeRegion()).isEmpty();
+    shape_covers[1] = shape_covers[0];
+    shape_covers[0].rect = r;
+    shape_covers[0].covers = covers;
+    if (shape_covers_n < 2)
+        shape_covers_n++;
+    return covers;
+}
+
 const QRegion &MWindowPropertyCache::customRegion(bool request_only)
 {
     if (!is_valid) {
@@ -359,11 +674,12 @@ const QRegion &MWindowPropertyCache::customRegion(bool request_only)
         xcb_custom_region_cookie = xcb_get_property(xcb_conn, 0, window,
                                          ATOM(_MEEGOTOUCH_CUSTOM_REGION),
                                          XCB_ATOM_CARDINAL, 0, 10 * 4);
+        requestFired(xcb_custom_region_cookie.sequence);
         custom_region_request_fired = true;
     }
     if (!request_only && custom_region_request_fired) {
         xcb_get_property_reply_t *r;
-        r = xcb_get_property_reply(xcb_conn, xcb_custom_region_cookie, 0);
+        r = propertyReply(xcb_custom_region_cookie);
         custom_region_request_fired = false;
         if (custom_region)
             delete custom_region;
@@ -389,7 +705,7 @@ Window MWindowPropertyCache::transientFor()
 {
     if (is_valid && transient_for == (Window)-1) {
         xcb_get_property_reply_t *r;
-        r = xcb_get_property_reply(xcb_conn, xcb_transient_for_cookie, 0);
+        r = propertyReply(xcb_transient_for_cookie);
         if (r) {
             if (xcb_get_property_value_length(r) == sizeof(Window))
                 transient_for = *((Window*)xcb_get_property_value(r));
@@ -401,8 +717,8 @@ Window MWindowPropertyCache::transientFor()
             if (transient_for) {
                 MCompositeManager *m = (MCompositeManager*)qApp;
                 // add reference to the "parent"
-                MWindowPropertyCache *p = m->d->prop_caches.value(
-                                                        transient_for, 0);
+                MWindowPropertyCache *p = m->d->registry.propertyCache(
+                                                        transient_for);
                 if (p) p->transients.append(window);
                 // need to check stacking again to make sure the "parent" is
                 // stacked according to the changed transient window list
@@ -416,36 +732,12 @@ Window MWindowPropertyCache::transientFor()
 
 int MWindowPropertyCache::cannotMinimize()
 {
-    if (is_valid && cannot_minimize < 0) {
-        xcb_get_property_reply_t *r;
-        r = xcb_get_property_reply(xcb_conn, xcb_cannot_minimize_cookie, 0);
-        if (r) {
-            if (xcb_get_property_value_length(r) == sizeof(CARD32))
-                cannot_minimize = *((CARD32*)xcb_get_property_value(r));
-            else
-                cannot_minimize = 0;
-            free(r);
-        } else
-            cannot_minimize = 0;
-    }
-    return cannot_minimize;
+    return is_valid ? cardinalProperty(cannot_minimize_prop) : -1;
 }
 
 int MWindowPropertyCache::alwaysMapped()
 {
-    if (is_valid && always_mapped < 0) {
-        xcb_get_property_reply_t *r;
-        r = xcb_get_property_reply(xcb_conn, xcb_always_mapped_cookie, 0);
-        if (r) {
-            if (xcb_get_property_value_length(r) == sizeof(CARD32))
-                always_mapped = *((CARD32*)xcb_get_property_value(r));
-            else
-                always_mapped = 0;
-            free(r);
-        } else
-            always_mapped = 0;
-    }
-    return always_mapped;
+    return is_valid ? cardinalProperty(always_mapped_prop) : -1;
 }
 
 int MWindowPropertyCache::desktopView(bool request_only)
@@ -480,7 +772,7 @@ bool MWindowPropertyCache::isDecorator()
 {
     if (is_valid && is_decorator < 0) {
         xcb_get_property_reply_t *r;
-        r = xcb_get_property_reply(xcb_conn, xcb_is_decorator_cookie, 0);
+        r = propertyReply(xcb_is_decorator_cookie);
         if (r) {
             if (xcb_get_property_value_length(r) == sizeof(CARD32))
                 is_decorator = *((CARD32*)xcb_get_property_value(r));
@@ -497,7 +789,7 @@ unsigned int MWindowPropertyCache::meegoStackingLayer()
 {
     if (is_valid && meego_layer < 0) {
         xcb_get_property_reply_t *r;
-        r = xcb_get_property_reply(xcb_conn, xcb_meego_layer_cookie, 0);
+        r = propertyReply(xcb_meego_layer_cookie);
         if (r) {
             if (xcb_get_property_value_length(r) == sizeof(CARD32))
                 meego_layer = *((CARD32*)xcb_get_property_value(r));
@@ -555,7 +847,7 @@ const XWMHints &MWindowPropertyCache::getWMHints()
     }
     if (!wmhints) {
         xcb_get_property_reply_t *r;
-        r = xcb_get_property_reply(xcb_conn, xcb_wm_hints_cookie, 0);
+        r = propertyReply(xcb_wm_hints_cookie);
         int len;
         if (!r)
             goto empty_value;
@@ -579,6 +871,14 @@ bool MWindowPropertyCache::propertyEvent(XPropertyEvent *e)
 {
     if (!is_valid)
         return false;
+    for (int i = 0; i < registry.size(); ++i)
+        if (registry.at(i).atom == e->atom) {
+            // refetch if somebody has been interested in the value
+            if (i < properties.size()
+                && (properties.at(i).valid || properties.at(i).sequence))
+                fetchProperty(i);
+            emit propertyChanged(this, e->atom);
+        }
     if (e->atom == ATOM(WM_TRANSIENT_FOR)) {
         if (transient_for == (Window)-1)
             // collect the old reply
@@ -586,31 +886,17 @@ bool MWindowPropertyCache::propertyEvent(XPropertyEvent *e)
         if (transient_for && transient_for != (Window)-1) {
             MCompositeManager *m = (MCompositeManager*)qApp;
             // remove reference from the old "parent"
-            MWindowPropertyCache *p = m->d->prop_caches.value(transient_for, 0);
+            MWindowPropertyCache *p = m->d->registry.propertyCache(transient_for);
             if (p) p->transients.removeAll(window);
         }
         transient_for = (Window)-1;
         xcb_transient_for_cookie = xcb_get_property(xcb_conn, 0, window,
                                                     XCB_ATOM_WM_TRANSIENT_FOR,
                                                     XCB_ATOM_WINDOW, 0, 1);
+        requestFired(xcb_transient_for_cookie.sequence);
         return true;
     } else if (e->atom == ATOM(_MEEGOTOUCH_ALWAYS_MAPPED)) {
-        if (always_mapped < 0)
-            // collect the old reply
-            alwaysMapped();
-        always_mapped = -1;
-        xcb_always_mapped_cookie = xcb_get_property(xcb_conn, 0, window,
-                                           ATOM(_MEEGOTOUCH_ALWAYS_MAPPED),
-                                           XCB_ATOM_CARDINAL, 0, 1);
         emit alwaysMappedChanged(this);
-    } else if (e->atom == ATOM(_MEEGOTOUCH_CANNOT_MINIMIZE)) {
-        if (cannot_minimize < 0)
-            // collect the old reply
-            cannotMinimize();
-        cannot_minimize = -1;
-        xcb_cannot_minimize_cookie = xcb_get_property(xcb_conn, 0, window,
-                                           ATOM(_MEEGOTOUCH_CANNOT_MINIMIZE),
-                                           XCB_ATOM_CARDINAL, 0, 1);
     } else if (e->atom == ATOM(_MEEGOTOUCH_DESKTOP_VIEW)) {
         emit desktopViewChanged(this);
     } else if (e->atom == ATOM(WM_HINTS)) {
@@ -621,6 +907,7 @@ bool MWindowPropertyCache::propertyEvent(XPropertyEvent *e)
         wmhints = 0;
         xcb_wm_hints_cookie = xcb_get_property(xcb_conn, 0, window,
                                   XCB_ATOM_WM_HINTS, XCB_ATOM_WM_HINTS, 0, 10);
+        requestFired(xcb_wm_hints_cookie.sequence);
         return true;
     } else if (e->atom == ATOM(_NET_WM_WINDOW_TYPE)) {
         if (window_type == MCompAtoms::INVALID)
@@ -630,6 +917,7 @@ bool MWindowPropertyCache::propertyEvent(XPropertyEvent *e)
         xcb_window_type_cookie = xcb_get_property(xcb_conn, 0, window,
                                                   ATOM(_NET_WM_WINDOW_TYPE),
                                                   XCB_ATOM_ATOM, 0, MAX_TYPES);
+        requestFired(xcb_window_type_cookie.sequence);
     } else if (e->atom == ATOM(_NET_WM_ICON_GEOMETRY)) {
         if (!icon_geometry_valid)
             // collect the old reply
@@ -638,23 +926,8 @@ bool MWindowPropertyCache::propertyEvent(XPropertyEvent *e)
         xcb_icon_geom_cookie = xcb_get_property(xcb_conn, 0, window,
                                             ATOM(_NET_WM_ICON_GEOMETRY),
                                             XCB_ATOM_CARDINAL, 0, 4);
+        requestFired(xcb_icon_geom_cookie.sequence);
         emit iconGeometryUpdated();
-    } else if (e->atom == ATOM(_MEEGOTOUCH_GLOBAL_ALPHA)) {
-        if (global_alpha < 0)
-            // collect the old reply
-            globalAlpha();
-        global_alpha = -1;
-        xcb_global_alpha_cookie = xcb_get_property(xcb_conn, 0, window,
-                                       ATOM(_MEEGOTOUCH_GLOBAL_ALPHA),
-                                       XCB_ATOM_CARDINAL, 0, 1);
-    } else if (e->atom == ATOM(_MEEGOTOUCH_VIDEO_ALPHA)) {
-        if (video_global_alpha < 0)
-            // collect the old reply
-            videoGlobalAlpha();
-        video_global_alpha = -1;
-        xcb_video_global_alpha_cookie = xcb_get_property(xcb_conn, 0, window,
-                                       ATOM(_MEEGOTOUCH_VIDEO_ALPHA),
-                                       XCB_ATOM_CARDINAL, 0, 1);
     } else if (e->atom == ATOM(_MEEGOTOUCH_DECORATOR_BUTTONS)) {
         if (!decor_buttons_valid)
             // collect the old reply
@@ -663,17 +936,14 @@ bool MWindowPropertyCache::propertyEvent(XPropertyEvent *e)
         xcb_decor_buttons_cookie = xcb_get_property(xcb_conn, 0, window,
                                        ATOM(_MEEGOTOUCH_DECORATOR_BUTTONS),
                                        XCB_ATOM_CARDINAL, 0, 8);
+        requestFired(xcb_decor_buttons_cookie.sequence);
         emit meegoDecoratorButtonsChanged(window);
-    } else if (e->atom == ATOM(_MEEGOTOUCH_ORIENTATION_ANGLE)) {
-        xcb_discard_reply(xcb_conn, xcb_orientation_angle_cookie.sequence);
-        xcb_orientation_angle_cookie = xcb_get_property(xcb_conn, 0, window,
-                                    ATOM(_MEEGOTOUCH_ORIENTATION_ANGLE),
-                                    XCB_ATOM_CARDINAL, 0, 1);
     } else if (e->atom == ATOM(_MEEGOTOUCH_MSTATUSBAR_GEOMETRY)) {
-        xcb_discard_reply(xcb_conn, xcb_statusbar_cookie.sequence);
+        discardReply(xcb_statusbar_cookie.sequence);
         xcb_statusbar_cookie = xcb_get_property(xcb_conn, 0, window,
                                     ATOM(_MEEGOTOUCH_MSTATUSBAR_GEOMETRY),
                                     XCB_ATOM_CARDINAL, 0, 4);
+        requestFired(xcb_statusbar_cookie.sequence);
     } else if (e->atom == ATOM(WM_PROTOCOLS)) {
         if (!wm_protocols_valid)
             // collect the old reply
@@ -682,6 +952,7 @@ bool MWindowPropertyCache::propertyEvent(XPropertyEvent *e)
         xcb_wm_protocols_cookie = xcb_get_property(xcb_conn, 0, window,
                                                    ATOM(WM_PROTOCOLS),
                                                    XCB_ATOM_ATOM, 0, 100);
+        requestFired(xcb_wm_protocols_cookie.sequence);
     } else if (e->atom == ATOM(_NET_WM_STATE)) {
         if (!net_wm_state_valid)
             // collect the old reply
@@ -690,12 +961,16 @@ bool MWindowPropertyCache::propertyEvent(XPropertyEvent *e)
         xcb_net_wm_state_cookie = xcb_get_property(xcb_conn, 0, window,
                                                    ATOM(_NET_WM_STATE),
                                                    XCB_ATOM_ATOM, 0, 100);
+        requestFired(xcb_net_wm_state_cookie.sequence);
+        // fullscreen affects stacking, unredirection and the decorator
+        return true;
     } else if (e->atom == ATOM(WM_STATE)) {
         if (wm_state_query)
             // collect the old reply
             windowState();
         xcb_wm_state_cookie = xcb_get_property(xcb_conn, 0, window,
                                   ATOM(WM_STATE), ATOM(WM_STATE), 0, 1);
+        requestFired(xcb_wm_state_cookie.sequence);
         wm_state_query = true;
         return true;
     } else if (e->atom == ATOM(_MEEGO_STACKING_LAYER)) {
@@ -706,6 +981,7 @@ bool MWindowPropertyCache::propertyEvent(XPropertyEvent *e)
         xcb_meego_layer_cookie = xcb_get_property(xcb_conn, 0, window,
                                                   ATOM(_MEEGO_STACKING_LAYER),
                                                   XCB_ATOM_CARDINAL, 0, 1);
+        requestFired(xcb_meego_layer_cookie.sequence);
         if (window_state == NormalState) {
             // raise it so that it becomes on top of same-leveled windows
             MCompositeManager *m = (MCompositeManager*)qApp;
@@ -722,7 +998,7 @@ int MWindowPropertyCache::windowState()
 {
     if (wm_state_query) {
         xcb_get_property_reply_t *r;
-        r = xcb_get_property_reply(xcb_conn, xcb_wm_state_cookie, 0);
+        r = propertyReply(xcb_wm_state_cookie);
         if (r && (unsigned)xcb_get_property_value_length(r) >= sizeof(CARD32))
             window_state = ((CARD32*)xcb_get_property_value(r))[0];
         else {
@@ -738,7 +1014,7 @@ int MWindowPropertyCache::windowState()
 void MWindowPropertyCache::buttonGeometryHelper()
 {
     xcb_get_property_reply_t *r;
-    r = xcb_get_property_reply(xcb_conn, xcb_decor_buttons_cookie, 0);
+    r = propertyReply(xcb_decor_buttons_cookie);
     if (!r) {
         decor_buttons_valid = true;
         return;
@@ -782,23 +1058,19 @@ const QRect &MWindowPropertyCache::closeButtonGeometry()
     return close_button_geom;
 }
 
-unsigned MWindowPropertyCache::orientationAngle()
+int MWindowPropertyCache::pid()
 {
-    xcb_get_property_reply_t *r;
-
-    if (!xcb_orientation_angle_cookie.sequence)
-        return orientation_angle;
+    return cardinalProperty(pid_prop);
+}
 
-    orientation_angle = 0;
-    r = xcb_get_property_reply(xcb_conn, xcb_orientation_angle_cookie, 0);
-    if (r != NULL) {
-        if (xcb_get_property_value_length(r) == sizeof(CARD32))
-            orientation_angle = *((CARD32*)xcb_get_property_value(r));
-        free(r);
-    }
-    xcb_orientation_angle_cookie.sequence = 0;
+XID MWindowPropertyCache::syncCounter()
+{
+    return cardinalProperty(sync_counter_prop, None);
+}
 
-    return orientation_angle;
+unsigned MWindowPropertyCache::orientationAngle()
+{
+    return cardinalProperty(orientation_angle_prop);
 }
 
 const QRect &MWindowPropertyCache::statusbarGeometry()
@@ -809,7 +1081,7 @@ const QRect &MWindowPropertyCache::statusbarGeometry()
     xcb_get_property_reply_t *r;
     unsigned long x, y, w, h;
     int len;
-    r = xcb_get_property_reply(xcb_conn, xcb_statusbar_cookie, 0);
+    r = propertyReply(xcb_statusbar_cookie);
     if (!r)
         goto failure;
     len = xcb_get_property_value_length(r);
@@ -837,7 +1109,7 @@ const QList<Atom>& MWindowPropertyCache::supportedProtocols()
         return wm_protocols;
 
     xcb_get_property_reply_t *r;
-    r = xcb_get_property_reply(xcb_conn, xcb_wm_protocols_cookie, 0);
+    r = propertyReply(xcb_wm_protocols_cookie);
     if (!r) {
         wm_protocols_valid = true;
         wm_protocols.clear();
@@ -857,7 +1129,7 @@ const QList<Atom> &MWindowPropertyCache::netWmState()
     if (!is_valid || net_wm_state_valid)
         return net_wm_state;
     xcb_get_property_reply_t *r;
-    r = xcb_get_property_reply(xcb_conn, xcb_net_wm_state_cookie, 0);
+    r = propertyReply(xcb_net_wm_state_cookie);
     if (!r) {
         net_wm_state_valid = true;
         net_wm_state.clear();
@@ -877,7 +1149,7 @@ const QRectF &MWindowPropertyCache::iconGeometry()
     if (!is_valid || icon_geometry_valid)
         return icon_geometry;
     xcb_get_property_reply_t *r;
-    r = xcb_get_property_reply(xcb_conn, xcb_icon_geom_cookie, 0);
+    r = propertyReply(xcb_icon_geom_cookie);
     int len;
     if (!r)
         goto empty_geom;
@@ -899,41 +1171,19 @@ empty_geom:
     return icon_geometry;
 }
 
-int MWindowPropertyCache::alphaValue(xcb_get_property_cookie_t c)
-{
-    xcb_get_property_reply_t *r;
-    r = xcb_get_property_reply(xcb_conn, c, 0);
-    if (!r) 
-        return 255;
-    
-    int len = xcb_get_property_value_length(r);
-    if ((unsigned)len < sizeof(CARD32)) {
-        free(r);
-        return 255;
-    }
-
-    /* Map 0..0xFFFFFFFF -> 0..0xFF. */
-    int ret = *(CARD32*)xcb_get_property_value(r) >> 24;
-    free(r);
-    return ret;
-}
-
 int MWindowPropertyCache::globalAlpha()
 {
-    if (!is_valid || global_alpha != -1)
-        return global_alpha;
-    
-    global_alpha = alphaValue(xcb_global_alpha_cookie);
-    return global_alpha;
+    if (!is_valid)
+        return -1;
+    /* Map 0..0xFFFFFFFF -> 0..0xFF. */
+    return cardinalProperty(global_alpha_prop, 0xFFFFFFFF) >> 24;
 }
 
 int MWindowPropertyCache::videoGlobalAlpha()
-{    
-    if (!is_valid || video_global_alpha != -1)
-        return video_global_alpha;
-    
-    video_global_alpha = alphaValue(xcb_video_global_alpha_cookie);
-    return video_global_alpha;
+{
+    if (!is_valid)
+        return -1;
+    return cardinalProperty(video_global_alpha_prop, 0xFFFFFFFF) >> 24;
 }
 
 MCompAtoms::Type MWindowPropertyCache::windowType()
@@ -943,7 +1193,7 @@ MCompAtoms::Type MWindowPropertyCache::windowType()
 
     QVector<Atom> a(MAX_TYPES);
     xcb_get_property_reply_t *r;
-    r = xcb_get_property_reply(xcb_conn, xcb_window_type_cookie, 0);
+    r = propertyReply(xcb_window_type_cookie);
     if (r) {
         int len = xcb_get_property_value_length(r);
         if (len >= (int)sizeof(Atom)) {
@@ -952,11 +1202,13 @@ MCompAtoms::Type MWindowPropertyCache::windowType()
         } else {
             free(r);
             window_type = MCompAtoms::NORMAL;
+            window_type_atom = ATOM(_NET_WM_WINDOW_TYPE_NORMAL);
             return window_type;
         }
         free(r);
     } else {
         window_type = MCompAtoms::NORMAL;
+        window_type_atom = ATOM(_NET_WM_WINDOW_TYPE_NORMAL);
         return window_type;
     }
 
@@ -983,6 +1235,10 @@ MCompAtoms::Type MWindowPropertyCache::windowType()
         window_type = MCompAtoms::UNKNOWN;
     else // fdo spec suggests unknown non-transients must be normal
         window_type = MCompAtoms::NORMAL;
+    if (window_type == MCompAtoms::NORMAL)
+        window_type_atom = ATOM(_NET_WM_WINDOW_TYPE_NORMAL);
+    else
+        window_type_atom = a[0];
     return window_type;
 }
 
@@ -21,6 +21,8 @@
 #define MWINDOWPROPERTYCACHE_H
 
 #include <QRegion>
+#include <QHash>
+#include <QVector>
 #include <QX11Info>
 #include <X11/Xutil.h>
 #include <X11/Xlib-xcb.h>
@@ -29,6 +31,7 @@
 #include <X11/extensions/shape.h>
 #include <X11/extensions/Xdamage.h>
 #include "mcompatoms_p.h"
+#include "mobjectpool.h"
 
 /*!
  * This is a class for caching window property values for a window.
@@ -49,9 +52,24 @@ public:
                          Damage damage_obj = 0);
     virtual ~MWindowPropertyCache();
 
-    Atom windowTypeAtom() const { return window_type_atom; }
+    // allocated from a pool, see MObjectPool
+    static void *operator new(size_t size)
+        { return MObjectPool<MWindowPropertyCache>::allocate(size); }
+    static void operator delete(void *p, size_t size)
+        { MObjectPool<MWindowPropertyCache>::release(p, size); }
+
+    /*!
+     * Returns the approximate number of bytes used by this object and
+     * the data it holds.
+     */
+    int memoryUsage() const;
 
-    void setWindowTypeAtom(Atom atom) { window_type_atom = atom; }
+    /*!
+     * Returns the first atom of _NET_WM_WINDOW_TYPE, or
+     * _NET_WM_WINDOW_TYPE_NORMAL if windowType() is NORMAL.  Only valid
+     * after windowType() has been called.
+     */
+    Atom windowTypeAtom() const { return window_type_atom; }
 
     void setRequestedGeometry(const QRect &rect) {
         req_geom = rect;
@@ -65,21 +83,22 @@ public:
         if (!is_valid)
             return;
         if (!xcb_real_geom)
-            xcb_real_geom = xcb_get_geometry_reply(xcb_conn,
-                                                   xcb_real_geom_cookie, 0);
+            xcb_real_geom = (xcb_get_geometry_reply_t*)
+                            takeReply(xcb_real_geom_cookie.sequence);
         real_geom_valid = true;
+        if (real_geom.size() != rect.size() && is_shaped != 1) {
+            // the default shape follows the size
+            shape_rects_valid = false;
+            shape_covers_n = 0;
+        }
+        if (real_geom.topLeft() != rect.topLeft())
+            root_shape_valid = false;
         real_geom = rect;
-
-        // shape needs to be refreshed in case it was the default value
-        // (i.e. the same as geometry), because there is no ShapeNotify
-        if ((shape_rects_valid && QRegion(real_geom) != shape_region)
-            || !shape_rects_valid)
-            shapeRefresh();
     }
     const QRect realGeometry() {
         if (is_valid && !xcb_real_geom) {
-            xcb_real_geom = xcb_get_geometry_reply(xcb_conn,
-                                                   xcb_real_geom_cookie, 0);
+            xcb_real_geom = (xcb_get_geometry_reply_t*)
+                            takeReply(xcb_real_geom_cookie.sequence);
             if (xcb_real_geom && !real_geom_valid) {
                 real_geom = QRect(xcb_real_geom->x, xcb_real_geom->y,
                                   xcb_real_geom->width, xcb_real_geom->height);
@@ -88,16 +107,41 @@ public:
         }
         return real_geom;
     }
+
+    /*!
+     * Returns the bounding shape of the window in window coordinates.
+     * Windows without one get the default shape, (0, 0, width, height).
+     * Use isShaped() and shapeCovers() where they are enough.
+     */
     const QRegion &shapeRegion();
-    void shapeRefresh() {
-        if (!is_valid)
-            return;
-        if (!shape_rects_valid)
-            shapeRegion();
-        shape_rects_valid = false;
-        xcb_shape_rects_cookie = xcb_shape_get_rectangles(xcb_conn, window,
-                                                          ShapeBounding);
-    }
+
+    /*!
+     * Returns shapeRegion() in root coordinates.  It's kept until the
+     * window moves or its shape changes.
+     */
+    const QRegion &rootShapeRegion();
+
+    /*!
+     * Returns true if the window has a bounding shape set with the Shape
+     * extension.  Only those windows have their rectangles fetched.
+     */
+    bool isShaped();
+
+    /*!
+     * Returns true if the bounding shape is a single rectangle.
+     */
+    bool shapeIsRectangular();
+
+    /*!
+     * Returns true if the bounding shape contains \a r, in window
+     * coordinates.  The answers for the last two rectangles are cached
+     * until the shape or the size changes, so it is cheap to ask with
+     * the same rectangles (e.g. the screen) over and over.
+     */
+    bool shapeCovers(const QRect &r);
+
+    // called on ShapeNotify with the event's shaped flag
+    void shapeRefresh(bool shaped);
 
     Window winId() const { return window; }
     Window parentWindow() const { return parent_window; }
@@ -231,6 +275,16 @@ public:
      */
     unsigned orientationAngle();
 
+    /*!
+     * Returns the value of _NET_WM_PID or 0.
+     */
+    int pid();
+
+    /*!
+     * Returns the value of _NET_WM_SYNC_REQUEST_COUNTER or None.
+     */
+    XID syncCounter();
+
     /*!
      * Returns the value of _MEEGOTOUCH_MSTATUSBAR_GEOMETRY.
      */
@@ -242,6 +296,52 @@ public:
      */
     bool propertyEvent(XPropertyEvent *e);
 
+    /*!
+     * Picks up the replies that have arrived for this window without
+     * blocking, so that the getters don't need to wait for them.
+     * Returns true if there are still replies on their way.
+     */
+    bool collectReplies();
+
+    /*!
+     * Returns true if the properties that the stacking order depends on
+     * (transiency, type, stacking layer, WM_STATE, _NET_WM_STATE and
+     * decorator-ness) can be read without waiting for the X server.
+     */
+    bool stackingAttributesReady() const;
+
+    /*!
+     * Registers a property to be cached for every window.  The value of
+     * at most \a max_len 32-bit units of type \a type is requested when
+     * the cache is created if \a prefetch is true, otherwise the first
+     * time it is asked for, and refetched on PropertyNotify.  Returns a
+     * handle for propertyData() that is valid for all windows.
+     */
+    static int registerProperty(Atom atom, Atom type, unsigned max_len,
+                                bool prefetch = true);
+
+    /*!
+     * Returns the raw value of a registered property, empty if unset.
+     */
+    const QByteArray &propertyData(int handle);
+
+    /*!
+     * Returns the first CARDINAL of a registered property, or \a def.
+     */
+    unsigned cardinalProperty(int handle, unsigned def = 0);
+
+    /*!
+     * Returns a registered property of type ATOM as a list.  It is
+     * decoded once per value, so it's cheap to ask repeatedly.
+     */
+    const QList<Atom> &atomListProperty(int handle);
+
+    /*!
+     * Returns a registered STRING or UTF8_STRING property up to its
+     * first \0, decoded once per value like atomListProperty().
+     */
+    const QString &stringProperty(int handle);
+
     MCompAtoms::Type windowType();
 
     bool hasAlpha();
@@ -252,6 +352,7 @@ public:
 
     static void set_xcb_connection(xcb_connection_t *c) {
         MWindowPropertyCache::xcb_conn = c;
+        buildVisualFormats();
     }
 
     void damageTracking(bool enabled)
@@ -273,12 +374,27 @@ signals:
     void desktopViewChanged(MWindowPropertyCache *pc);
     void alwaysMappedChanged(MWindowPropertyCache *pc);
     void customRegionChanged(MWindowPropertyCache *pc);
+    // emitted on PropertyNotify of a registered property
+    void propertyChanged(MWindowPropertyCache *pc, Atom atom);
+    // emitted by collectReplies() when stackingAttributesReady() turns true
+    void repliesReady(MWindowPropertyCache *pc);
 
 private:
     void init();
     void init_invalid();
-    int alphaValue(xcb_get_property_cookie_t c);
     void buttonGeometryHelper();
+    void fetchProperty(int handle);
+    static void registerBuiltinProperties();
+
+    // Every request is registered with requestFired(); the getters fetch
+    // the reply with takeReply(), which only blocks if collectReplies()
+    // has not seen it arrive yet.
+    void requestFired(unsigned int sequence);
+    void *takeReply(unsigned int sequence);
+    void discardReply(unsigned int sequence);
+    xcb_get_property_reply_t *propertyReply(xcb_get_property_cookie_t c) {
+        return (xcb_get_property_reply_t*)takeReply(c.sequence);
+    }
 
     Atom window_type_atom;
     Window transient_for;
@@ -293,8 +409,6 @@ private:
     bool wm_state_query;
     QRectF icon_geometry;
     int has_alpha;
-    int global_alpha;
-    int video_global_alpha;
     int is_decorator;
     QList<Atom> net_wm_state;
     QRect req_geom, real_geom, statusbar_geom;
@@ -304,11 +418,10 @@ private:
     int meego_layer, window_state;
     MCompAtoms::Type window_type;
     Window window, parent_window;
-    int always_mapped, cannot_minimize, desktop_view;
+    int desktop_view;
     bool being_mapped, dont_iconify;
     QRegion *custom_region;
     bool custom_region_request_fired;
-    unsigned orientation_angle;
     // geometry is requested only once in the beginning, after that, we
     // use ConfigureNotifys to update the size through setRealGeometry()
     xcb_get_geometry_reply_t *xcb_real_geom;
@@ -322,19 +435,69 @@ private:
     xcb_get_property_cookie_t xcb_wm_state_cookie;
     xcb_get_property_cookie_t xcb_wm_hints_cookie;
     xcb_get_property_cookie_t xcb_icon_geom_cookie;
-    xcb_get_property_cookie_t xcb_global_alpha_cookie;
-    xcb_get_property_cookie_t xcb_video_global_alpha_cookie;
     xcb_get_property_cookie_t xcb_net_wm_state_cookie;
-    xcb_get_property_cookie_t xcb_always_mapped_cookie;
-    xcb_get_property_cookie_t xcb_cannot_minimize_cookie;
     xcb_get_property_cookie_t xcb_custom_region_cookie;
-    xcb_get_property_cookie_t xcb_orientation_angle_cookie;
     xcb_get_property_cookie_t xcb_statusbar_cookie;
-    xcb_render_query_pict_formats_cookie_t xcb_pict_formats_cookie;
+    xcb_shape_query_extents_cookie_t xcb_shape_extents_cookie;
     xcb_shape_get_rectangles_cookie_t xcb_shape_rects_cookie;
+    // -1 until we know; unshaped windows have their default shape in
+    // shape_region while shape_rects_valid
+    int is_shaped;
     QRegion shape_region;
+    // shape_region translated to realGeometry() while root_shape_valid
+    bool root_shape_valid;
+    QRegion root_shape;
+    int shape_rectangular;
+    // the last two rectangles asked from shapeCovers(), most recent first
+    struct ShapeCovers {
+        QRect rect;
+        bool covers;
+    } shape_covers[2];
+    int shape_covers_n;
+    // sequence numbers of the requests in flight, in the order sent
+    QList<unsigned int> pending_replies;
+    // when pending_replies became non-empty, for MCompositeManagerPrivate's
+    // reply_latency
+    unsigned long long requests_sent;
+    // replies picked up by collectReplies() but not yet used
+    QHash<unsigned int, void*> collected_replies;
+
+    struct PropertyValue {
+        PropertyValue()
+            : sequence(0), valid(false), type(None), decoded(0) {}
+        unsigned int sequence;
+        bool valid;
+        QByteArray data;
+        // the actual type of @data
+        Atom type;
+        // typed values, decoded on demand and cleared with @data
+        enum { Atoms = 1, String = 2 };
+        char decoded;
+        QList<Atom> atoms;
+        QString string;
+    };
+    // per-window values of the registered properties, indexed by handle
+    QVector<PropertyValue> properties;
 
     static xcb_connection_t *xcb_conn;
+
+    struct RegisteredProperty {
+        Atom atom, type;
+        unsigned max_len;
+        bool prefetch;
+    };
+    static QVector<RegisteredProperty> registry;
+    static int always_mapped_prop, cannot_minimize_prop,
+               orientation_angle_prop, global_alpha_prop,
+               video_global_alpha_prop, pid_prop, sync_counter_prop;
+
+    struct VisualFormat {
+        xcb_render_pictformat_t format;
+        bool has_alpha;
+        quint8 depth;
+    };
+    static void buildVisualFormats();
+    static QHash<xcb_visualid_t, VisualFormat> visual_formats;
     Damage damage_object;
 };
 
@@ -0,0 +1,193 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "mwindowregistry.h"
+
+// slots per record
+#define LOAD_FACTOR 2
+
+MWindowRegistry::MWindowRegistry()
+{
+    rehash(64);
+}
+
+void MWindowRegistry::rehash(int size)
+{
+    slots.fill(0, size);
+    shift = 32;
+    for (int n = size; n > 1; n >>= 1)
+        --shift;
+    for (int i = 0; i < records.size(); ++i) {
+        unsigned s = hash(records.at(i).window) >> shift;
+        while (slots.at(s))
+            s = (s + 1) & (size - 1);
+        slots[s] = i + 1;
+    }
+}
+
+int MWindowRegistry::slotOf(Window w) const
+{
+    unsigned mask = slots.size() - 1;
+    unsigned s = hash(w) >> shift;
+    while (slots.at(s) && records.at(slots.at(s) - 1).window != w)
+        s = (s + 1) & mask;
+    return s;
+}
+
+int MWindowRegistry::indexOf(Window w) const
+{
+    unsigned mask = slots.size() - 1;
+    for (unsigned s = hash(w) >> shift; slots.at(s); s = (s + 1) & mask)
+        if (records.at(slots.at(s) - 1).window == w)
+            return slots.at(s) - 1;
+    return -1;
+}
+
+MWindowRegistry::Record &MWindowRegistry::get(Window w)
+{
+    int i = indexOf(w);
+    if (i >= 0)
+        return records[i];
+
+    if ((records.size() + 1) * LOAD_FACTOR > slots.size())
+        rehash(slots.size() * 2);
+    Record r;
+    r.window = w;
+    records.append(r);
+    unsigned mask = slots.size() - 1;
+    unsigned s = hash(w) >> shift;
+    while (slots.at(s))
+        s = (s + 1) & mask;
+    slots[s] = records.size();
+    return records.last();
+}
+
+void MWindowRegistry::drop(Window w)
+{
+    unsigned mask = slots.size() - 1;
+    unsigned s = slotOf(w);
+    if (!slots.at(s))
+        return;
+    const Record &r = records.at(slots.at(s) - 1);
+    if (r.pc || r.cw || r.frame.frame || !r.configure_reqs.isEmpty())
+        // still in use
+        return;
+
+    // move the last record to the hole
+    int i = slots.at(s) - 1, last = records.size() - 1;
+    if (i != last) {
+        unsigned ls = hash(records.at(last).window) >> shift;
+        while (slots.at(ls) != last + 1)
+            ls = (ls + 1) & mask;
+        records[i] = records.at(last);
+        slots[ls] = i + 1;
+    }
+    records.resize(last);
+
+    // close the gap in the probe sequence
+    slots[s] = 0;
+    for (unsigned j = (s + 1) & mask; slots.at(j); j = (j + 1) & mask) {
+        unsigned home = hash(records.at(slots.at(j) - 1).window) >> shift;
+        // move j to s if its home is not cyclically in (s, j]
+        if ((j > s && (home <= s || home > j))
+            || (j < s && (home <= s && home > j))) {
+            slots[s] = slots.at(j);
+            slots[j] = 0;
+            s = j;
+        }
+    }
+}
+
+void MWindowRegistry::setCompositeWindow(Window w, MCompositeWindow *cw)
+{
+    if (cw)
+        get(w).cw = cw;
+    else if (indexOf(w) >= 0) {
+        get(w).cw = 0;
+        drop(w);
+    }
+}
+
+void MWindowRegistry::setPropertyCache(Window w, MWindowPropertyCache *pc)
+{
+    if (pc)
+        get(w).pc = pc;
+    else if (indexOf(w) >= 0) {
+        get(w).pc = 0;
+        drop(w);
+    }
+}
+
+void MWindowRegistry::setFrameData(Window w, const FrameData &fd)
+{
+    get(w).frame = fd;
+}
+
+void MWindowRegistry::removeFrameData(Window w)
+{
+    if (indexOf(w) < 0)
+        return;
+    get(w).frame = FrameData();
+    drop(w);
+}
+
+void MWindowRegistry::addConfigureRequest(const XConfigureRequestEvent &e)
+{
+    get(e.window).configure_reqs.append(e);
+}
+
+QList<XConfigureRequestEvent> MWindowRegistry::takeConfigureRequests(Window w)
+{
+    QList<XConfigureRequestEvent> ret;
+    if (indexOf(w) < 0)
+        return ret;
+    qSwap(ret, get(w).configure_reqs);
+    drop(w);
+    return ret;
+}
+
+void MWindowRegistry::restack(const QList<Window> &stacking_list)
+{
+    // records[0..k) are in their place already
+    int k = 0;
+    for (int i = 0; i < stacking_list.size(); ++i) {
+        int j = indexOf(stacking_list.at(i));
+        // not ours, or a duplicate we have placed already
+        if (j < k)
+            continue;
+        if (j != k) {
+            int sj = slotOf(records.at(j).window);
+            int sk = slotOf(records.at(k).window);
+            qSwap(records[j], records[k]);
+            slots[sj] = k + 1;
+            slots[sk] = j + 1;
+        }
+        ++k;
+    }
+}
+
+QHash<Window, MWindowPropertyCache*> MWindowRegistry::propertyCaches() const
+{
+    QHash<Window, MWindowPropertyCache*> pcs;
+    pcs.reserve(records.size());
+    for (int i = 0; i < records.size(); ++i)
+        if (records.at(i).pc)
+            pcs.insert(records.at(i).window, records.at(i).pc);
+    return pcs;
+}
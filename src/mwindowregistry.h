@@ -0,0 +1,121 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MWINDOWREGISTRY_H
+#define MWINDOWREGISTRY_H
+
+#include <QVector>
+#include <QList>
+#include <QHash>
+#include <X11/Xlib.h>
+
+class MCompositeWindow;
+class MWindowPropertyCache;
+class MSimpleWindowFrame;
+
+/*!
+ * Everything the composite manager keeps about a window, indexed by XID
+ * in one open-addressing table.  The records are stored in one array in
+ * stacking order (see restack()), so walking the stack and looking the
+ * windows up touches little memory.
+ *
+ * Record pointers are valid only until the next change to the registry.
+ */
+class MWindowRegistry
+{
+public:
+    struct FrameData {
+        FrameData(): frame(0), parentWindow(0), mapped(false) {}
+        MSimpleWindowFrame *frame;
+        Window                parentWindow;
+        bool mapped;
+    };
+
+    struct Record {
+        Record(): window(0), pc(0), cw(0) {}
+        Window window;
+        MWindowPropertyCache *pc;
+        MCompositeWindow *cw;
+        FrameData frame;
+        // ConfigureRequests of a window that is not mapped yet
+        QList<XConfigureRequestEvent> configure_reqs;
+    };
+
+    MWindowRegistry();
+
+    const Record *find(Window w) const {
+        int i = indexOf(w);
+        return i < 0 ? 0 : &records.at(i);
+    }
+    MCompositeWindow *compositeWindow(Window w) const {
+        const Record *r = find(w);
+        return r ? r->cw : 0;
+    }
+    MWindowPropertyCache *propertyCache(Window w) const {
+        const Record *r = find(w);
+        return r ? r->pc : 0;
+    }
+    FrameData frameData(Window w) const {
+        const Record *r = find(w);
+        return r ? r->frame : FrameData();
+    }
+    bool hasConfigureRequests(Window w) const {
+        const Record *r = find(w);
+        return r && !r->configure_reqs.isEmpty();
+    }
+
+    // Setting a member to 0 (or removing the frame or configure requests)
+    // drops the record when nothing is left in it.
+    void setCompositeWindow(Window w, MCompositeWindow *cw);
+    void setPropertyCache(Window w, MWindowPropertyCache *pc);
+    void setFrameData(Window w, const FrameData &fd);
+    void removeFrameData(Window w);
+    void addConfigureRequest(const XConfigureRequestEvent &e);
+    QList<XConfigureRequestEvent> takeConfigureRequests(Window w);
+
+    /*!
+     * Reorders the records to follow \a stacking_list, bottom first, in
+     * place.  Windows not in the list are left at the end in no
+     * particular order.
+     */
+    void restack(const QList<Window> &stacking_list);
+
+    // iteration in stacking order
+    int size() const { return records.size(); }
+    const Record &at(int i) const { return records.at(i); }
+
+    // for MCompositeManager::propCaches(), built on each call
+    QHash<Window, MWindowPropertyCache*> propertyCaches() const;
+
+private:
+    static unsigned hash(Window w) { return (unsigned)w * 2654435761U; }
+    int indexOf(Window w) const;
+    // the slot of w, or the free slot where it would go
+    int slotOf(Window w) const;
+    Record &get(Window w);
+    void drop(Window w);
+    void rehash(int size);
+
+    QVector<Record> records;
+    // index + 1 into records, 0 for a free slot; the size is a power of 2
+    QVector<int> slots;
+    int shift;
+};
+
+#endif
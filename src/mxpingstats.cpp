@@ -0,0 +1,130 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "mxpingstats.h"
+#include <QtDebug>
+#include <sys/mman.h>
+#include <errno.h>
+#include <new>
+
+MXPingStats *MXPingStats::segment = 0;
+
+MXPingStats *MXPingStats::create(unsigned interval_msecs)
+{
+    void *mem = mmap(NULL, sizeof(MXPingStats), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        qWarning("%s: mmap: %s", __func__, strerror(errno));
+        return 0;
+    }
+
+    segment = new (mem) MXPingStats;
+    segment->interval_msecs = interval_msecs;
+    segment->sent = 0;
+    segment->nstalls = 0;
+    segment->seq = 0;
+    return segment;
+}
+
+void MXPingStats::pingSent(unsigned long long now)
+{
+    seq++;
+    __sync_synchronize();
+    sent = now;
+    __sync_synchronize();
+    seq++;
+}
+
+void MXPingStats::replyReceived(unsigned long long now)
+{
+    if (!sent)
+        return;
+
+    unsigned long long usecs = now - sent;
+    seq++;
+    __sync_synchronize();
+    rtt.add(usecs);
+    if (usecs >= interval_msecs * 1000ULL) {
+        Stall &s = stalls[nstalls % STALLS];
+        s.start = sent;
+        s.usecs = usecs;
+        nstalls++;
+    }
+    sent = 0;
+    __sync_synchronize();
+    seq++;
+}
+
+// The pinger holds @seq odd only for a few stores, but it may be
+// descheduled or killed in the middle of them, so don't spin forever.
+#define SNAPSHOT_TRIES 1000
+
+bool MXPingStats::snapshot(MXPingStats *copy) const
+{
+    for (int i = 0; i < SNAPSHOT_TRIES; ++i) {
+        unsigned before = seq;
+        if (before & 1)
+            continue;
+        __sync_synchronize();
+        memcpy((void *)copy, (const void *)this, sizeof(*this));
+        __sync_synchronize();
+        if (seq == before)
+            return true;
+    }
+    return false;
+}
+
+void MXPingStats::dump() const
+{
+    MXPingStats s;
+    if (!snapshot(&s)) {
+        qDebug("X server pings: the pinger is stuck updating them");
+        return;
+    }
+
+    unsigned long long now = MLatencyHistogram::now();
+    qDebug("X server pings every %u ms:", s.interval_msecs);
+    s.rtt.dump("  round trip");
+    if (s.sent && now - s.sent >= s.interval_msecs * 1000ULL)
+        qDebug("  stalled for %llu ms now", (now - s.sent) / 1000);
+    qDebug("  %u stalls", s.nstalls);
+    for (unsigned i = s.nstalls > STALLS ? s.nstalls - STALLS : 0;
+         i < s.nstalls; ++i) {
+        const Stall &st = s.stalls[i % STALLS];
+        qDebug("    %llu ms, %llu s ago", st.usecs / 1000,
+               (now - st.start) / 1000000);
+    }
+}
+
+void MXPingStats::print(FILE *out) const
+{
+    MXPingStats s;
+    if (!snapshot(&s)) {
+        fprintf(out, "# x_roundtrip unavailable\n");
+        return;
+    }
+
+    if (s.rtt.count())
+        s.rtt.print(out, "x_roundtrip");
+    fprintf(out, "# x_stall start_us duration_us\n");
+    for (unsigned i = s.nstalls > STALLS ? s.nstalls - STALLS : 0;
+         i < s.nstalls; ++i)
+        fprintf(out, "# x_stall %llu %llu\n", s.stalls[i % STALLS].start,
+                s.stalls[i % STALLS].usecs);
+}
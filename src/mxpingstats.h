@@ -0,0 +1,75 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MXPINGSTATS_H
+#define MXPINGSTATS_H
+
+#include "mlatencyhistogram.h"
+
+/*!
+ * X server round-trip statistics measured by XServerPinger in its own
+ * process and read by the compositor, to tell stalls of the X server
+ * apart from our own.  It lives in a shared anonymous mapping created
+ * before the pinger is forked, so both processes see it at the same
+ * address.  The pinger is the only writer; readers take a snapshot().
+ */
+class MXPingStats
+{
+public:
+    enum { STALLS = 16 };
+
+    //! A ping which wasn't answered within the ping interval.
+    struct Stall
+    {
+        // CLOCK_MONOTONIC in microseconds
+        unsigned long long start, usecs;
+    };
+
+    //! Returns the segment, or NULL if there is no pinger.
+    static MXPingStats *shared() { return segment; }
+    //! Maps the segment; must be called before forking the pinger.
+    static MXPingStats *create(unsigned interval_msecs);
+
+    // For the pinger.
+    void pingSent(unsigned long long now);
+    void replyReceived(unsigned long long now);
+
+    //! Copies the stats consistently with a concurrent writer.  Returns
+    //! false if the writer kept them busy for too long.
+    bool snapshot(MXPingStats *copy) const;
+    void dump() const;
+    //! Prints the round-trip histogram and stalls for the "stats" command.
+    void print(FILE *out) const;
+
+    unsigned interval_msecs;
+    // when the pending ping was sent, or 0
+    unsigned long long sent;
+    // total number of stalls, the last STALLS are in the ring
+    unsigned nstalls;
+    Stall stalls[STALLS];
+    MLatencyHistogram rtt;
+
+private:
+    // odd while the pinger is updating
+    volatile unsigned seq;
+
+    static MXPingStats *segment;
+};
+
+#endif
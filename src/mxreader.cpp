@@ -0,0 +1,183 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "mxreader.h"
+#include <QSocketNotifier>
+#include <QX11Info>
+#include <X11/Xlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+MXReader::MXReader(xcb_connection_t *conn, QObject *parent)
+    : QThread(parent),
+      xcb_conn(conn),
+      quit(0),
+      reply_waiting(0),
+      wake_pending(0)
+{
+    if (pipe(wake_pipe) < 0) {
+        qWarning("%s: pipe: %s", __func__, strerror(errno));
+        wake_pipe[0] = wake_pipe[1] = -1;
+    } else {
+        fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+        connect(new QSocketNotifier(wake_pipe[0], QSocketNotifier::Read,
+                                    this),
+                SIGNAL(activated(int)), SLOT(wakeup(int)));
+    }
+    start();
+}
+
+MXReader::~MXReader()
+{
+    quit.fetchAndStoreOrdered(1);
+    requests_avail.release();
+    wait();
+
+    while (collectOne(false))
+        ;
+    foreach (void *r, arrived)
+        free(r);
+    foreach (unsigned int sequence, direct)
+        xcb_discard_reply(xcb_conn, sequence);
+    if (wake_pipe[0] >= 0) {
+        close(wake_pipe[0]);
+        close(wake_pipe[1]);
+    }
+}
+
+void MXReader::expect(unsigned int sequence)
+{
+    if (!requests.push(sequence)) {
+        // the reader is far behind, don't wait for it
+        direct.insert(sequence);
+        return;
+    }
+    requests_avail.release();
+}
+
+bool MXReader::poll(unsigned int sequence, void **reply)
+{
+    if (direct.contains(sequence)) {
+        xcb_generic_error_t *e = 0;
+        if (!xcb_poll_for_reply(xcb_conn, sequence, reply, &e))
+            return false;
+        if (e)
+            // the property cache handles the missing reply
+            free(e);
+        direct.remove(sequence);
+        return true;
+    }
+
+    while (collectOne(false))
+        ;
+    if (!arrived.contains(sequence))
+        return false;
+    *reply = arrived.take(sequence);
+    return true;
+}
+
+void *MXReader::waitForReply(unsigned int sequence)
+{
+    if (direct.remove(sequence))
+        return xcb_wait_for_reply(xcb_conn, sequence, 0);
+    while (!arrived.contains(sequence))
+        collectOne(true);
+    return arrived.take(sequence);
+}
+
+void MXReader::discard(unsigned int sequence)
+{
+    if (direct.remove(sequence))
+        xcb_discard_reply(xcb_conn, sequence);
+    else if (arrived.contains(sequence))
+        free(arrived.take(sequence));
+    else
+        discarded.insert(sequence);
+}
+
+// Moves one reply from the queue to @arrived, waiting for the reader to
+// post one if @block.
+bool MXReader::collectOne(bool block)
+{
+    Reply r;
+    if (!replies.pop(&r)) {
+        if (!block)
+            return false;
+        // Announce the wait before looking at the queue again, so the
+        // reader either sees it or has pushed before we look.
+        reply_lock.lock();
+        reply_waiting.fetchAndStoreOrdered(1);
+        while (!replies.pop(&r))
+            reply_posted.wait(&reply_lock);
+        reply_waiting.fetchAndStoreOrdered(0);
+        reply_lock.unlock();
+    }
+    if (discarded.remove(r.sequence))
+        free(r.reply);
+    else
+        arrived.insert(r.sequence, r.reply);
+    return true;
+}
+
+void MXReader::wakeup(int fd)
+{
+    char buf[16];
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+    // clear it before the replies are polled so none is left unnoticed
+    wake_pending.fetchAndStoreOrdered(0);
+    // Pull the events the reader has read into Xlib's queue, where the
+    // event dispatcher looks for them before it goes to sleep again.
+    XEventsQueued(QX11Info::display(), QueuedAfterReading);
+    emit repliesArrived();
+}
+
+void MXReader::run()
+{
+    for (;;) {
+        requests_avail.acquire();
+        if (quit.fetchAndAddAcquire(0))
+            break;
+
+        Reply r;
+        xcb_generic_error_t *e = 0;
+        requests.pop(&r.sequence);
+        r.reply = xcb_wait_for_reply(xcb_conn, r.sequence, &e);
+        if (e)
+            // the property cache handles the missing reply
+            free(e);
+        while (!replies.push(r))
+            msleep(1);
+        if (reply_waiting.fetchAndAddOrdered(0)) {
+            // the GUI thread sleeps until the lock is released in wait()
+            reply_lock.lock();
+            reply_posted.wakeOne();
+            reply_lock.unlock();
+        }
+
+        if (wake_pending.testAndSetOrdered(0, 1) && wake_pipe[1] >= 0) {
+            char c = 0;
+            if (write(wake_pipe[1], &c, 1) < 0)
+                wake_pending.fetchAndStoreOrdered(0);
+        }
+    }
+}
@@ -0,0 +1,147 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of mcompositor.
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef MXREADER_H
+#define MXREADER_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QSemaphore>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QHash>
+#include <QSet>
+#include <xcb/xcb.h>
+
+/*!
+ * Bounded single-producer single-consumer queue.  push() and pop() don't
+ * take locks, so the two threads never wait for each other on it; a
+ * consumer that needs to sleep until there is something to pop() has to
+ * arrange that itself.  N must be a power of two.
+ */
+template<class T, unsigned N> class MSpscQueue
+{
+public:
+    MSpscQueue() : head(0), tail(0) {}
+
+    // only called by the producer
+    bool push(const T &v)
+    {
+        unsigned t = (unsigned)tail.fetchAndAddRelaxed(0);
+        if (t - (unsigned)head.fetchAndAddAcquire(0) == N)
+            return false;
+        buf[t % N] = v;
+        tail.fetchAndStoreRelease(t + 1);
+        return true;
+    }
+
+    // only called by the consumer
+    bool pop(T *v)
+    {
+        unsigned h = (unsigned)head.fetchAndAddRelaxed(0);
+        if (h == (unsigned)tail.fetchAndAddAcquire(0))
+            return false;
+        *v = buf[h % N];
+        head.fetchAndStoreRelease(h + 1);
+        return true;
+    }
+
+private:
+    QAtomicInt head, tail;
+    T buf[N];
+};
+
+/*!
+ * Thread waiting for the replies of the property cache's requests on the
+ * shared XCB connection (XCB is thread-safe), so the GUI thread doesn't
+ * have to.  The sequence numbers are handed over with expect() and the
+ * replies come back in the same order; repliesArrived() is emitted in
+ * the GUI thread when there are new ones to poll().
+ *
+ * While waiting the thread also reads the events off the connection,
+ * which XCB queues without the GUI thread noticing, since the socket has
+ * been drained by then.  So the thread wakes the GUI thread after every
+ * wait, and it moves the queued events over to Xlib for its dispatcher.
+ * Replies come in request order and the server answers the property
+ * requests right away, so events are held back at most a round trip.
+ * If the thread has more requests to wait for than fit its queue, the
+ * rest are left to the GUI thread to pick up from XCB itself, so the
+ * GUI thread never waits for the reader to catch up.
+ * Enabled with the -xreader command line option.
+ */
+class MXReader : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit MXReader(xcb_connection_t *conn, QObject *parent = 0);
+    ~MXReader();
+
+    //! Makes the thread wait for the reply of request \a sequence,
+    //! unless it's too much behind.
+    void expect(unsigned int sequence);
+    //! Takes the reply of \a sequence if it has arrived.  Returns false
+    //! if it hasn't.  \a reply is 0 if the request failed.
+    bool poll(unsigned int sequence, void **reply);
+    //! Like poll() but waits for the reply.
+    void *waitForReply(unsigned int sequence);
+    //! Frees the reply of \a sequence whenever it arrives.
+    void discard(unsigned int sequence);
+
+signals:
+    void repliesArrived();
+
+protected:
+    virtual void run();
+
+private slots:
+    void wakeup(int fd);
+
+private:
+    struct Reply {
+        unsigned int sequence;
+        void *reply;
+    };
+    enum { QUEUE_SIZE = 256 };
+    bool collectOne(bool block);
+
+    xcb_connection_t *xcb_conn;
+    // GUI thread -> reader.  The idle reader sleeps on @requests_avail;
+    // releasing it costs the GUI thread an uncontended lock, which is
+    // little next to the round trip the reader saves it.
+    MSpscQueue<unsigned int, QUEUE_SIZE> requests;
+    QSemaphore requests_avail;
+    QAtomicInt quit;
+    // reader -> GUI thread, polled without locking.  Only a GUI thread
+    // which has to wait for a reply sets @reply_waiting and sleeps on
+    // @reply_posted, so the reader takes @reply_lock only then.
+    MSpscQueue<Reply, QUEUE_SIZE> replies;
+    QAtomicInt reply_waiting;
+    QMutex reply_lock;
+    QWaitCondition reply_posted;
+    int wake_pipe[2];
+    QAtomicInt wake_pending;
+    // only touched by the GUI thread
+    QHash<unsigned int, void*> arrived;
+    QSet<unsigned int> discarded;
+    // requests that didn't fit @requests, read by the GUI thread
+    QSet<unsigned int> direct;
+};
+
+#endif
@@ -34,6 +34,7 @@ HEADERS += \
     mcompositewindow.h \
     mwindowpropertycache.h \
     mcompwindowanimator.h \
+    manimationdriver.h \
     mcompositemanager.h \
     msimplewindowframe.h \
     mcompositemanager_p.h \
@@ -42,7 +43,19 @@ HEADERS += \
     mdecoratorframe.h \
     mcompositemanagerextension.h \
     mcompositewindowshadereffect.h \
-    mcompmgrextensionfactory.h
+    mcompmgrextensionfactory.h \
+    mocclusiontracker.h \
+    mstackingrules.h \
+    mobjectpool.h \
+    mwindowregistry.h \
+    mlatencyhistogram.h \
+    mxreader.h \
+    meventlog.h \
+    meventrecorder.h \
+    mstartupprofile.h \
+    mtimerwheel.h \
+    mxpingstats.h \
+    mtrace.h
 
 SOURCES += \
     mtexturepixmapitem_p.cpp \
@@ -50,12 +63,21 @@ SOURCES += \
     mcompositewindow.cpp \
     mwindowpropertycache.cpp \
     mcompwindowanimator.cpp \
+    manimationdriver.cpp \
     mcompositemanager.cpp \
     msimplewindowframe.cpp \
     mdevicestate.cpp \
     mdecoratorframe.cpp \
     mcompositemanagerextension.cpp \
-    mcompositewindowshadereffect.cpp
+    mcompositewindowshadereffect.cpp \
+    mocclusiontracker.cpp \
+    mwindowregistry.cpp \
+    mxreader.cpp \
+    meventrecorder.cpp \
+    mstartupprofile.cpp \
+    mtimerwheel.cpp \
+    mxpingstats.cpp \
+    mtrace.cpp
 
 RESOURCES = tools.qrc
 
@@ -69,6 +91,7 @@ publicHeaders.files += mcompositewindow.h \
                       mcompositewindowshadereffect.h \
                       mcompositemanagerextension.h \
                       mwindowpropertycache.h \
+                      mobjectpool.h \
                       mcompatoms_p.h \
                       mcompmgrextensionfactory.h
 publicHeaders.path = $$M_INSTALL_HEADERS/mcompositor
@@ -77,8 +100,8 @@ INSTALLS += publicHeaders
 target.path += /usr/lib
 INSTALLS += target 
 
-LIBS += -lXdamage -lXcomposite -lXfixes -lX11-xcb -lxcb-render -lxcb-shape \
-        -lXrandr ../decorators/libdecorator/libdecorator.so
+LIBS += -lXdamage -lXcomposite -lXfixes -lXext -lX11-xcb -lxcb-render -lxcb-shape \
+        -lXrandr -lrt ../decorators/libdecorator/libdecorator.so
 
 QMAKE_EXTRA_TARGETS += check
 check.depends = $$TARGET
@@ -19,34 +19,48 @@
 #ifndef TEXTUREPIXMAPSHADERS_H
 #define TEXTUREPIXMAPSHADERS_H
 
+// A window transition (see MWindowTransition) moves the vertices from
+// matWorld to matWorldEnd and scales the opacity from 1 to animOpacity
+// as animStep goes from 0 to 1.
 static const char* TexpVertShaderSource = "\
     attribute highp vec4 inputVertex; \
     attribute lowp  vec2 textureCoord; \
     uniform   highp mat4 matProj; \
     uniform   highp mat4 matWorld; \
+    uniform   highp mat4 matWorldEnd; \
+    uniform   highp float animStep; \
+    uniform   mediump float animOpacity; \
     varying   lowp  vec2 fragTexCoord; \
+    varying   mediump float fragAnimOpacity; \
     void main(void) \
     {\
-            gl_Position = (matProj * matWorld) * inputVertex;\
+            gl_Position = matProj * mix(matWorld * inputVertex, \
+                                        matWorldEnd * inputVertex, \
+                                        animStep);\
             fragTexCoord = textureCoord; \
+            fragAnimOpacity = mix(1.0, animOpacity, animStep); \
     }";
 
 static const char* TexpFragShaderSource = "\
     varying lowp vec2 fragTexCoord;\
+    varying mediump float fragAnimOpacity;\
     uniform sampler2D texture;\
     uniform lowp float opacity;\n\
     void main(void) \
     {\
-            gl_FragColor = texture2D(texture, fragTexCoord) * opacity; \
+            gl_FragColor = texture2D(texture, fragTexCoord) \
+                           * (opacity * fragAnimOpacity); \
     }";
 
 static const char* TexpCustomShaderSource = "\
     varying highp vec2 fragTexCoord;\n\
+    varying mediump float fragAnimOpacity;\n\
     uniform lowp sampler2D texture;\n\
     uniform lowp float opacity;\n\
     void main(void) \n\
     {\n\
-            gl_FragColor = customShader(texture, fragTexCoord) * opacity; \n\
+            gl_FragColor = customShader(texture, fragTexCoord) \n\
+                           * (opacity * fragAnimOpacity); \n\
     }\n\n";
 
 
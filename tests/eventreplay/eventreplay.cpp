@@ -0,0 +1,437 @@
+/* Replays an X event log recorded by mcompositor (started with
+ * -record=<file> or given the "record <file>" remote control command)
+ * against an X server, or prints the statistics of a log.
+ *
+ * Compiling standalone:
+ * g++ -lQtCore -lX11 -Wall -I../../src -I/usr/include/qt4/QtCore/ -I/usr/include/qt4/ eventreplay.cpp -o eventreplay
+ *
+ * Usage: eventreplay [-x speedup] <log>
+ *        eventreplay -s <log>
+ *
+ * Replaying does what the clients did in the recording session: windows
+ * are created, configured, mapped, unmapped and destroyed, properties are
+ * changed, client messages are sent to the root window and damage is
+ * generated by drawing into the windows.  The original delays between the
+ * events are divided by @speedup, 0 means no delays at all.  What the
+ * composite manager did by itself (such as setting WM_STATE or the root
+ * window's properties) is left for the composite manager under test.
+ * Device state changes (display, calls) can't be faked, they are only
+ * printed.
+ *
+ * To reproduce a performance problem, run a fresh mcompositor on Xvfb
+ * with -record=<new log>, replay the original log and compare the output
+ * of -s for the two logs: it has the number of events of each type with
+ * the time the compositor spent handling them, and the number of frames
+ * with their painting time and the intervals between them.
+ * */
+
+#include <QtCore>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+
+#include "meventlog.h"
+
+static Display *dpy;
+static Window root;
+static MEventLogHeader header;
+static int x_errors;
+
+struct ReplayWindow
+{
+    Window id;
+    bool mapped, override_redirect;
+};
+static QHash<quint32, ReplayWindow> windows;
+
+// properties the composite manager maintains itself
+static const char *wm_properties[] = {
+    "WM_STATE", "_NET_WM_ALLOWED_ACTIONS", "_M_WM_INFO",
+    "_M_WM_WINDOW_ZVALUE", NULL
+};
+
+static unsigned long long usecs_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int error_handler(Display *, XErrorEvent *)
+{
+    // windows of the log may be gone already
+    x_errors++;
+    return 0;
+}
+
+static bool read_record(FILE *in, MEventLogRecord *r, QByteArray *payload)
+{
+    if (fread(r, sizeof(*r), 1, in) != 1)
+        return false;
+    payload->resize(r->length);
+    return !r->length || fread(payload->data(), r->length, 1, in) == 1;
+}
+
+// Returns the window standing for @w of the recording session.  Windows
+// created before the recording started are created when first needed.
+static ReplayWindow *lookup(quint32 w, bool create)
+{
+    QHash<quint32, ReplayWindow>::iterator it = windows.find(w);
+    if (it != windows.end())
+        return &it.value();
+    if (!create || !w || w == header.root)
+        return 0;
+
+    ReplayWindow rw;
+    rw.id = XCreateSimpleWindow(dpy, root, 0, 0, header.screen_width,
+                                header.screen_height, 0, 0, 0);
+    XSelectInput(dpy, rw.id, StructureNotifyMask);
+    rw.mapped = rw.override_redirect = false;
+    return &windows.insert(w, rw).value();
+}
+
+static Window translate(quint32 w)
+{
+    if (w == header.root)
+        return root;
+    ReplayWindow *rw = lookup(w, false);
+    return rw ? rw->id : None;
+}
+
+static void create_window(quint32 w, const MEventLogConfigure *c)
+{
+    ReplayWindow rw;
+    XSetWindowAttributes attrs;
+
+    if (windows.contains(w) || c->parent != header.root)
+        // we only know about the top-level windows
+        return;
+    attrs.override_redirect = c->override_redirect;
+    attrs.background_pixel = BlackPixel(dpy, DefaultScreen(dpy));
+    rw.id = XCreateWindow(dpy, root, c->x, c->y,
+                          c->width ? c->width : 1, c->height ? c->height : 1,
+                          0, CopyFromParent, InputOutput, CopyFromParent,
+                          CWOverrideRedirect | CWBackPixel, &attrs);
+    rw.mapped = false;
+    rw.override_redirect = c->override_redirect;
+    windows.insert(w, rw);
+}
+
+static void configure_window(ReplayWindow *rw, const MEventLogConfigure *c,
+                             unsigned mask)
+{
+    XWindowChanges wc;
+
+    wc.x = c->x;
+    wc.y = c->y;
+    wc.width = c->width;
+    wc.height = c->height;
+    wc.stack_mode = c->detail;
+    if (mask & CWSibling) {
+        if ((wc.sibling = translate(c->above)) == None)
+            mask &= ~(CWSibling | CWStackMode);
+    }
+    XConfigureWindow(dpy, rw->id, mask & (CWX | CWY | CWWidth | CWHeight
+                                          | CWSibling | CWStackMode), &wc);
+}
+
+static void change_property(ReplayWindow *rw, const QByteArray &payload)
+{
+    const MEventLogProperty *p = (const MEventLogProperty *)payload.data();
+    const char *s = payload.data() + sizeof(*p);
+    QByteArray name(s, p->name_length);
+    QByteArray type(s + p->name_length, p->type_length);
+    QByteArray value(s + p->name_length + p->type_length, p->value_length);
+
+    for (int i = 0; wm_properties[i]; ++i)
+        if (name == wm_properties[i])
+            return;
+    if (rw->mapped && name == "_NET_WM_STATE")
+        // changed by the composite manager after mapping
+        return;
+
+    Atom a = XInternAtom(dpy, name.constData(), False);
+    if (p->deleted) {
+        XDeleteProperty(dpy, rw->id, a);
+        return;
+    }
+
+    Atom t = XInternAtom(dpy, type.constData(), False);
+    if (t == XA_ATOM) {
+        // reintern the atoms of the value
+        QVector<Atom> atoms;
+        foreach (const QByteArray &an, value.split('\0'))
+            if (!an.isEmpty())
+                atoms.append(XInternAtom(dpy, an.constData(), False));
+        XChangeProperty(dpy, rw->id, a, t, 32, PropModeReplace,
+                        (unsigned char *)atoms.data(), atoms.size());
+    } else if (p->format == 32) {
+        // back to longs, translating the windows
+        QVector<long> longs(value.size() / 4);
+        for (int i = 0; i < longs.size(); ++i) {
+            longs[i] = ((const quint32 *)value.constData())[i];
+            if (t == XA_WINDOW)
+                longs[i] = translate(longs[i]);
+        }
+        XChangeProperty(dpy, rw->id, a, t, 32, PropModeReplace,
+                        (unsigned char *)longs.data(), longs.size());
+    } else if (p->format == 16) {
+        QVector<short> shorts(value.size() / 2);
+        for (int i = 0; i < shorts.size(); ++i)
+            shorts[i] = ((const quint16 *)value.constData())[i];
+        XChangeProperty(dpy, rw->id, a, t, 16, PropModeReplace,
+                        (unsigned char *)shorts.data(), shorts.size());
+    } else
+        XChangeProperty(dpy, rw->id, a, t, 8, PropModeReplace,
+                        (unsigned char *)value.constData(), value.size());
+}
+
+static void send_client_message(quint32 w, const QByteArray &payload)
+{
+    const MEventLogClientMessage *m =
+        (const MEventLogClientMessage *)payload.data();
+    const char *s = payload.data() + sizeof(*m);
+    QList<QByteArray> atoms = QByteArray(s + m->name_length,
+                                         payload.size() - sizeof(*m)
+                                         - m->name_length).split('\0');
+    XEvent ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.xclient.type = ClientMessage;
+    if ((ev.xclient.window = translate(w)) == None)
+        return;
+    ev.xclient.message_type = XInternAtom(dpy,
+                                          QByteArray(s, m->name_length)
+                                          .constData(), False);
+    ev.xclient.format = m->format;
+    for (int i = 0, j = 0; i < 5; ++i)
+        if ((m->atoms & (1 << i)) && j < atoms.size())
+            ev.xclient.data.l[i] = XInternAtom(dpy, atoms[j++].constData(),
+                                               False);
+        else
+            ev.xclient.data.l[i] = m->data[i];
+    XSendEvent(dpy, root, False,
+               SubstructureRedirectMask | SubstructureNotifyMask, &ev);
+}
+
+// Does what the client did to cause @r.  Returns whether anything was
+// sent to the X server.
+static bool replay_record(const MEventLogRecord &r, const QByteArray &payload)
+{
+    const MEventLogConfigure *c = (const MEventLogConfigure *)payload.data();
+    const MEventLogMap *m = (const MEventLogMap *)payload.data();
+    ReplayWindow *rw;
+
+    switch (r.type) {
+    case CreateNotify:
+        create_window(r.window, c);
+        return true;
+    case ConfigureRequest:
+        if (!(rw = lookup(r.window, true)))
+            return false;
+        configure_window(rw, c, c->value_mask);
+        return true;
+    case ConfigureNotify:
+        // only override-redirect windows are configured directly
+        if (!c->override_redirect || !(rw = lookup(r.window, false)))
+            return false;
+        configure_window(rw, c, CWX | CWY | CWWidth | CWHeight);
+        return true;
+    case MapRequest:
+        if (!(rw = lookup(r.window, true)) || rw->mapped)
+            return false;
+        XMapWindow(dpy, rw->id);
+        rw->mapped = true;
+        return true;
+    case MapNotify:
+        // others were mapped by the MapRequest or by the compositor
+        if (!m->override_redirect || !(rw = lookup(r.window, false))
+            || rw->mapped)
+            return false;
+        XMapWindow(dpy, rw->id);
+        rw->mapped = true;
+        return true;
+    case UnmapNotify:
+        if (!(rw = lookup(r.window, false)) || !rw->mapped)
+            return false;
+        XUnmapWindow(dpy, rw->id);
+        rw->mapped = false;
+        return true;
+    case DestroyNotify:
+        if (!(rw = lookup(r.window, false)))
+            return false;
+        XDestroyWindow(dpy, rw->id);
+        windows.remove(r.window);
+        return true;
+    case PropertyNotify:
+        if (r.window == header.root || !(rw = lookup(r.window, true)))
+            return false;
+        change_property(rw, payload);
+        return true;
+    case ClientMessage:
+        send_client_message(r.window, payload);
+        return true;
+    case MEventLogRecord::Damage: {
+        const MEventLogRect *d = (const MEventLogRect *)payload.data();
+        if (!(rw = lookup(r.window, false)) || !rw->mapped)
+            return false;
+        XFillRectangle(dpy, rw->id, DefaultGC(dpy, DefaultScreen(dpy)),
+                       d->x, d->y, d->width, d->height);
+        return true;
+    }
+    case MEventLogRecord::DeviceState: {
+        const MEventLogDeviceState *s =
+            (const MEventLogDeviceState *)payload.data();
+        printf("device state: display %s, call %s\n",
+               s->display_off ? "off" : "on",
+               s->call_ongoing ? "ongoing" : "none");
+        return false;
+    }
+    default:
+        return false;
+    }
+}
+
+static int replay(FILE *in, double speedup)
+{
+    MEventLogRecord r;
+    QByteArray payload;
+    unsigned long long start, recorded = 0, max_lag = 0;
+    unsigned records = 0, requests = 0;
+
+    if (!(dpy = XOpenDisplay(NULL))) {
+        fprintf(stderr, "cannot open display\n");
+        return 1;
+    }
+    root = DefaultRootWindow(dpy);
+    XSetErrorHandler(error_handler);
+    if (DisplayWidth(dpy, DefaultScreen(dpy)) != header.screen_width
+        || DisplayHeight(dpy, DefaultScreen(dpy)) != header.screen_height)
+        printf("warning: the log was recorded on a %ux%u screen\n",
+               header.screen_width, header.screen_height);
+
+    start = usecs_now();
+    while (read_record(in, &r, &payload)) {
+        records++;
+        recorded += r.usecs;
+        if (speedup > 0) {
+            unsigned long long due = start + recorded / speedup;
+            unsigned long long now = usecs_now();
+            if (now < due) {
+                XFlush(dpy);
+                usleep(due - now);
+            } else if (now - due > max_lag)
+                max_lag = now - due;
+        }
+        if (replay_record(r, payload))
+            requests++;
+    }
+    XSync(dpy, False);
+
+    printf("%u records, %u replayed in %.3f s (recorded in %.3f s), "
+           "max %.3f ms behind, %d X errors\n", records, requests,
+           (usecs_now() - start) / 1e6, recorded / 1e6, max_lag / 1e3,
+           x_errors);
+    XCloseDisplay(dpy);
+    return 0;
+}
+
+static int statistics(FILE *in)
+{
+    struct Stat {
+        unsigned count;
+        unsigned long long total, max;
+    } stats[256];
+    QVector<unsigned> intervals;
+    MEventLogRecord r;
+    QByteArray payload;
+    unsigned long long t = 0, last_frame = 0;
+
+    memset(stats, 0, sizeof(stats));
+    while (read_record(in, &r, &payload)) {
+        Stat &s = stats[r.type & 0xff];
+        t += r.usecs;
+        s.count++;
+        s.total += r.handler_usecs;
+        if (r.handler_usecs > s.max)
+            s.max = r.handler_usecs;
+        if (r.type == MEventLogRecord::Frame) {
+            if (last_frame)
+                intervals.append(t - last_frame);
+            last_frame = t;
+        }
+    }
+
+    printf("%.3f s recorded\n", t / 1e6);
+    printf("%-18s %8s %10s %8s %8s\n", "event", "count", "total ms",
+           "avg us", "max us");
+    for (int i = 0; i < 256; ++i) {
+        if (!stats[i].count || i == MEventLogRecord::Frame
+            || i == MEventLogRecord::DeviceState
+            || i == MEventLogRecord::Clock)
+            continue;
+        printf("%-18s %8u %10.3f %8llu %8llu\n", MEventLogRecord::typeName(i),
+               stats[i].count, stats[i].total / 1e3,
+               stats[i].total / stats[i].count, stats[i].max);
+    }
+
+    const Stat &f = stats[MEventLogRecord::Frame];
+    if (!f.count) {
+        printf("no frames\n");
+        return 0;
+    }
+    printf("%u frames, %.1f fps, painting avg %llu us, max %llu us\n",
+           f.count, t ? f.count * 1e6 / t : 0.0, f.total / f.count, f.max);
+    if (!intervals.isEmpty()) {
+        qSort(intervals);
+        printf("frame intervals: median %.3f ms, 95%% %.3f ms, "
+               "max %.3f ms\n", intervals[intervals.size() / 2] / 1e3,
+               intervals[intervals.size() * 95 / 100] / 1e3,
+               intervals.last() / 1e3);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    double speedup = 1;
+    bool stats = false, usage = false;
+    const char *fname = NULL;
+    FILE *in;
+    int ret;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-x") && i + 1 < argc)
+            speedup = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-s"))
+            stats = true;
+        else if (!fname && argv[i][0] != '-')
+            fname = argv[i];
+        else
+            usage = true;
+    }
+    if (!fname || usage) {
+        printf("usage: %s [-x speedup] <log>\n"
+               "       %s -s <log>\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    if (!(in = fopen(fname, "r"))) {
+        perror(fname);
+        return 1;
+    }
+    if (fread(&header, sizeof(header), 1, in) != 1
+        || memcmp(header.magic, MEVENTLOG_MAGIC, sizeof(header.magic))
+        || header.version != MEVENTLOG_VERSION) {
+        fprintf(stderr, "%s: not an event log of this version\n", fname);
+        return 1;
+    }
+
+    ret = stats ? statistics(in) : replay(in, speedup);
+    fclose(in);
+    return ret;
+}
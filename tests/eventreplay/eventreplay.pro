@@ -0,0 +1,18 @@
+TEMPLATE = app
+TARGET = eventreplay
+
+target.path=/usr/bin
+
+QT = core
+
+QMAKE_CXXFLAGS+= -Wall
+
+LIBS+=-lX11 -lrt
+
+DEPENDPATH += .
+INCLUDEPATH += . ../../src
+
+HEADERS += ../../src/meventlog.h
+SOURCES += eventreplay.cpp
+
+INSTALLS += target
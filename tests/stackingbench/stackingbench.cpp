@@ -0,0 +1,360 @@
+/* Benchmark and fuzzer for the rough stacking rules (MStackingRules) run
+ * against a fake window model, so neither an X server nor a running
+ * compositor is needed.
+ *
+ * Compiling standalone:
+ * g++ -lQtCore -Wall -I../../src -I/usr/include/qt4/QtCore/ -I/usr/include/qt4/ stackingbench.cpp -o stackingbench
+ *
+ * Usage: stackingbench [-s seed] [-r rounds] [n_windows...]
+ *
+ * For each window count a random stack is generated, sorted from scratch
+ * and then mutated and resorted @rounds times.  The average time and number
+ * of comparisons is printed for both.  After every sort the result is
+ * checked for the ordering invariants of the rules.  Then transients and
+ * the decorator are placed with MStackingPlacement, the code checkStacking()
+ * uses, and the stack is checked for transients below their parents and a
+ * decorator not right above its managed window.  The exit status is non-zero if any of these
+ * was violated.
+ * */
+
+#include <QtCore>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "mstackingrules.h"
+
+struct FakeWindow
+{
+    Window id;
+    bool decorator;
+    int state;
+    MStacking::WindowType type;
+    int layer;
+    bool override_redirect, keep_above, modal;
+    Window transient_for;
+};
+
+class FakeModel
+{
+public:
+    typedef const FakeWindow *Item;
+
+    FakeModel() : client(0), comparisons(0) {}
+
+    Item item(Window w) const
+    {
+        ++comparisons;
+        QHash<Window, FakeWindow>::const_iterator i = windows.find(w);
+        return i != windows.end() ? &i.value() : 0;
+    }
+    bool isDecorator(Item w) const { return w->decorator; }
+    Item decoratorClient() const { return client ? item(client) : 0; }
+    int windowState(Item w) const { return w->state; }
+    MStacking::WindowType windowType(Item w) const { return w->type; }
+    int stackingLayer(Item w) const { return w->layer; }
+    bool isOverrideRedirect(Item w) const { return w->override_redirect; }
+    bool isKeepAbove(Item w) const { return w->keep_above; }
+    bool isModal(Item w) const { return w->modal; }
+    bool hasVisibleParent(Item w) const
+    {
+        Item p = w->transient_for ? item(w->transient_for) : 0;
+        return p && p->state == NormalState;
+    }
+    Window transientFor(Item w) const { return w->transient_for; }
+
+    // for MStackingPlacement
+    const QList<Window> *transientWindows(Window w) const
+    {
+        if (!windows.contains(w))
+            return 0;
+        QHash<Window, QList<Window> >::const_iterator i = transients.find(w);
+        return i != transients.end() ? &i.value() : &no_transients;
+    }
+
+    QHash<Window, FakeWindow> windows;
+    // the transients of each window, updated by finishStack()
+    QHash<Window, QList<Window> > transients;
+    QList<Window> no_transients;
+    QList<Window> stack;
+    Window client;
+    mutable long comparisons;
+};
+
+static int rnd(int n)
+{
+    return qrand() % n;
+}
+
+static void randomize(FakeModel &m, FakeWindow &w)
+{
+    static const MStacking::WindowType types[] = {
+        MStacking::OtherType, MStacking::OtherType, MStacking::OtherType,
+        MStacking::DialogType, MStacking::InputType,
+        MStacking::NotificationType
+    };
+
+    w.state = rnd(4) ? NormalState : (rnd(2) ? IconicState : WithdrawnState);
+    w.type = types[rnd(sizeof(types) / sizeof(types[0]))];
+    w.layer = rnd(3) ? 0 : rnd(11);
+    w.override_redirect = !rnd(10);
+    w.keep_above = !rnd(20);
+    w.modal = w.type == MStacking::DialogType && rnd(2);
+    w.transient_for = None;
+    if (!rnd(4) && m.stack.size() > 1) {
+        // maybe transient for another one, loops included
+        Window p = m.stack.at(rnd(m.stack.size()));
+        if (p != w.id && !m.windows.value(p).decorator)
+            w.transient_for = p;
+    }
+}
+
+static void generate(FakeModel &m, int n)
+{
+    m.windows.clear();
+    m.stack.clear();
+    m.client = 0;
+    for (int i = 0; i < n; ++i) {
+        FakeWindow w;
+        w.id = 0x1000000 + i;
+        w.decorator = false;
+        m.stack.append(w.id);
+        m.windows.insert(w.id, w);
+    }
+    // the first one plays the decorator
+    for (int i = 0; i < n; ++i) {
+        FakeWindow &w = m.windows[m.stack.at(i)];
+        randomize(m, w);
+        if (!i) {
+            w.decorator = true;
+            w.transient_for = None;
+        }
+    }
+    if (n > 1 && rnd(2))
+        m.client = m.stack.at(1 + rnd(n - 1));
+    for (int i = m.stack.size() - 1; i > 0; --i)
+        m.stack.swap(i, rnd(i + 1));
+}
+
+// One mutation of the kind the compositor sees: a property change,
+// a new decorated window or a window raised to the top.
+static void mutate(FakeModel &m)
+{
+    Window w = m.stack.at(rnd(m.stack.size()));
+    switch (rnd(3)) {
+    case 0:
+        if (!m.windows[w].decorator)
+            randomize(m, m.windows[w]);
+        break;
+    case 1:
+        if (!m.windows[w].decorator)
+            m.client = rnd(4) ? w : 0;
+        break;
+    default:
+        m.stack.move(m.stack.indexOf(w), m.stack.size() - 1);
+        break;
+    }
+}
+
+// Where the rules put @w: the decorator is ordered like its managed window
+// or below everything if unused, then non-NormalState windows, the desktop,
+// and the rest by layer and special type.  The result must be ordered by
+// this key; transiency only orders windows with equal keys.
+static qint64 rank(const FakeModel &m, const FakeWindow *w)
+{
+    if (w->decorator) {
+        if (!m.client || m.client == w->id)
+            return -1;
+        w = m.item(m.client);
+    }
+    if (w->state != NormalState)
+        return 0;
+    if (w->type == MStacking::DesktopType)
+        return 1;
+
+    MStacking::WindowType special = MStacking::OtherType;
+    if (w->layer < 6 && w->type == MStacking::NotificationType)
+        special = MStacking::NotificationType;
+    else if (w->layer < 5 && (w->type == MStacking::InputType
+                              || w->override_redirect || w->keep_above))
+        special = MStacking::InputType;
+    else if (w->layer < 4 && w->type == MStacking::DialogType && w->modal)
+        special = MStacking::DialogType;
+    if (m.hasVisibleParent(w))
+        special = MStacking::OtherType;
+    return 2 + w->layer * 8 + special;
+}
+
+// Whether @w is transient for itself through a chain of parents.
+static bool inTransientLoop(const FakeModel &m, const FakeWindow *w)
+{
+    const FakeWindow *p = w;
+    for (int n = 0; n < m.stack.size(); ++n) {
+        if (!p->transient_for || !(p = m.item(p->transient_for)))
+            return false;
+        if (p == w)
+            return true;
+    }
+    // a loop further up the chain
+    return true;
+}
+
+// Places the windows the way checkStacking() does after roughSort(),
+// with the same MStackingPlacement: every window raised with its
+// transients, the parents in their stacking order, and the decorator
+// right above its managed window, or to the bottom if it's unused.
+static void finishStack(FakeModel &m)
+{
+    m.transients.clear();
+    foreach (Window w, m.stack) {
+        const FakeWindow *fw = m.item(w);
+        if (fw->transient_for)
+            m.transients[fw->transient_for].append(w);
+    }
+
+    MStackingPlacement<FakeModel> placement(m, m.stack);
+    QList<Window> order = m.stack;
+    foreach (Window w, order) {
+        const FakeWindow *fw = m.item(w);
+        if (!fw->transient_for || !m.item(fw->transient_for)
+            || inTransientLoop(m, fw))
+            placement.raiseWithTransients(w, m.stack.indexOf(w));
+    }
+
+    for (int i = 0; i < m.stack.size(); ++i)
+        if (m.item(m.stack.at(i))->decorator) {
+            if (m.client && m.client != m.stack.at(i))
+                placement.placeDecorator(i, m.stack.indexOf(m.client));
+            else
+                placement.lowerDecorator(i);
+            break;
+        }
+}
+
+// Checks the invariants left to checkStacking() on a finishStack()ed
+// stack: transients are above their parents and the decorator is
+// directly above its managed window.
+static int checkFinished(const FakeModel &m)
+{
+    int errors = 0;
+    QHash<Window, int> pos;
+    for (int i = 0; i < m.stack.size(); ++i)
+        pos.insert(m.stack.at(i), i);
+
+    for (int i = 0; i < m.stack.size(); ++i) {
+        const FakeWindow *w = m.item(m.stack.at(i));
+        if (w->decorator && m.client && m.client != w->id
+            && pos.value(m.client) + 1 != i) {
+            fprintf(stderr, "FAIL: decorator 0x%lx at %d is not right above "
+                    "its managed window at %d\n", w->id, i,
+                    pos.value(m.client));
+            ++errors;
+        }
+        if (w->transient_for && m.item(w->transient_for)
+            && !inTransientLoop(m, w) && pos.value(w->transient_for) > i) {
+            fprintf(stderr, "FAIL: 0x%lx at %d is below its parent 0x%lx "
+                    "at %d\n", w->id, i, w->transient_for,
+                    pos.value(w->transient_for));
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+static int check(const FakeModel &m, int *transients_below)
+{
+    int errors = 0;
+    qint64 prev = -2;
+    QHash<Window, int> pos;
+    for (int i = 0; i < m.stack.size(); ++i) {
+        const FakeWindow *w = m.item(m.stack.at(i));
+        qint64 r = rank(m, w);
+        if (r < prev) {
+            fprintf(stderr, "FAIL: 0x%lx at %d is ordered above a "
+                    "higher ranking window\n", w->id, i);
+            ++errors;
+        }
+        prev = r;
+        pos.insert(w->id, i);
+    }
+
+    // not an error: checkStacking() raises the transients itself
+    *transients_below = 0;
+    foreach (const FakeWindow &w, m.windows)
+        if (w.transient_for && pos.value(w.transient_for) > pos.value(w.id))
+            ++*transients_below;
+    return errors;
+}
+
+// Returns the time it took in milliseconds.
+static double sortStack(FakeModel &m)
+{
+    struct timeval t0, t1;
+    gettimeofday(&t0, 0);
+    qStableSort(m.stack.begin(), m.stack.end(),
+                MStackingRules<FakeModel>(m));
+    gettimeofday(&t1, 0);
+    return (t1.tv_sec - t0.tv_sec) * 1000.0
+           + (t1.tv_usec - t0.tv_usec) / 1000.0;
+}
+
+int main(int argc, char *argv[])
+{
+    QList<int> sizes;
+    int rounds = 1000;
+    uint seed = time(0);
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            seed = strtoul(argv[++i], 0, 0);
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+            rounds = atoi(argv[++i]);
+        else if (atoi(argv[i]) > 0)
+            sizes.append(atoi(argv[i]));
+        else {
+            printf("usage: %s [-s seed] [-r rounds] [n_windows...]\n",
+                   argv[0]);
+            return 1;
+        }
+    }
+    if (sizes.isEmpty())
+        sizes << 10 << 100 << 1000;
+    printf("seed %u, %d rounds\n", seed, rounds);
+    qsrand(seed);
+
+    int errors = 0;
+    foreach (int n, sizes) {
+        FakeModel m;
+        double full_ms = 0, mut_ms = 0;
+        long full_cmp = 0, mut_cmp = 0, below = 0;
+        int transients_below;
+
+        for (int i = 0; i < rounds; ++i) {
+            generate(m, n);
+            m.comparisons = 0;
+            full_ms += sortStack(m);
+            full_cmp += m.comparisons;
+            errors += check(m, &transients_below);
+            finishStack(m);
+            errors += checkFinished(m);
+
+            mutate(m);
+            m.comparisons = 0;
+            mut_ms += sortStack(m);
+            mut_cmp += m.comparisons;
+            errors += check(m, &transients_below);
+            below += transients_below;
+            finishStack(m);
+            errors += checkFinished(m);
+        }
+        printf("%5d windows: restack %.3f ms %ld lookups, "
+               "after mutation %.3f ms %ld lookups, "
+               "%.2f transients left below parent\n", n,
+               full_ms / rounds, full_cmp / rounds,
+               mut_ms / rounds, mut_cmp / rounds, (double)below / rounds);
+    }
+
+    if (errors)
+        printf("%d ordering violations\n", errors);
+    return errors ? 1 : 0;
+}
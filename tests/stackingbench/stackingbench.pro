@@ -0,0 +1,21 @@
+TEMPLATE = app
+TARGET = stackingbench
+
+target.path=/usr/bin
+
+QT = core
+
+QMAKE_CXXFLAGS+= -Wall
+
+DEPENDPATH += .
+INCLUDEPATH += . ../../src
+
+HEADERS += ../../src/mstackingrules.h
+SOURCES += stackingbench.cpp
+
+INSTALLS += target
+
+# 'make check' fuzzes a few hundred random stacks
+QMAKE_EXTRA_TARGETS += check
+check.depends = $$TARGET
+check.commands = ./$$TARGET -r 200
@@ -3,4 +3,7 @@ TEMPLATE=subdirs
 SUBDIRS = windowctl \
           windowstack \
           focus-tracker \
+          stackingbench \
+          eventreplay \
+          tracedump \
           functional 
@@ -0,0 +1,149 @@
+/* Prints a trace ring buffer saved by mcompositor with the "trace <file>"
+ * remote control command, optionally merged with an X event log of the
+ * same session (see eventreplay), to see what the compositor was doing
+ * between the events.
+ *
+ * Compiling standalone:
+ * g++ -lQtCore -Wall -I../../src -I/usr/include/qt4/QtCore/ -I/usr/include/qt4/ tracedump.cpp -o tracedump
+ *
+ * Usage: tracedump <trace> [<event log>]
+ *
+ * Every line has the time in seconds since the first printed entry, the
+ * window it is about, and either the trace message or the event with the
+ * time the compositor spent handling it.  Event logs are matched with the
+ * trace by their Clock record; older logs don't have one and can't be
+ * merged.
+ * */
+
+#include <QtCore>
+#include <stdio.h>
+#include <string.h>
+
+#include "mtrace.h"
+#include "meventlog.h"
+
+struct Event
+{
+    quint64 usecs;
+    MEventLogRecord r;
+};
+
+static bool read_trace(const char *fname, QVector<MTraceRecord> *trace,
+                       QByteArray *strings)
+{
+    FILE *in;
+    MTraceHeader h;
+
+    if (!(in = fopen(fname, "r"))) {
+        perror(fname);
+        return false;
+    }
+    if (fread(&h, sizeof(h), 1, in) != 1
+        || memcmp(h.magic, MTRACE_MAGIC, sizeof(h.magic))
+        || h.version != MTRACE_VERSION) {
+        fprintf(stderr, "%s: not a trace of this version\n", fname);
+        fclose(in);
+        return false;
+    }
+
+    trace->resize(h.records);
+    strings->resize(h.strings);
+    if ((h.records && fread(trace->data(), sizeof(MTraceRecord), h.records,
+                            in) != h.records)
+        || (h.strings && fread(strings->data(), h.strings, 1, in) != 1)) {
+        fprintf(stderr, "%s: truncated\n", fname);
+        fclose(in);
+        return false;
+    }
+    fclose(in);
+    if (h.lost)
+        printf("%u older trace records were overwritten\n", h.lost);
+    return true;
+}
+
+// Reads the records of @fname and their CLOCK_MONOTONIC times.
+static bool read_events(const char *fname, QVector<Event> *events)
+{
+    FILE *in;
+    MEventLogHeader h;
+    Event e;
+    QByteArray payload;
+    bool have_clock = false;
+
+    if (!(in = fopen(fname, "r"))) {
+        perror(fname);
+        return false;
+    }
+    if (fread(&h, sizeof(h), 1, in) != 1
+        || memcmp(h.magic, MEVENTLOG_MAGIC, sizeof(h.magic))
+        || h.version != MEVENTLOG_VERSION) {
+        fprintf(stderr, "%s: not an event log of this version\n", fname);
+        fclose(in);
+        return false;
+    }
+
+    e.usecs = 0;
+    while (fread(&e.r, sizeof(e.r), 1, in) == 1) {
+        payload.resize(e.r.length);
+        if (e.r.length && fread(payload.data(), e.r.length, 1, in) != 1)
+            break;
+        if (e.r.type == MEventLogRecord::Clock
+            && e.r.length >= (int)sizeof(MEventLogClock)) {
+            e.usecs = ((const MEventLogClock *)payload.constData())->usecs;
+            have_clock = true;
+            continue;
+        }
+        e.usecs += e.r.usecs;
+        if (have_clock)
+            events->append(e);
+    }
+    fclose(in);
+
+    if (!have_clock)
+        fprintf(stderr, "%s: no Clock record, the log is too old to be "
+                        "merged\n", fname);
+    return have_clock;
+}
+
+int main(int argc, char **argv)
+{
+    QVector<MTraceRecord> trace;
+    QByteArray strings;
+    QVector<Event> events;
+
+    if (argc < 2 || argc > 3 || argv[1][0] == '-') {
+        printf("usage: %s <trace> [<event log>]\n", argv[0]);
+        return 1;
+    }
+    if (!read_trace(argv[1], &trace, &strings))
+        return 1;
+    if (argc > 2 && !read_events(argv[2], &events))
+        return 1;
+
+    // both are in chronological order already
+    quint64 start = 0;
+    if (!trace.isEmpty())
+        start = trace[0].usecs;
+    if (!events.isEmpty() && (!start || events[0].usecs < start))
+        start = events[0].usecs;
+
+    int t = 0, e = 0;
+    while (t < trace.size() || e < events.size()) {
+        if (e >= events.size()
+            || (t < trace.size() && trace[t].usecs <= events[e].usecs)) {
+            const MTraceRecord &r = trace[t++];
+            if (r.fun < (quint32)strings.size())
+                printf("%12.6f 0x%08x %s from %s\n", (r.usecs - start) / 1e6,
+                       r.window, r.text, strings.constData() + r.fun);
+            else
+                printf("%12.6f 0x%08x %s\n", (r.usecs - start) / 1e6,
+                       r.window, r.text);
+        } else {
+            const Event &ev = events[e++];
+            printf("%12.6f 0x%08x   <%s> handled in %u us\n",
+                   (ev.usecs - start) / 1e6, ev.r.window,
+                   MEventLogRecord::typeName(ev.r.type), ev.r.handler_usecs);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,16 @@
+TEMPLATE = app
+TARGET = tracedump
+
+target.path=/usr/bin
+
+QT = core
+
+QMAKE_CXXFLAGS+= -Wall
+
+DEPENDPATH += .
+INCLUDEPATH += . ../../src
+
+HEADERS += ../../src/mtrace.h ../../src/meventlog.h
+SOURCES += tracedump.cpp
+
+INSTALLS += target